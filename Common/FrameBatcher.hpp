@@ -0,0 +1,294 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+#include "Opcodes.h"
+#include "WireCodec.hpp"
+
+// Coalesces the messages of a tick into kFrame datagrams.
+//
+// A frame is laid out as uint32_t kFrame, uint16_t message count, then for
+// each message uint32_t opcode, uint16_t size and the payload. Messages are
+// sent by decreasing opcode priority, whatever does not fit in the per tick
+// byte budget stays queued for the next tick, the first message of a tick is
+// always sent so a large one cannot starve. Queued messages older than the
+// maximum age are dropped, as are the oldest ones once the queue holds more
+// than the maximum pending bytes.
+//
+// Until SetPeerVersion() reports kFrameVersion or later, and for peers older
+// than that, every message goes out as its own datagram made of the uint32_t
+// opcode and the payload, as before. So do payloads too large for the
+// uint16_t size of a framed message.
+//
+// Nothing in the transport sends or negotiates frames yet, so kProtocolVersion
+// in Opcodes.h does not advertise them: it moves to kFrameVersion, and kFrame
+// joins the opcodes there, once the send and receive paths go through
+// FrameBatcher and FrameReader and the handshake reports the peer's version.
+
+class FrameBatcher
+{
+public:
+
+	typedef std::function<void(const uint8_t*, size_t)> Sink;
+
+	enum
+	{
+		kFrame = 'fram',
+		kFrameVersion = 3,	// first protocol version that will understand kFrame datagrams
+		kFrameHeaderSize = sizeof(uint32_t) + sizeof(uint16_t),
+		kMessageHeaderSize = sizeof(uint32_t) + sizeof(uint16_t),
+		kDefaultDatagramSize = 1200,
+		kMaxFramedSize = 0xFFFF,
+		kDefaultMaxPending = 0x10000,
+		kDefaultMaxAge = 30
+	};
+
+	FrameBatcher(size_t pDatagramSize = kDefaultDatagramSize)
+		: mDatagramSize(pDatagramSize), mPeerVersion(0), mSequence(0), mTick(0), mBudget(0),
+		  mMaxPending(kDefaultMaxPending), mMaxAge(kDefaultMaxAge), mDropped(0)
+	{
+	}
+
+	// The version sent by the peer during the handshake, nothing is framed before it is known.
+	void SetPeerVersion(uint32_t pVersion) { mPeerVersion = pVersion; }
+	bool IsBatching() const { return mPeerVersion >= kFrameVersion; }
+
+	void SetPriority(uint32_t pOpcode, int pPriority) { mPriorities[pOpcode] = pPriority; }
+
+	// Bytes per tick, 0 means unlimited.
+	void SetBudget(size_t pBudget) { mBudget = pBudget; }
+
+	// Bytes kept queued past a Flush, 0 means unlimited.
+	void SetMaxPending(size_t pBytes) { mMaxPending = pBytes; }
+
+	// Flushes a message may wait before it is dropped, 0 means forever.
+	void SetMaxAge(uint32_t pTicks) { mMaxAge = pTicks; }
+
+	// Messages dropped for being too old or over the pending limit.
+	size_t Dropped() const { return mDropped; }
+
+	void Queue(uint32_t pOpcode, const void* pData, size_t pSize)
+	{
+		Message message;
+		message.Opcode = pOpcode;
+		message.Priority = GetPriority(pOpcode);
+		message.Sequence = mSequence++;
+		message.Tick = mTick;
+		message.Offset = mPayload.size();
+		message.Size = pSize;
+		mMessages.push_back(message);
+
+		const uint8_t* data = static_cast<const uint8_t*>(pData);
+		mPayload.insert(mPayload.end(), data, data + pSize);
+	}
+
+	// Sends what the budget allows, returns the number of bytes handed to pSink.
+	size_t Flush(const Sink& pSink)
+	{
+		std::stable_sort(mMessages.begin(), mMessages.end(), [](const Message& a, const Message& b)
+		{
+			return a.Priority > b.Priority;
+		});
+
+		mDatagram.resize(mDatagramSize);
+
+		size_t sent = 0;
+		std::vector<Message> pending;
+
+		WireWriter writer(mDatagram.data(), mDatagram.size());
+		uint8_t* count = nullptr;
+		uint16_t messages = 0;
+
+		for(auto& message : mMessages)
+		{
+			const size_t used = sent + writer.Size();
+			const size_t cost = message.Size + kMessageHeaderSize + (messages ? 0 : kFrameHeaderSize);
+			if(mBudget && used && used + cost > mBudget)
+			{
+				pending.push_back(message);
+				continue;
+			}
+
+			const uint8_t* payload = mPayload.data() + message.Offset;
+
+			// Oversized messages and old peers get a datagram of their own.
+			if(!IsBatching() || message.Size > kMaxFramedSize || message.Size + kFrameHeaderSize + kMessageHeaderSize > mDatagramSize)
+			{
+				mSingle.resize(sizeof(uint32_t) + message.Size);
+				std::memcpy(mSingle.data(), &message.Opcode, sizeof(uint32_t));
+				std::memcpy(mSingle.data() + sizeof(uint32_t), payload, message.Size);
+				pSink(mSingle.data(), mSingle.size());
+				sent += mSingle.size();
+				continue;
+			}
+
+			if(writer.Remaining() < message.Size + kMessageHeaderSize || messages == 0xFFFF)
+			{
+				sent += Emit(writer, count, messages, pSink);
+				writer.Reset();
+				count = nullptr;
+				messages = 0;
+			}
+
+			if(!count)
+			{
+				writer.WritePod(uint32_t(kFrame));
+				count = writer.Reserve(sizeof(uint16_t));
+			}
+
+			writer.WritePod(message.Opcode);
+			writer.WritePod(uint16_t(message.Size));
+			writer.Write(payload, message.Size);
+			++messages;
+		}
+
+		sent += Emit(writer, count, messages, pSink);
+
+		Compact(pending);
+		++mTick;
+		return sent;
+	}
+
+	size_t Pending() const { return mMessages.size(); }
+
+private:
+
+	struct Message
+	{
+		uint32_t Opcode;
+		int Priority;
+		uint32_t Sequence;
+		uint32_t Tick;
+		size_t Offset;
+		size_t Size;
+	};
+
+	int GetPriority(uint32_t pOpcode) const
+	{
+		auto itor = mPriorities.find(pOpcode);
+		return itor == mPriorities.end() ? 0 : itor->second;
+	}
+
+	static size_t Emit(WireWriter& pWriter, uint8_t* pCount, uint16_t pMessages, const Sink& pSink)
+	{
+		if(!pMessages)
+			return 0;
+		std::memcpy(pCount, &pMessages, sizeof(pMessages));
+		pSink(pWriter.Data(), pWriter.Size());
+		return pWriter.Size();
+	}
+
+	// Keeps the messages that did not fit, in their original order, dropping
+	// the stale ones and the oldest beyond the pending limit.
+	void Compact(std::vector<Message>& pPending)
+	{
+		std::sort(pPending.begin(), pPending.end(), [](const Message& a, const Message& b)
+		{
+			return a.Sequence < b.Sequence;
+		});
+
+		const uint32_t tick = mTick;
+		const uint32_t maxAge = mMaxAge;
+		auto stale = std::remove_if(pPending.begin(), pPending.end(), [tick, maxAge](const Message& a)
+		{
+			return maxAge && tick - a.Tick >= maxAge;
+		});
+		mDropped += size_t(pPending.end() - stale);
+		pPending.erase(stale, pPending.end());
+
+		if(mMaxPending)
+		{
+			size_t bytes = 0;
+			size_t first = pPending.size();
+			while(first && bytes + pPending[first - 1].Size <= mMaxPending)
+				bytes += pPending[--first].Size;
+
+			mDropped += first;
+			pPending.erase(pPending.begin(), pPending.begin() + first);
+		}
+
+		std::vector<uint8_t> payload;
+		for(auto& message : pPending)
+		{
+			const size_t offset = payload.size();
+			payload.insert(payload.end(), mPayload.begin() + message.Offset, mPayload.begin() + message.Offset + message.Size);
+			message.Offset = offset;
+		}
+
+		mPayload.swap(payload);
+		mMessages.swap(pPending);
+	}
+
+	size_t mDatagramSize;
+	uint32_t mPeerVersion;
+	uint32_t mSequence;
+	uint32_t mTick;
+	size_t mBudget;
+	size_t mMaxPending;
+	uint32_t mMaxAge;
+	size_t mDropped;
+	std::unordered_map<uint32_t, int> mPriorities;
+	std::vector<Message> mMessages;
+	std::vector<uint8_t> mPayload;
+	std::vector<uint8_t> mDatagram;
+	std::vector<uint8_t> mSingle;
+};
+
+// Walks the messages of a received datagram, which is either a kFrame or a
+// single opcode prefixed message.
+class FrameReader
+{
+public:
+
+	FrameReader(const void* pData, size_t pSize)
+		: mReader(pData, pSize), mRemaining(1), mSingle(true)
+	{
+		uint32_t magic = 0;
+		if(pSize >= FrameBatcher::kFrameHeaderSize)
+			std::memcpy(&magic, pData, sizeof(magic));
+
+		if(magic == uint32_t(FrameBatcher::kFrame))
+		{
+			uint16_t count = 0;
+			mReader.ReadPod(magic);
+			mReader.ReadPod(count);
+			mRemaining = count;
+			mSingle = false;
+		}
+	}
+
+	bool IsFrame() const { return !mSingle; }
+
+	// Returns false once every message has been read or the datagram is malformed.
+	bool Next(uint32_t& pOpcode, const uint8_t*& pPayload, size_t& pSize)
+	{
+		if(!mRemaining)
+			return false;
+		--mRemaining;
+
+		if(mSingle)
+		{
+			if(!mReader.ReadPod(pOpcode))
+				return false;
+			pSize = mReader.Remaining();
+			pPayload = mReader.Take(pSize);
+			return true;
+		}
+
+		uint16_t size;
+		if(!mReader.ReadPod(pOpcode) || !mReader.ReadPod(size))
+			return false;
+		pPayload = mReader.Take(size);
+		pSize = size;
+		return pPayload != nullptr;
+	}
+
+private:
+
+	WireReader mReader;
+	uint16_t mRemaining;
+	bool mSingle;
+};
@@ -0,0 +1,194 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Area of interest for PlayerGOMEntryReplication fan-out.
+//
+// Entries are bucketed in a uniform grid per Region using their Position, an
+// update is only sent to the entries of the cells in range. Each region has its
+// own cell table keyed by both 32 bit cell coordinates, so distant cells never
+// share a bucket however large the worldspace. Farther receivers
+// get updates at a lower rate, each tier sends one tick out of Interval, the
+// tick is offset per pair so the load is spread instead of bursting.
+
+struct InterestTier
+{
+	float Distance;
+	uint32_t Interval;
+};
+
+class InterestGrid
+{
+public:
+
+	InterestGrid(float pCellSize = 4096.f)
+		: mCellSize(pCellSize)
+	{
+		InterestTier tiers[] = {{4096.f, 1}, {8192.f, 2}, {16384.f, 4}};
+		SetTiers(tiers, 3);
+	}
+
+	// Tiers must be sorted by increasing distance, nothing is sent beyond the last one.
+	void SetTiers(const InterestTier* pTiers, size_t pCount)
+	{
+		mTiers.assign(pTiers, pTiers + pCount);
+		mRange = mTiers.empty() ? 0.f : mTiers.back().Distance;
+		mCellRange = int32_t(std::ceil(mRange / mCellSize));
+	}
+
+	void Update(uint32_t pId, uint32_t pRegion, const float* pPosition)
+	{
+		const uint64_t key = CellKey(pPosition);
+
+		auto itor = mEntries.find(pId);
+		if(itor == mEntries.end())
+		{
+			Entry entry;
+			entry.Region = pRegion;
+			entry.Position[0] = pPosition[0];
+			entry.Position[1] = pPosition[1];
+			entry.Position[2] = pPosition[2];
+			entry.Cell = key;
+			Insert(pId, entry);
+			itor = mEntries.insert(std::make_pair(pId, entry)).first;
+		}
+		else if(itor->second.Region != pRegion || itor->second.Cell != key)
+		{
+			Erase(itor->second);
+			itor->second.Region = pRegion;
+			itor->second.Cell = key;
+			Insert(pId, itor->second);
+		}
+
+		Entry& entry = itor->second;
+		entry.Position[0] = pPosition[0];
+		entry.Position[1] = pPosition[1];
+		entry.Position[2] = pPosition[2];
+	}
+
+	void Remove(uint32_t pId)
+	{
+		auto itor = mEntries.find(pId);
+		if(itor == mEntries.end())
+			return;
+		Erase(itor->second);
+		mEntries.erase(itor);
+	}
+
+	// Appends the entries that must receive the update of pId on this tick.
+	void GatherSubscribers(uint32_t pId, uint32_t pTick, std::vector<uint32_t>& pSubscribers) const
+	{
+		auto itor = mEntries.find(pId);
+		if(itor == mEntries.end())
+			return;
+
+		const Entry& source = itor->second;
+		const Cells& cells = mRegions.find(source.Region)->second;
+		const int32_t cx = CellCoord(source.Position[0]);
+		const int32_t cy = CellCoord(source.Position[1]);
+
+		for(int32_t x = cx - mCellRange; x <= cx + mCellRange; ++x)
+		{
+			for(int32_t y = cy - mCellRange; y <= cy + mCellRange; ++y)
+			{
+				auto cell = cells.find(MakeKey(x, y));
+				if(cell == cells.end())
+					continue;
+
+				for(auto id : cell->second)
+				{
+					if(id == pId)
+						continue;
+
+					const Entry& other = mEntries.find(id)->second;
+					const uint32_t interval = Interval(DistanceSquared(source, other));
+					if(interval && (pTick + pId + id) % interval == 0)
+						pSubscribers.push_back(id);
+				}
+			}
+		}
+	}
+
+	size_t Size() const { return mEntries.size(); }
+
+private:
+
+	struct Entry
+	{
+		uint32_t Region;
+		float Position[3];
+		uint64_t Cell;
+		size_t Slot;
+	};
+
+	typedef std::unordered_map<uint64_t, std::vector<uint32_t>> Cells;
+
+	uint32_t Interval(float pDistanceSquared) const
+	{
+		for(auto& tier : mTiers)
+		{
+			if(pDistanceSquared <= tier.Distance * tier.Distance)
+				return tier.Interval;
+		}
+		return 0;
+	}
+
+	static float DistanceSquared(const Entry& pA, const Entry& pB)
+	{
+		const float dx = pA.Position[0] - pB.Position[0];
+		const float dy = pA.Position[1] - pB.Position[1];
+		const float dz = pA.Position[2] - pB.Position[2];
+		return dx * dx + dy * dy + dz * dz;
+	}
+
+	int32_t CellCoord(float pValue) const
+	{
+		return int32_t(std::floor(pValue / mCellSize));
+	}
+
+	uint64_t CellKey(const float* pPosition) const
+	{
+		return MakeKey(CellCoord(pPosition[0]), CellCoord(pPosition[1]));
+	}
+
+	static uint64_t MakeKey(int32_t pX, int32_t pY)
+	{
+		return (uint64_t(uint32_t(pX)) << 32) | uint64_t(uint32_t(pY));
+	}
+
+	void Insert(uint32_t pId, Entry& pEntry)
+	{
+		std::vector<uint32_t>& cell = mRegions[pEntry.Region][pEntry.Cell];
+		pEntry.Slot = cell.size();
+		cell.push_back(pId);
+	}
+
+	// Swap with the last id of the cell so removal stays O(1).
+	void Erase(const Entry& pEntry)
+	{
+		auto region = mRegions.find(pEntry.Region);
+		auto cell = region->second.find(pEntry.Cell);
+		std::vector<uint32_t>& ids = cell->second;
+		const uint32_t moved = ids.back();
+		ids[pEntry.Slot] = moved;
+		ids.pop_back();
+		if(ids.empty())
+		{
+			region->second.erase(cell);
+			if(region->second.empty())
+				mRegions.erase(region);
+		}
+		else if(pEntry.Slot < ids.size())
+			mEntries.find(moved)->second.Slot = pEntry.Slot;
+	}
+
+	float mCellSize;
+	float mRange;
+	int32_t mCellRange;
+	std::vector<InterestTier> mTiers;
+	std::unordered_map<uint32_t, Entry> mEntries;
+	std::unordered_map<uint32_t, Cells> mRegions;
+};
@@ -0,0 +1,443 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+// Compact encoding of the PlayerMoveState stream.
+//
+// Positions are quantized against the origin of the region the player is in,
+// every update is then encoded as the difference to the last state the
+// receiver acknowledged and the differences are bit packed. The mask uses the
+// same flags as the PlayerMoveState SwitchedFields, a field is only written
+// when its quantized value differs from the baseline.
+//
+// One MoveEncoder is kept per (sender, receiver) pair on the sending side and
+// one MoveDecoder per sender on the receiving side. The receiver reports the
+// sequence returned by MoveDecoder::Decode back, the sender feeds it to
+// MoveEncoder::Ack. Region changes travel in band with the first full update
+// of the new region so both sides always quantize against the same origin.
+
+enum
+{
+	kMoveHeading = 0x0001,
+	kMovePosition = 0x0002,
+	kMoveSpeed = 0x0004,
+	kMoveTime = 0x0008,
+	kMoveAll = 0x000F
+};
+
+class BitWriter
+{
+public:
+
+	BitWriter(void* pBuffer, size_t pCapacity)
+		: mData(static_cast<uint8_t*>(pBuffer)), mCapacity(pCapacity * 8), mBit(0), mOverflow(false)
+	{
+		std::memset(mData, 0, pCapacity);
+	}
+
+	void Write(uint32_t pValue, uint32_t pBits)
+	{
+		if(mBit + pBits > mCapacity)
+		{
+			mOverflow = true;
+			return;
+		}
+		for(uint32_t i = 0; i < pBits; ++i, ++mBit)
+		{
+			if(pValue & (1u << i))
+				mData[mBit >> 3] |= uint8_t(1u << (mBit & 7));
+		}
+	}
+
+	size_t Bytes() const { return (mBit + 7) / 8; }
+	size_t Bits() const { return mBit; }
+	bool Overflow() const { return mOverflow; }
+
+private:
+
+	uint8_t* mData;
+	size_t mCapacity;
+	size_t mBit;
+	bool mOverflow;
+};
+
+class BitReader
+{
+public:
+
+	BitReader(const void* pBuffer, size_t pSize)
+		: mData(static_cast<const uint8_t*>(pBuffer)), mSize(pSize * 8), mBit(0), mError(false)
+	{
+	}
+
+	uint32_t Read(uint32_t pBits)
+	{
+		if(mBit + pBits > mSize)
+		{
+			mError = true;
+			return 0;
+		}
+		uint32_t value = 0;
+		for(uint32_t i = 0; i < pBits; ++i, ++mBit)
+		{
+			if(mData[mBit >> 3] & (1u << (mBit & 7)))
+				value |= 1u << i;
+		}
+		return value;
+	}
+
+	size_t Bytes() const { return (mBit + 7) / 8; }
+	bool Error() const { return mError; }
+
+private:
+
+	const uint8_t* mData;
+	size_t mSize;
+	size_t mBit;
+	bool mError;
+};
+
+struct MoveState
+{
+	float Heading;
+	float Position[3];
+	float Speed;
+	uint64_t Time;
+};
+
+class MoveCodec
+{
+public:
+
+	// Quantization steps. Quantizing and dequantizing is done in double, so the
+	// decoded error is at most half a step plus the rounding of the decoded
+	// value to float, which is half an ulp: pMagnitude * 2^-24 for a value of
+	// that magnitude. Far from the world origin that term is not negligible,
+	// at 100000 units it is 0.006.
+	static float PositionStep() { return 1.f / 8.f; }
+	static float SpeedStep() { return 1.f / 4.f; }
+	static float HeadingRange() { return 360.f; }
+	static double MaxPositionError(double pMagnitude) { return PositionStep() * 0.5 + FloatRounding(pMagnitude); }
+	static double MaxSpeedError(double pMagnitude) { return SpeedStep() * 0.5 + FloatRounding(pMagnitude); }
+	static double MaxHeadingError() { return HeadingRange() / 65536.0 * 0.5 + FloatRounding(HeadingRange()); }
+
+	enum
+	{
+		kSequenceBits = 16,
+		kAgeBits = 5,
+		kHistory = 1 << kAgeBits
+	};
+
+	// Size of the largest possible update, for pre-sizing send buffers.
+	enum
+	{
+		kMaxBits = kSequenceBits + kAgeBits + 4 + 1 + 4 * 32 + 5 * (2 + 32) + (1 + 2 + 32 + 32),
+		kMaxBytes = (kMaxBits + 7) / 8
+	};
+
+	struct Quantized
+	{
+		uint32_t Sequence;
+		uint32_t Heading;
+		int32_t Position[3];
+		int32_t Speed;
+		uint64_t Time;
+	};
+
+	static Quantized Quantize(const MoveState& pState, const float* pOrigin)
+	{
+		Quantized q;
+		q.Sequence = 0;
+		double heading = std::fmod(double(pState.Heading), double(HeadingRange()));
+		if(heading < 0.0)
+			heading += HeadingRange();
+		q.Heading = uint32_t(Round(heading / HeadingRange() * 65536.0)) & 0xFFFF;
+		for(int i = 0; i < 3; ++i)
+			q.Position[i] = Round((double(pState.Position[i]) - double(pOrigin[i])) / PositionStep());
+		q.Speed = Round(double(pState.Speed) / SpeedStep());
+		q.Time = pState.Time;
+		return q;
+	}
+
+	static MoveState Dequantize(const Quantized& pQuantized, const float* pOrigin)
+	{
+		MoveState state;
+		state.Heading = float(double(pQuantized.Heading) / 65536.0 * HeadingRange());
+		for(int i = 0; i < 3; ++i)
+			state.Position[i] = float(double(pQuantized.Position[i]) * PositionStep() + double(pOrigin[i]));
+		state.Speed = float(double(pQuantized.Speed) * SpeedStep());
+		state.Time = pQuantized.Time;
+		return state;
+	}
+
+	static Quantized Zero()
+	{
+		Quantized q;
+		std::memset(&q, 0, sizeof(q));
+		return q;
+	}
+
+	// Signed values are zigzagged and written with a 2 bit width class, small
+	// deltas which are the common case for movement take 6 or 10 bits.
+	static void WriteSigned(BitWriter& pWriter, int32_t pValue)
+	{
+		const uint32_t zigzag = (uint32_t(pValue) << 1) ^ uint32_t(pValue >> 31);
+		uint32_t widthClass = 0;
+		while(widthClass < 3 && (zigzag >> Width(widthClass)) != 0)
+			++widthClass;
+		pWriter.Write(widthClass, 2);
+		pWriter.Write(zigzag, Width(widthClass));
+	}
+
+	static int32_t ReadSigned(BitReader& pReader)
+	{
+		const uint32_t zigzag = pReader.Read(Width(pReader.Read(2)));
+		return int32_t(zigzag >> 1) ^ -int32_t(zigzag & 1);
+	}
+
+	static void WriteTime(BitWriter& pWriter, uint64_t pTime, uint64_t pBaseline)
+	{
+		const int64_t delta = int64_t(pTime - pBaseline);
+		if(delta >= INT32_MIN && delta <= INT32_MAX)
+		{
+			pWriter.Write(0, 1);
+			WriteSigned(pWriter, int32_t(delta));
+		}
+		else
+		{
+			pWriter.Write(1, 1);
+			pWriter.Write(uint32_t(pTime), 32);
+			pWriter.Write(uint32_t(pTime >> 32), 32);
+		}
+	}
+
+	static uint64_t ReadTime(BitReader& pReader, uint64_t pBaseline)
+	{
+		if(pReader.Read(1) == 0)
+			return pBaseline + uint64_t(int64_t(ReadSigned(pReader)));
+		const uint64_t low = pReader.Read(32);
+		return low | (uint64_t(pReader.Read(32)) << 32);
+	}
+
+private:
+
+	static uint32_t Width(uint32_t pClass)
+	{
+		static const uint32_t widths[4] = {4, 8, 16, 32};
+		return widths[pClass & 3];
+	}
+
+	static int32_t Round(double pValue)
+	{
+		return int32_t(std::floor(pValue + 0.5));
+	}
+
+	static double FloatRounding(double pMagnitude)
+	{
+		return std::fabs(pMagnitude) * (1.0 / 16777216.0);
+	}
+};
+
+class MoveEncoder
+{
+public:
+
+	MoveEncoder()
+		: mSequence(0), mAcked(0), mHasAck(false), mRegion(0), mRegionSequence(0), mSendRegion(false)
+	{
+		std::memset(mOrigin, 0, sizeof(mOrigin));
+		for(int i = 0; i < MoveCodec::kHistory; ++i)
+			mHistory[i] = MoveCodec::Zero();
+	}
+
+	// Changing region moves the quantization origin, the receiver cannot use
+	// older baselines anymore so the next update is sent in full.
+	void SetRegion(uint32_t pRegion, const float* pOrigin)
+	{
+		if(pRegion == mRegion && std::memcmp(pOrigin, mOrigin, sizeof(mOrigin)) == 0)
+			return;
+		mRegion = pRegion;
+		std::memcpy(mOrigin, pOrigin, sizeof(mOrigin));
+		mRegionSequence = (mSequence + 1) & 0xFFFF;
+		mSendRegion = true;
+		mHasAck = false;
+	}
+
+	void Ack(uint32_t pSequence)
+	{
+		pSequence &= 0xFFFF;
+		const Quantized& entry = mHistory[pSequence % MoveCodec::kHistory];
+		if(entry.Sequence != pSequence || uint16_t(mSequence - pSequence) >= MoveCodec::kHistory)
+			return;
+		// Updates quantized against a previous origin can't serve as baseline.
+		if(int16_t(uint16_t(pSequence - mRegionSequence)) < 0)
+			return;
+		if(!mHasAck || int16_t(uint16_t(pSequence - mAcked)) > 0)
+		{
+			mAcked = pSequence;
+			mHasAck = true;
+			mSendRegion = false;
+		}
+	}
+
+	// Writes the update and returns the mask of the fields it contains.
+	uint32_t Encode(const MoveState& pState, BitWriter& pWriter)
+	{
+		mSequence = (mSequence + 1) & 0xFFFF;
+
+		uint32_t age = 0;
+		Quantized baseline = MoveCodec::Zero();
+		if(mHasAck)
+		{
+			age = uint16_t(mSequence - mAcked);
+			if(age < MoveCodec::kHistory)
+				baseline = mHistory[mAcked % MoveCodec::kHistory];
+			else
+			{
+				age = 0;
+				mHasAck = false;
+			}
+		}
+
+		Quantized current = MoveCodec::Quantize(pState, mOrigin);
+		current.Sequence = mSequence;
+		mHistory[mSequence % MoveCodec::kHistory] = current;
+
+		uint32_t mask = 0;
+		if(current.Heading != baseline.Heading)
+			mask |= kMoveHeading;
+		if(std::memcmp(current.Position, baseline.Position, sizeof(current.Position)) != 0)
+			mask |= kMovePosition;
+		if(current.Speed != baseline.Speed)
+			mask |= kMoveSpeed;
+		if(current.Time != baseline.Time)
+			mask |= kMoveTime;
+
+		pWriter.Write(mSequence, MoveCodec::kSequenceBits);
+		pWriter.Write(age, MoveCodec::kAgeBits);
+		pWriter.Write(mask, 4);
+
+		if(age == 0)
+		{
+			pWriter.Write(mSendRegion ? 1 : 0, 1);
+			if(mSendRegion)
+			{
+				pWriter.Write(mRegion, 32);
+				for(int i = 0; i < 3; ++i)
+				{
+					uint32_t bits;
+					std::memcpy(&bits, &mOrigin[i], sizeof(bits));
+					pWriter.Write(bits, 32);
+				}
+			}
+		}
+
+		if(mask & kMoveHeading)
+			MoveCodec::WriteSigned(pWriter, int32_t(int16_t(uint16_t(current.Heading - baseline.Heading))));
+		if(mask & kMovePosition)
+		{
+			for(int i = 0; i < 3; ++i)
+				MoveCodec::WriteSigned(pWriter, int32_t(uint32_t(current.Position[i]) - uint32_t(baseline.Position[i])));
+		}
+		if(mask & kMoveSpeed)
+			MoveCodec::WriteSigned(pWriter, int32_t(uint32_t(current.Speed) - uint32_t(baseline.Speed)));
+		if(mask & kMoveTime)
+			MoveCodec::WriteTime(pWriter, current.Time, baseline.Time);
+
+		return mask;
+	}
+
+private:
+
+	typedef MoveCodec::Quantized Quantized;
+
+	uint32_t mSequence;
+	uint32_t mAcked;
+	bool mHasAck;
+	uint32_t mRegion;
+	uint32_t mRegionSequence;
+	bool mSendRegion;
+	float mOrigin[3];
+	Quantized mHistory[MoveCodec::kHistory];
+};
+
+class MoveDecoder
+{
+public:
+
+	MoveDecoder()
+		: mRegion(0)
+	{
+		std::memset(mOrigin, 0, sizeof(mOrigin));
+		for(int i = 0; i < MoveCodec::kHistory; ++i)
+			mHistory[i] = MoveCodec::Zero();
+	}
+
+	uint32_t GetRegion() const { return mRegion; }
+	const float* GetOrigin() const { return mOrigin; }
+
+	// Decodes an update, pMask receives the fields it carried and pSequence the
+	// value to acknowledge. Returns false if the data is truncated or refers to
+	// a baseline that is no longer known.
+	bool Decode(BitReader& pReader, MoveState& pState, uint32_t& pMask, uint32_t& pSequence)
+	{
+		const uint32_t sequence = pReader.Read(MoveCodec::kSequenceBits);
+		const uint32_t age = pReader.Read(MoveCodec::kAgeBits);
+		const uint32_t mask = pReader.Read(4);
+		if(pReader.Error())
+			return false;
+
+		Quantized current = MoveCodec::Zero();
+		if(age == 0)
+		{
+			if(pReader.Read(1))
+			{
+				mRegion = pReader.Read(32);
+				for(int i = 0; i < 3; ++i)
+				{
+					const uint32_t bits = pReader.Read(32);
+					std::memcpy(&mOrigin[i], &bits, sizeof(bits));
+				}
+			}
+		}
+		else
+		{
+			const uint32_t baselineSequence = (sequence - age) & 0xFFFF;
+			current = mHistory[baselineSequence % MoveCodec::kHistory];
+			if(current.Sequence != baselineSequence)
+				return false;
+		}
+
+		if(mask & kMoveHeading)
+			current.Heading = (current.Heading + uint32_t(MoveCodec::ReadSigned(pReader))) & 0xFFFF;
+		if(mask & kMovePosition)
+		{
+			for(int i = 0; i < 3; ++i)
+				current.Position[i] = int32_t(uint32_t(current.Position[i]) + uint32_t(MoveCodec::ReadSigned(pReader)));
+		}
+		if(mask & kMoveSpeed)
+			current.Speed = int32_t(uint32_t(current.Speed) + uint32_t(MoveCodec::ReadSigned(pReader)));
+		if(mask & kMoveTime)
+			current.Time = MoveCodec::ReadTime(pReader, current.Time);
+		if(pReader.Error())
+			return false;
+
+		current.Sequence = sequence;
+		mHistory[sequence % MoveCodec::kHistory] = current;
+
+		pState = MoveCodec::Dequantize(current, mOrigin);
+		pMask = mask;
+		pSequence = sequence;
+		return true;
+	}
+
+private:
+
+	typedef MoveCodec::Quantized Quantized;
+
+	uint32_t mRegion;
+	float mOrigin[3];
+	Quantized mHistory[MoveCodec::kHistory];
+};
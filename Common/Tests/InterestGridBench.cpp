@@ -0,0 +1,135 @@
+// Deterministic fan-out simulation for InterestGrid: synthetic players move
+// around a few regions every tick, every player's update is fanned out to the
+// subscribers the grid selects. Reports messages per tick against sending
+// every update to every other player, and CPU per tick for the grid updates
+// plus the subscriber queries.
+//
+// g++ -std=c++11 -O2 -I.. InterestGridBench.cpp -o InterestGridBench
+
+#include "InterestGrid.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+class Random
+{
+public:
+
+	explicit Random(uint32_t pSeed) : mState(pSeed) {}
+
+	uint32_t Next()
+	{
+		mState = mState * 1664525u + 1013904223u;
+		return mState >> 8;
+	}
+
+	// Uniform in [-1, 1).
+	float Signed() { return float(Next()) / float(1u << 23) - 1.f; }
+
+private:
+
+	uint32_t mState;
+};
+
+struct Player
+{
+	uint32_t Region;
+	float Position[3];
+	float Velocity[2];
+};
+
+struct Scenario
+{
+	const char* Name;
+	uint32_t Players;
+	uint32_t Regions;
+	uint32_t Hotspots;		// gathering points per region, players start around one
+	float HotspotSpread;	// how far from their hotspot players start
+	float WorldSize;		// hotspots are spread over +-WorldSize
+};
+
+static const uint32_t kTicks = 200;
+static const float kTickSeconds = 0.05f;
+
+static bool Run(const Scenario& pScenario)
+{
+	Random random(0x1000 + pScenario.Players);
+
+	std::vector<float> hotspots(pScenario.Regions * pScenario.Hotspots * 2);
+	for(size_t i = 0; i < hotspots.size(); ++i)
+		hotspots[i] = random.Signed() * pScenario.WorldSize;
+
+	std::vector<Player> players(pScenario.Players);
+	for(uint32_t i = 0; i < pScenario.Players; ++i)
+	{
+		Player& player = players[i];
+		player.Region = random.Next() % pScenario.Regions;
+		const float* hotspot = &hotspots[(player.Region * pScenario.Hotspots + random.Next() % pScenario.Hotspots) * 2];
+		player.Position[0] = hotspot[0] + random.Signed() * pScenario.HotspotSpread;
+		player.Position[1] = hotspot[1] + random.Signed() * pScenario.HotspotSpread;
+		player.Position[2] = 0.f;
+		// Walking to riding pace.
+		player.Velocity[0] = random.Signed() * 700.f;
+		player.Velocity[1] = random.Signed() * 700.f;
+	}
+
+	InterestGrid grid;
+	std::vector<uint32_t> subscribers;
+	uint64_t messages = 0;
+	double seconds = 0.0;
+
+	for(uint32_t tick = 0; tick < kTicks; ++tick)
+	{
+		for(uint32_t i = 0; i < pScenario.Players; ++i)
+		{
+			Player& player = players[i];
+			if(random.Next() % 40 == 0)
+			{
+				player.Velocity[0] = random.Signed() * 700.f;
+				player.Velocity[1] = random.Signed() * 700.f;
+			}
+			player.Position[0] += player.Velocity[0] * kTickSeconds;
+			player.Position[1] += player.Velocity[1] * kTickSeconds;
+		}
+
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for(uint32_t i = 0; i < pScenario.Players; ++i)
+			grid.Update(i, players[i].Region, players[i].Position);
+
+		for(uint32_t i = 0; i < pScenario.Players; ++i)
+		{
+			subscribers.clear();
+			grid.GatherSubscribers(i, tick, subscribers);
+			messages += subscribers.size();
+		}
+		seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	const double naive = double(pScenario.Players) * (pScenario.Players - 1);
+	const double perTick = double(messages) / kTicks;
+	std::printf("%-10s %5u players  %12.0f -> %9.0f messages/tick (%5.2f%%)  %7.3f ms/tick\n",
+		pScenario.Name, pScenario.Players, naive, perTick, perTick / naive * 100.0, seconds * 1000.0 / kTicks);
+
+	return grid.Size() == pScenario.Players;
+}
+
+int main()
+{
+	static const Scenario scenarios[] =
+	{
+		// Players gathered in a few towns of one large worldspace and some interiors.
+		{"towns", 1000, 4, 6, 6000.f, 200000.f},
+		{"towns", 1500, 4, 6, 6000.f, 200000.f},
+		{"towns", 4000, 4, 6, 6000.f, 200000.f},
+		// Spread thinly over a huge worldspace, where cells far apart must not share a bucket.
+		{"wide", 1500, 1, 64, 50000.f, 2000000000.f},
+	};
+
+	bool ok = true;
+	for(size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); ++i)
+		ok = Run(scenarios[i]) && ok;
+
+	return ok ? 0 : 1;
+}
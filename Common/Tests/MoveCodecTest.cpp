@@ -0,0 +1,277 @@
+// Round trips movement traces through MoveEncoder/MoveDecoder over a lossy
+// link and reports bytes per update, the compression ratio against the plain
+// PlayerMoveState packet and the largest decoding errors, failing if any error
+// exceeds the bound MoveCodec documents.
+//
+// g++ -std=c++11 -O2 -I.. MoveCodecTest.cpp -o MoveCodecTest
+// ./MoveCodecTest [trace]
+//
+// A trace is a text file with one update per line:
+//   time heading x y z speed region originX originY originZ
+// Without one, deterministic synthetic traces are generated: walking, running
+// and riding players crossing regions, in the middle of the world and near
+// its edge where float precision is coarsest.
+
+#include "MoveCodec.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+struct TraceStep
+{
+	MoveState State;
+	uint32_t Region;
+	float Origin[3];
+};
+
+// Small deterministic generator so runs are comparable across machines.
+class Random
+{
+public:
+
+	explicit Random(uint32_t pSeed) : mState(pSeed) {}
+
+	uint32_t Next()
+	{
+		mState = mState * 1664525u + 1013904223u;
+		return mState >> 8;
+	}
+
+	// Uniform in [0, 1).
+	double Unit() { return Next() / double(1u << 24); }
+
+	bool Chance(double pProbability) { return Unit() < pProbability; }
+
+private:
+
+	uint32_t mState;
+};
+
+static const float kRegionSize = 4096.f;
+
+static void SetRegion(TraceStep& pStep)
+{
+	const int32_t cellX = int32_t(std::floor(pStep.State.Position[0] / kRegionSize));
+	const int32_t cellY = int32_t(std::floor(pStep.State.Position[1] / kRegionSize));
+	pStep.Region = (uint32_t(cellX) & 0xFFFF) | (uint32_t(cellY) << 16);
+	pStep.Origin[0] = cellX * kRegionSize;
+	pStep.Origin[1] = cellY * kRegionSize;
+	pStep.Origin[2] = 0.f;
+}
+
+// A player wandering around pStart: walks, runs or rides in straight legs,
+// turning and changing pace between them, standing still now and then.
+static std::vector<TraceStep> Generate(uint32_t pSeed, const float* pStart, uint32_t pSteps)
+{
+	static const float kSpeeds[] = {0.f, 110.f, 360.f, 720.f};
+	static const uint64_t kTickMs = 50;
+
+	Random random(pSeed);
+	std::vector<TraceStep> trace;
+	trace.reserve(pSteps);
+
+	TraceStep step;
+	step.State.Heading = float(random.Unit() * 360.0);
+	step.State.Position[0] = pStart[0];
+	step.State.Position[1] = pStart[1];
+	step.State.Position[2] = pStart[2];
+	step.State.Speed = kSpeeds[1];
+	step.State.Time = 1000000;
+
+	uint32_t legLeft = 0;
+	for(uint32_t i = 0; i < pSteps; ++i)
+	{
+		if(legLeft-- == 0)
+		{
+			legLeft = 20 + random.Next() % 100;
+			step.State.Speed = kSpeeds[random.Next() % 4];
+			step.State.Heading = std::fmod(step.State.Heading + float(random.Unit() * 120.0 - 60.0) + 360.f, 360.f);
+		}
+
+		const double radians = step.State.Heading * 3.14159265358979 / 180.0;
+		const double distance = step.State.Speed * kTickMs / 1000.0;
+		step.State.Position[0] += float(std::sin(radians) * distance);
+		step.State.Position[1] += float(std::cos(radians) * distance);
+		step.State.Position[2] += float(random.Unit() * 2.0 - 1.0) * (step.State.Speed > 0.f ? 1.f : 0.f);
+		step.State.Time += kTickMs;
+
+		SetRegion(step);
+		trace.push_back(step);
+	}
+	return trace;
+}
+
+static bool Load(const char* pPath, std::vector<TraceStep>& pTrace)
+{
+	FILE* file = std::fopen(pPath, "r");
+	if(!file)
+		return false;
+
+	TraceStep step;
+	unsigned long long time;
+	while(std::fscanf(file, "%llu %f %f %f %f %f %u %f %f %f", &time, &step.State.Heading,
+		&step.State.Position[0], &step.State.Position[1], &step.State.Position[2], &step.State.Speed,
+		&step.Region, &step.Origin[0], &step.Origin[1], &step.Origin[2]) == 10)
+	{
+		step.State.Time = time;
+		pTrace.push_back(step);
+	}
+	std::fclose(file);
+	return !pTrace.empty();
+}
+
+struct Result
+{
+	uint32_t Updates;
+	uint32_t Delivered;
+	uint64_t Bytes;
+	uint64_t PlainBytes;
+	double PositionError;
+	double SpeedError;
+	double HeadingError;
+	uint32_t Failures;
+};
+
+// Size of the update as a plain PlayerMoveState: the mask plus every field
+// that changed since the previous update.
+static uint32_t PlainSize(const MoveState& pState, const MoveState* pPrevious)
+{
+	uint32_t size = 4;
+	if(!pPrevious || pState.Heading != pPrevious->Heading)
+		size += 4;
+	if(!pPrevious || std::memcmp(pState.Position, pPrevious->Position, sizeof(pState.Position)) != 0)
+		size += 12;
+	if(!pPrevious || pState.Speed != pPrevious->Speed)
+		size += 4;
+	if(!pPrevious || pState.Time != pPrevious->Time)
+		size += 8;
+	return size;
+}
+
+// Sends the trace over a link that loses pLoss of the updates and of the
+// acknowledgements, acknowledgements arriving pAckDelay updates late.
+static Result Run(const std::vector<TraceStep>& pTrace, double pLoss, uint32_t pAckDelay, uint32_t pSeed)
+{
+	Result result;
+	std::memset(&result, 0, sizeof(result));
+
+	Random random(pSeed);
+	MoveEncoder encoder;
+	MoveDecoder decoder;
+	std::vector<uint32_t> acks;
+
+	uint8_t buffer[MoveCodec::kMaxBytes];
+	for(size_t i = 0; i < pTrace.size(); ++i)
+	{
+		const TraceStep& step = pTrace[i];
+
+		// Acknowledgements due this tick.
+		while(acks.size() > pAckDelay)
+		{
+			encoder.Ack(acks.front());
+			acks.erase(acks.begin());
+		}
+
+		encoder.SetRegion(step.Region, step.Origin);
+		BitWriter writer(buffer, sizeof(buffer));
+		encoder.Encode(step.State, writer);
+		if(writer.Overflow())
+		{
+			++result.Failures;
+			continue;
+		}
+
+		++result.Updates;
+		result.Bytes += writer.Bytes();
+		result.PlainBytes += PlainSize(step.State, i ? &pTrace[i - 1].State : nullptr);
+
+		if(random.Chance(pLoss))
+			continue;
+
+		BitReader reader(buffer, writer.Bytes());
+		MoveState decoded;
+		uint32_t mask, sequence;
+		if(!decoder.Decode(reader, decoded, mask, sequence))
+		{
+			++result.Failures;
+			continue;
+		}
+		++result.Delivered;
+
+		if(!random.Chance(pLoss))
+			acks.push_back(sequence);
+
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			const double error = std::fabs(double(decoded.Position[axis]) - double(step.State.Position[axis]));
+			if(error > MoveCodec::MaxPositionError(step.State.Position[axis]))
+				++result.Failures;
+			if(error > result.PositionError)
+				result.PositionError = error;
+		}
+
+		const double speedError = std::fabs(double(decoded.Speed) - double(step.State.Speed));
+		if(speedError > MoveCodec::MaxSpeedError(step.State.Speed))
+			++result.Failures;
+		if(speedError > result.SpeedError)
+			result.SpeedError = speedError;
+
+		double headingError = std::fabs(std::fmod(double(decoded.Heading) - double(step.State.Heading) + 540.0, 360.0) - 180.0);
+		if(headingError > MoveCodec::MaxHeadingError())
+			++result.Failures;
+		if(headingError > result.HeadingError)
+			result.HeadingError = headingError;
+
+		if(decoded.Time != step.State.Time)
+			++result.Failures;
+	}
+	return result;
+}
+
+static uint32_t Report(const char* pName, const std::vector<TraceStep>& pTrace)
+{
+	static const double kLosses[] = {0.0, 0.1, 0.3};
+
+	uint32_t failures = 0;
+	for(size_t i = 0; i < sizeof(kLosses) / sizeof(kLosses[0]); ++i)
+	{
+		const Result result = Run(pTrace, kLosses[i], 2, 0xC0DEC + uint32_t(i));
+		std::printf("%-16s loss %2.0f%%  %5.2f bytes/update  plain %5.2f  ratio %4.2fx  "
+			"max error pos %.4f speed %.4f heading %.4f  %s\n",
+			pName, kLosses[i] * 100.0,
+			double(result.Bytes) / result.Updates, double(result.PlainBytes) / result.Updates,
+			double(result.PlainBytes) / result.Bytes,
+			result.PositionError, result.SpeedError, result.HeadingError,
+			result.Failures ? "FAILED" : "ok");
+		failures += result.Failures;
+	}
+	return failures;
+}
+
+int main(int argc, char** argv)
+{
+	std::printf("bounds: position %.4f + |x| * 2^-24, speed %.4f + |v| * 2^-24, heading %.4f\n",
+		MoveCodec::PositionStep() * 0.5, MoveCodec::SpeedStep() * 0.5, MoveCodec::MaxHeadingError());
+
+	uint32_t failures = 0;
+	if(argc > 1)
+	{
+		std::vector<TraceStep> trace;
+		if(!Load(argv[1], trace))
+		{
+			std::printf("can't read trace %s\n", argv[1]);
+			return 1;
+		}
+		failures += Report(argv[1], trace);
+	}
+	else
+	{
+		const float center[3] = {1500.f, -2500.f, 200.f};
+		const float edge[3] = {-118000.f, 121000.f, 4000.f};
+		failures += Report("center", Generate(1, center, 20000));
+		failures += Report("world edge", Generate(2, edge, 20000));
+	}
+
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// The serializer the packet classes derive from is not part of this tree, the
+// codecs only look at the template arguments of BasicSerializable, so empty
+// shells are enough for the packet headers to parse in the tests.
+
+using std::string;
+
+template<class... Members>
+class BasicSerializable {};
+
+template<class Mask, class... Fields>
+class SwitchedSerializable {};
+
+template<uint32_t Flag, class T>
+class SwitchedField {};
+
+template<size_t N, class T>
+class BasicArray {};
+
+template<class T>
+class BasicVector {};
+
+#define ACCESSOR_1(pIndex, pName) void pName() {}
+#define ACCESSOR_2(pIndex, pSubIndex, pName) void pName() {}
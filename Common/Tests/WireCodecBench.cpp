@@ -0,0 +1,183 @@
+// Decode/encode throughput and heap allocations per packet for every schema in
+// Common, through WireCodec's views and arena.
+//
+// g++ -std=c++11 -O2 -I.. WireCodecBench.cpp -o WireCodecBench
+
+#include "SerializableStub.hpp"
+#include "ClientPackets.hpp"
+#include "ServerPackets.hpp"
+#include "SharedPackets.hpp"
+#include "WireCodec.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+static size_t gAllocations = 0;
+
+void* operator new(size_t pSize)
+{
+	++gAllocations;
+	if(void* p = std::malloc(pSize ? pSize : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	std::free(p);
+}
+
+static const uint32_t kIterations = 1000000;
+
+static int gFailures = 0;
+
+template<class Packet>
+static void Bench(const char* pName, const typename WirePacket<Packet>::View& pView)
+{
+	static uint8_t buffer[4096];
+	static uint8_t arena[4096];
+
+	WireWriter writer(buffer, sizeof(buffer));
+	const size_t size = WirePacket<Packet>::Encode(pView, writer);
+	if(size == 0 || size != WirePacket<Packet>::Size(pView))
+	{
+		std::printf("%-28s FAILED to encode\n", pName);
+		++gFailures;
+		return;
+	}
+
+	// Summing a member keeps the decode from being optimised out.
+	uint64_t checksum = 0;
+
+	size_t allocations = gAllocations;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for(uint32_t i = 0; i < kIterations; ++i)
+	{
+		typename WirePacket<Packet>::View view;
+		if(!WirePacket<Packet>::Decode(buffer, size, view))
+		{
+			std::printf("%-28s FAILED to decode\n", pName);
+			++gFailures;
+			return;
+		}
+		checksum += WirePacket<Packet>::Size(view);
+	}
+	const double decodeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	const size_t decodeAllocations = gAllocations - allocations;
+
+	allocations = gAllocations;
+	start = std::chrono::steady_clock::now();
+	for(uint32_t i = 0; i < kIterations; ++i)
+	{
+		WireWriter out(arena, sizeof(arena));
+		checksum += WirePacket<Packet>::Encode(pView, out);
+	}
+	const double encodeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	const size_t encodeAllocations = gAllocations - allocations;
+
+	if(checksum != uint64_t(size) * kIterations * 2)
+	{
+		std::printf("%-28s FAILED checksum\n", pName);
+		++gFailures;
+		return;
+	}
+
+	std::printf("%-28s %5zu bytes  decode %7.2f M/s %4.2f allocs  encode %7.2f M/s %4.2f allocs\n",
+		pName, size,
+		kIterations / decodeSeconds / 1e6, double(decodeAllocations) / kIterations,
+		kIterations / encodeSeconds / 1e6, double(encodeAllocations) / kIterations);
+}
+
+int main()
+{
+	const std::string name = "Lydia of Whiterun";
+	const std::string channel = "global";
+	const std::string text = "Meet at the Bannered Mare";
+	const std::vector<uint32_t> worn(12, 0x00012E46);
+	const std::vector<float> morphs(32, 0.25f);
+	const WireTraits<BasicArray<3, float>>::View position = {{1024.5f, -2048.25f, 96.0f}};
+	const WireTraits<BasicArray<3, float>>::View rotation = {{0.0f, 0.0f, 1.57f}};
+
+	{
+		WirePacket<PlayerMoveState>::View view;
+		std::get<0>(view).Set<0>(1.57f);
+		std::get<0>(view).Set<1>(position);
+		std::get<0>(view).Set<2>(220.0f);
+		std::get<0>(view).Set<3>(uint64_t(123456789));
+		Bench<PlayerMoveState>("PlayerMoveState", view);
+	}
+
+	{
+		WirePacket<PlayerGOMEntryReplication>::View view;
+		std::get<0>(view).Set<0>(morphs);
+		std::get<0>(view).Set<1>(worn);
+		std::get<0>(view).Set<2>(uint32_t(12));
+		std::get<0>(view).Set<4>(position);
+		std::get<0>(view).Set<5>(rotation);
+		std::get<0>(view).Set<7>(name);
+		std::get<1>(view) = 7;
+		Bench<PlayerGOMEntryReplication>("PlayerGOMEntryReplication", view);
+	}
+
+	{
+		WirePacket<WorldState>::View view;
+		const WireTraits<BasicArray<4, float>>::View date = {{4.0f, 17.0f, 201.0f, 9.5f}};
+		std::get<0>(view).Set<0>(uint32_t(0x0010A23B));
+		std::get<0>(view).Set<1>(date);
+		Bench<WorldState>("WorldState", view);
+	}
+
+	{
+		WirePacket<PlayerGOMTransaction>::View view;
+		std::get<0>(view).Set<0>(name);
+		std::get<0>(view).Set<1>(worn);
+		std::get<0>(view).Set<2>(morphs);
+		std::get<0>(view).Set<4>(uint32_t(0x00013746));
+		std::get<0>(view).Set<7>(position);
+		Bench<PlayerGOMTransaction>("PlayerGOMTransaction", view);
+	}
+
+	{
+		WirePacket<ClientInitialTransaction>::View view;
+		std::get<0>(view) = name;
+		std::get<1>(view) = worn;
+		std::get<2>(view) = morphs;
+		std::get<3>(view) = worn;
+		std::get<4>(view) = 0x00013746;
+		std::get<5>(view) = 1;
+		std::get<6>(view) = 12;
+		std::get<7>(view) = position;
+		std::get<8>(view) = rotation;
+		Bench<ClientInitialTransaction>("ClientInitialTransaction", view);
+	}
+
+	{
+		WirePacket<ChatMessage>::View view;
+		std::get<0>(view) = channel;
+		std::get<1>(view) = text;
+		Bench<ChatMessage>("ChatMessage", view);
+	}
+
+	{
+		std::vector<WirePacket<ModEntry>::View> entries(3);
+		std::get<0>(entries[0]) = WireString("Skyrim.esm");
+		std::get<1>(entries[0]) = true;
+		std::get<0>(entries[1]) = WireString("Update.esm");
+		std::get<1>(entries[1]) = true;
+		std::get<0>(entries[2]) = WireString("SkyUI.esp");
+		std::get<1>(entries[2]) = false;
+
+		WirePacket<ModRegistration>::View view;
+		std::get<0>(view) = WireList<ModEntry>(entries);
+		Bench<ModRegistration>("ModRegistration", view);
+	}
+
+	return gFailures ? 1 : 0;
+}
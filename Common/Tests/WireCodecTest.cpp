@@ -0,0 +1,329 @@
+// Checks WireCodec against hand written byte layouts for every schema in
+// Common: the compile time sizes, the exact bytes each packet encodes to, that
+// they decode back to the same members, that every truncation of them is
+// rejected, and that the table dispatched switched fields write the same bytes
+// as testing every flag in turn for all masks.
+//
+// Expected bytes are written out for a little endian host, as the codec is.
+//
+// g++ -std=c++11 -O2 -I.. WireCodecTest.cpp -o WireCodecTest
+
+#include "SerializableStub.hpp"
+#include "ClientPackets.hpp"
+#include "ServerPackets.hpp"
+#include "SharedPackets.hpp"
+#include "WireCodec.hpp"
+
+#include <cstdio>
+#include <vector>
+
+static_assert(WireTraits<BasicArray<3, float>>::kMinSize == 12 && WireTraits<BasicArray<3, float>>::kMaxSize == 12
+	&& WireTraits<BasicArray<3, float>>::kBounded, "BasicArray<3, float> is 12 bytes");
+static_assert(WireTraits<std::string>::kMinSize == 4 && !WireTraits<std::string>::kBounded, "strings are a count and their bytes");
+
+static_assert(WirePacket<PlayerMoveState>::kMinSize == 4 && WirePacket<PlayerMoveState>::kMaxSize == 4 + 4 + 12 + 4 + 8
+	&& WirePacket<PlayerMoveState>::kBounded && !WirePacket<PlayerMoveState>::kFixed, "PlayerMoveState sizes");
+static_assert(WirePacket<WorldState>::kMinSize == 4 && WirePacket<WorldState>::kMaxSize == 4 + 4 + 16
+	&& WirePacket<WorldState>::kBounded && !WirePacket<WorldState>::kFixed, "WorldState sizes");
+static_assert(WirePacket<PlayerGOMEntryReplication>::kMinSize == 2 + 4 && !WirePacket<PlayerGOMEntryReplication>::kBounded,
+	"PlayerGOMEntryReplication sizes");
+static_assert(WirePacket<PlayerGOMTransaction>::kMinSize == 4 && !WirePacket<PlayerGOMTransaction>::kBounded,
+	"PlayerGOMTransaction sizes");
+static_assert(WirePacket<ClientInitialTransaction>::kMinSize == 4 * 4 + 3 * 4 + 2 * 12
+	&& !WirePacket<ClientInitialTransaction>::kBounded, "ClientInitialTransaction sizes");
+static_assert(WirePacket<ChatMessage>::kMinSize == 8 && !WirePacket<ChatMessage>::kBounded, "ChatMessage sizes");
+static_assert(WirePacket<ModEntry>::kMinSize == 5 && !WirePacket<ModEntry>::kBounded, "ModEntry sizes");
+static_assert(WirePacket<ModRegistration>::kMinSize == 4 && !WirePacket<ModRegistration>::kBounded, "ModRegistration sizes");
+
+static int gFailures = 0;
+
+static void Check(bool pCondition, const char* pName, const char* pWhat)
+{
+	if(!pCondition)
+	{
+		std::printf("%-28s FAILED %s\n", pName, pWhat);
+		++gFailures;
+	}
+}
+
+// Encodes pView and compares it to pBytes, then decodes pBytes back into
+// pDecoded, which points into pBytes, and checks no shorter prefix of it
+// decodes.
+template<class Packet, size_t N>
+static void CheckLayout(const char* pName, const typename WirePacket<Packet>::View& pView,
+	const uint8_t (&pBytes)[N], typename WirePacket<Packet>::View& pDecoded)
+{
+	const std::vector<uint8_t> expected(pBytes, pBytes + N);
+
+	uint8_t buffer[256];
+	WireWriter writer(buffer, sizeof(buffer));
+	const size_t size = WirePacket<Packet>::Encode(pView, writer);
+	Check(size == expected.size() && std::memcmp(buffer, expected.data(), size) == 0, pName, "encoded bytes");
+	Check(WirePacket<Packet>::Size(pView) == expected.size(), pName, "Size()");
+
+	WireReader reader(pBytes, N);
+	Check(WirePacket<Packet>::Decode(reader, pDecoded) && reader.Remaining() == 0, pName, "decode");
+
+	uint8_t scratch[256];
+	Check(WireVerify<Packet>(expected.data(), expected.size(), scratch), pName, "WireVerify");
+
+	std::vector<uint8_t> longer(expected);
+	longer.push_back(0);
+	Check(!WireVerify<Packet>(longer.data(), longer.size(), scratch), pName, "WireVerify accepted a trailing byte");
+
+	for(size_t length = 0; length < expected.size(); ++length)
+	{
+		typename WirePacket<Packet>::View view;
+		if(WirePacket<Packet>::Decode(expected.data(), length, view))
+		{
+			Check(false, pName, "decoded a truncated buffer");
+			break;
+		}
+	}
+
+	// An encode that does not fit must leave the arena as it was.
+	WireWriter tight(buffer, expected.size() - 1);
+	tight.Reserve(0);
+	Check(WirePacket<Packet>::Encode(pView, tight) == 0 && tight.Size() == 0, pName, "encode into a short arena");
+}
+
+static void Report(const char* pName, int pFailuresBefore, size_t pSize)
+{
+	if(gFailures == pFailuresBefore)
+		std::printf("%-28s ok, %zu bytes\n", pName, pSize);
+}
+
+// The reference for the switched field dispatch: test every flag in turn.
+static bool WriteBranching(WireWriter& pWriter, const WirePacket<PlayerGOMTransaction>::View& pView)
+{
+	typedef WirePacket<PlayerGOMTransaction>::View View;
+	typedef std::tuple_element<0, View>::type Switched;
+
+	const Switched& fields = std::get<0>(pView);
+	const uint32_t mask = fields.GetMask();
+	bool ok = pWriter.WritePod(mask);
+	if(mask & 0x0001) ok = ok && WireTraits<std::string>::Write(pWriter, fields.Get<0>());
+	if(mask & 0x0002) ok = ok && WireTraits<std::vector<uint32_t>>::Write(pWriter, fields.Get<1>());
+	if(mask & 0x0004) ok = ok && WireTraits<std::vector<float>>::Write(pWriter, fields.Get<2>());
+	if(mask & 0x0008) ok = ok && WireTraits<std::vector<uint32_t>>::Write(pWriter, fields.Get<3>());
+	if(mask & 0x0010) ok = ok && WireTraits<uint32_t>::Write(pWriter, fields.Get<4>());
+	if(mask & 0x0020) ok = ok && WireTraits<uint32_t>::Write(pWriter, fields.Get<5>());
+	if(mask & 0x0040) ok = ok && WireTraits<uint32_t>::Write(pWriter, fields.Get<6>());
+	if(mask & 0x0080) ok = ok && WireTraits<BasicArray<3, float>>::Write(pWriter, fields.Get<7>());
+	if(mask & 0x0100) ok = ok && WireTraits<BasicArray<3, float>>::Write(pWriter, fields.Get<8>());
+	return ok;
+}
+
+static void CheckDispatch()
+{
+	const std::string name = "Lydia";
+	const std::vector<uint32_t> worn(3, 0x00012E46);
+	const std::vector<float> morphs(5, 0.25f);
+	const std::vector<uint32_t> presets(2, 7);
+	const WireTraits<BasicArray<3, float>>::View position = {{1024.5f, -2048.25f, 96.0f}};
+	const WireTraits<BasicArray<3, float>>::View rotation = {{0.0f, 0.0f, 1.57f}};
+
+	uint8_t expected[256];
+	uint8_t encoded[256];
+	for(uint32_t mask = 0; mask < (1u << 9); ++mask)
+	{
+		WirePacket<PlayerGOMTransaction>::View view;
+		auto& fields = std::get<0>(view);
+		if(mask & 0x0001) fields.Set<0>(name);
+		if(mask & 0x0002) fields.Set<1>(worn);
+		if(mask & 0x0004) fields.Set<2>(morphs);
+		if(mask & 0x0008) fields.Set<3>(presets);
+		if(mask & 0x0010) fields.Set<4>(uint32_t(0x00013746));
+		if(mask & 0x0020) fields.Set<5>(uint32_t(1));
+		if(mask & 0x0040) fields.Set<6>(uint32_t(12));
+		if(mask & 0x0080) fields.Set<7>(position);
+		if(mask & 0x0100) fields.Set<8>(rotation);
+
+		WireWriter reference(expected, sizeof(expected));
+		WireWriter writer(encoded, sizeof(encoded));
+		if(!WriteBranching(reference, view) || WirePacket<PlayerGOMTransaction>::Encode(view, writer) != reference.Size()
+			|| std::memcmp(expected, encoded, reference.Size()) != 0
+			|| WirePacket<PlayerGOMTransaction>::Size(view) != reference.Size())
+		{
+			std::printf("%-28s FAILED mask 0x%03X differs from per field branching\n", "switched dispatch", mask);
+			++gFailures;
+			return;
+		}
+
+		WirePacket<PlayerGOMTransaction>::View decoded;
+		if(!WirePacket<PlayerGOMTransaction>::Decode(encoded, writer.Size(), decoded)
+			|| std::get<0>(decoded).GetMask() != mask
+			|| ((mask & 0x0001) && std::get<0>(decoded).Get<0>() != WireString(name))
+			|| ((mask & 0x0004) && std::get<0>(decoded).Get<2>()[4] != 0.25f)
+			|| ((mask & 0x0040) && std::get<0>(decoded).Get<6>() != 12)
+			|| ((mask & 0x0100) && std::get<0>(decoded).Get<8>()[2] != 1.57f))
+		{
+			std::printf("%-28s FAILED mask 0x%03X does not round trip\n", "switched dispatch", mask);
+			++gFailures;
+			return;
+		}
+	}
+	std::printf("%-28s ok, 512 masks\n", "switched dispatch");
+}
+
+int main()
+{
+	{
+		const int failures = gFailures;
+		WirePacket<PlayerMoveState>::View view, decoded;
+		std::get<0>(view).Set<0>(1.0f);
+		std::get<0>(view).Set<3>(uint64_t(0x0102030405060708ull));
+		const uint8_t bytes[] =
+		{
+			0x09, 0x00, 0x00, 0x00,
+			0x00, 0x00, 0x80, 0x3F,
+			0x08, 0x07, 0x06, 0x05, 0x04, 0x03, 0x02, 0x01,
+		};
+		CheckLayout<PlayerMoveState>("PlayerMoveState", view, bytes, decoded);
+		Check(std::get<0>(decoded).Has<0>() && !std::get<0>(decoded).Has<1>() && !std::get<0>(decoded).Has<2>()
+			&& std::get<0>(decoded).Get<0>() == 1.0f && std::get<0>(decoded).Get<3>() == 0x0102030405060708ull,
+			"PlayerMoveState", "decoded members");
+		Report("PlayerMoveState", failures, sizeof(bytes));
+	}
+
+	{
+		const int failures = gFailures;
+		WirePacket<WorldState>::View view, decoded;
+		const WireTraits<BasicArray<4, float>>::View date = {{4.0f, 17.0f, 201.0f, 9.5f}};
+		std::get<0>(view).Set<0>(uint32_t(0x0010A23B));
+		std::get<0>(view).Set<1>(date);
+		const uint8_t bytes[] =
+		{
+			0x03, 0x00, 0x00, 0x00,
+			0x3B, 0xA2, 0x10, 0x00,
+			0x00, 0x00, 0x80, 0x40, 0x00, 0x00, 0x88, 0x41, 0x00, 0x00, 0x49, 0x43, 0x00, 0x00, 0x18, 0x41,
+		};
+		CheckLayout<WorldState>("WorldState", view, bytes, decoded);
+		Check(std::get<0>(decoded).Get<0>() == 0x0010A23B && std::get<0>(decoded).Get<1>()[2] == 201.0f,
+			"WorldState", "decoded members");
+		Report("WorldState", failures, sizeof(bytes));
+	}
+
+	{
+		const int failures = gFailures;
+		WirePacket<PlayerGOMEntryReplication>::View view, decoded;
+		std::get<0>(view).Set<2>(uint32_t(12));
+		std::get<0>(view).Set<7>(WireString("Bo"));
+		std::get<1>(view) = 7;
+		const uint8_t bytes[] =
+		{
+			0x84, 0x00,
+			0x0C, 0x00, 0x00, 0x00,
+			0x02, 0x00, 0x00, 0x00, 'B', 'o',
+			0x07, 0x00, 0x00, 0x00,
+		};
+		CheckLayout<PlayerGOMEntryReplication>("PlayerGOMEntryReplication", view, bytes, decoded);
+		Check(std::get<0>(decoded).GetMask() == 0x84 && std::get<0>(decoded).Get<7>() == WireString("Bo")
+			&& std::get<1>(decoded) == 7, "PlayerGOMEntryReplication", "decoded members");
+		Report("PlayerGOMEntryReplication", failures, sizeof(bytes));
+	}
+
+	{
+		const int failures = gFailures;
+		WirePacket<PlayerGOMTransaction>::View view, decoded;
+		const std::vector<uint32_t> worn(2, 0x00012E46);
+		std::get<0>(view).Set<1>(worn);
+		std::get<0>(view).Set<5>(uint32_t(1));
+		const uint8_t bytes[] =
+		{
+			0x22, 0x00, 0x00, 0x00,
+			0x02, 0x00, 0x00, 0x00, 0x46, 0x2E, 0x01, 0x00, 0x46, 0x2E, 0x01, 0x00,
+			0x01, 0x00, 0x00, 0x00,
+		};
+		CheckLayout<PlayerGOMTransaction>("PlayerGOMTransaction", view, bytes, decoded);
+		Check(std::get<0>(decoded).Get<1>().Size() == 2 && std::get<0>(decoded).Get<1>()[1] == 0x00012E46,
+			"PlayerGOMTransaction", "decoded members");
+		Report("PlayerGOMTransaction", failures, sizeof(bytes));
+	}
+
+	{
+		const int failures = gFailures;
+		WirePacket<ClientInitialTransaction>::View view, decoded;
+		const std::vector<uint32_t> worn(1, 0x00012E46);
+		const std::vector<float> morphs;
+		const WireTraits<BasicArray<3, float>>::View position = {{1.0f, 2.0f, 0.0f}};
+		const WireTraits<BasicArray<3, float>>::View rotation = {{0.0f, 0.0f, -1.0f}};
+		std::get<0>(view) = WireString("Al");
+		std::get<1>(view) = worn;
+		std::get<2>(view) = morphs;
+		std::get<3>(view) = WireSpan<uint32_t>();
+		std::get<4>(view) = 0x00013746;
+		std::get<5>(view) = 1;
+		std::get<6>(view) = 12;
+		std::get<7>(view) = position;
+		std::get<8>(view) = rotation;
+		const uint8_t bytes[] =
+		{
+			0x02, 0x00, 0x00, 0x00, 'A', 'l',
+			0x01, 0x00, 0x00, 0x00, 0x46, 0x2E, 0x01, 0x00,
+			0x00, 0x00, 0x00, 0x00,
+			0x00, 0x00, 0x00, 0x00,
+			0x46, 0x37, 0x01, 0x00,
+			0x01, 0x00, 0x00, 0x00,
+			0x0C, 0x00, 0x00, 0x00,
+			0x00, 0x00, 0x80, 0x3F, 0x00, 0x00, 0x00, 0x40, 0x00, 0x00, 0x00, 0x00,
+			0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80, 0xBF,
+		};
+		CheckLayout<ClientInitialTransaction>("ClientInitialTransaction", view, bytes, decoded);
+		Check(std::get<0>(decoded) == WireString("Al") && std::get<2>(decoded).Empty() && std::get<8>(decoded)[2] == -1.0f,
+			"ClientInitialTransaction", "decoded members");
+		Report("ClientInitialTransaction", failures, sizeof(bytes));
+	}
+
+	{
+		const int failures = gFailures;
+		WirePacket<ChatMessage>::View view, decoded;
+		std::get<0>(view) = WireString("ab");
+		std::get<1>(view) = WireString("xyz");
+		const uint8_t bytes[] =
+		{
+			0x02, 0x00, 0x00, 0x00, 'a', 'b',
+			0x03, 0x00, 0x00, 0x00, 'x', 'y', 'z',
+		};
+		CheckLayout<ChatMessage>("ChatMessage", view, bytes, decoded);
+		Check(std::get<0>(decoded) == WireString("ab") && std::get<1>(decoded) == WireString("xyz"),
+			"ChatMessage", "decoded members");
+		Report("ChatMessage", failures, sizeof(bytes));
+	}
+
+	{
+		const int failures = gFailures;
+		std::vector<WirePacket<ModEntry>::View> entries(2);
+		std::get<0>(entries[0]) = WireString("A");
+		std::get<1>(entries[0]) = true;
+		std::get<0>(entries[1]) = WireString("");
+		std::get<1>(entries[1]) = false;
+
+		WirePacket<ModRegistration>::View view, decoded;
+		std::get<0>(view) = WireList<ModEntry>(entries);
+		const uint8_t bytes[] =
+		{
+			0x02, 0x00, 0x00, 0x00,
+			0x01, 0x00, 0x00, 0x00, 'A', 0x01,
+			0x00, 0x00, 0x00, 0x00, 0x00,
+		};
+		CheckLayout<ModRegistration>("ModRegistration", view, bytes, decoded);
+
+		std::vector<WirePacket<ModEntry>::View> visited;
+		std::get<0>(decoded).ForEach([&visited](const WirePacket<ModEntry>::View& pEntry) { visited.push_back(pEntry); });
+		Check(visited.size() == 2 && std::get<0>(visited[0]) == WireString("A") && std::get<1>(visited[0])
+			&& std::get<0>(visited[1]).Empty() && !std::get<1>(visited[1]), "ModRegistration", "decoded members");
+		Report("ModRegistration", failures, sizeof(bytes));
+	}
+
+	{
+		// A count larger than the bytes left must be rejected before anything is read.
+		const uint8_t bytes[] = {0xFF, 0xFF, 0xFF, 0x7F, 0x00, 0x00, 0x00, 0x00, 0x00};
+		WirePacket<ModRegistration>::View view;
+		Check(!WirePacket<ModRegistration>::Decode(bytes, sizeof(bytes), view), "ModRegistration", "oversized count");
+	}
+
+	CheckDispatch();
+
+	return gFailures ? 1 : 0;
+}
@@ -0,0 +1,776 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Allocation free codec for the BasicSerializable packet schemas.
+//
+// Decoding produces views that point into the received buffer instead of
+// owning std::string/std::vector copies, encoding appends to a caller owned
+// arena through WireWriter. Views are only valid as long as the buffer they
+// were decoded from.
+//
+// The wire format is this codec's own: scalars are raw little endian, strings
+// and vectors are a uint32_t count followed by their elements,
+// BasicArray<N, T> is N raw elements, a SwitchedSerializable is its mask
+// followed by the fields whose bit is set and a nested packet is its members
+// in order. BasicSerializable is not part of this tree, so nothing checks this
+// matches what it writes: both ends of a connection must use WireCodec, it is
+// not a drop in reader for packets written by the serializer.
+// WireVerify<Packet>() checks a buffer decodes completely and re-encodes to
+// the same bytes, which pins the format down once buffers from another writer
+// are available. Tests/WireCodecTest.cpp checks the sizes, the byte layout
+// and the switched field dispatch of each schema, Tests/WireCodecBench.cpp
+// measures decode/encode rates and allocations per packet.
+//
+// Every WireTraits also describes its encoded size at compile time: kMinSize,
+// kMaxSize and kBounded, kMaxSize being meaningless for unbounded types such
+// as strings. Size() gives the exact size of a view without encoding it.
+
+class WireWriter
+{
+public:
+
+	WireWriter(void* pBuffer, size_t pCapacity)
+		: mBegin(static_cast<uint8_t*>(pBuffer)), mCursor(mBegin), mEnd(mBegin + pCapacity), mOverflow(false)
+	{
+	}
+
+	bool Write(const void* pData, size_t pSize)
+	{
+		if(mOverflow || size_t(mEnd - mCursor) < pSize)
+		{
+			mOverflow = true;
+			return false;
+		}
+		// Empty spans and strings have no data pointer.
+		if(pSize)
+			std::memcpy(mCursor, pData, pSize);
+		mCursor += pSize;
+		return true;
+	}
+
+	template<class T>
+	bool WritePod(const T& pValue)
+	{
+		return Write(&pValue, sizeof(T));
+	}
+
+	// Returns a pointer to pSize reserved bytes, used to patch counts afterwards.
+	uint8_t* Reserve(size_t pSize)
+	{
+		if(mOverflow || size_t(mEnd - mCursor) < pSize)
+		{
+			mOverflow = true;
+			return nullptr;
+		}
+		uint8_t* pos = mCursor;
+		mCursor += pSize;
+		return pos;
+	}
+
+	void Rewind(size_t pSize)
+	{
+		mCursor = mBegin + pSize;
+		mOverflow = false;
+	}
+
+	void Reset()
+	{
+		Rewind(0);
+	}
+
+	const uint8_t* Data() const { return mBegin; }
+	size_t Size() const { return size_t(mCursor - mBegin); }
+	size_t Capacity() const { return size_t(mEnd - mBegin); }
+	size_t Remaining() const { return size_t(mEnd - mCursor); }
+	bool Overflow() const { return mOverflow; }
+
+private:
+
+	uint8_t* mBegin;
+	uint8_t* mCursor;
+	uint8_t* mEnd;
+	bool mOverflow;
+};
+
+class WireReader
+{
+public:
+
+	WireReader(const void* pBuffer, size_t pSize)
+		: mCursor(static_cast<const uint8_t*>(pBuffer)), mEnd(mCursor + pSize), mError(false)
+	{
+	}
+
+	// Returns a pointer to the next pSize bytes and skips them, nullptr if the buffer is too short.
+	const uint8_t* Take(size_t pSize)
+	{
+		if(mError || size_t(mEnd - mCursor) < pSize)
+		{
+			mError = true;
+			return nullptr;
+		}
+		const uint8_t* pos = mCursor;
+		mCursor += pSize;
+		return pos;
+	}
+
+	template<class T>
+	bool ReadPod(T& pValue)
+	{
+		const uint8_t* pos = Take(sizeof(T));
+		if(pos)
+			std::memcpy(&pValue, pos, sizeof(T));
+		return pos != nullptr;
+	}
+
+	const uint8_t* Position() const { return mCursor; }
+	size_t Remaining() const { return size_t(mEnd - mCursor); }
+	bool Error() const { return mError; }
+
+private:
+
+	const uint8_t* mCursor;
+	const uint8_t* mEnd;
+	bool mError;
+};
+
+// Non owning string, either decoded from a packet or pointing at caller data to encode.
+class WireString
+{
+public:
+
+	WireString() : mData(nullptr), mSize(0) {}
+	WireString(const char* pData, uint32_t pSize) : mData(pData), mSize(pSize) {}
+	WireString(const char* pData) : mData(pData), mSize(uint32_t(std::strlen(pData))) {}
+	WireString(const std::string& pStr) : mData(pStr.data()), mSize(uint32_t(pStr.size())) {}
+
+	const char* Data() const { return mData; }
+	uint32_t Size() const { return mSize; }
+	bool Empty() const { return mSize == 0; }
+
+	std::string Str() const { return std::string(mData, mSize); }
+
+	bool operator==(const WireString& pOther) const
+	{
+		return mSize == pOther.mSize && (mSize == 0 || std::memcmp(mData, pOther.mData, mSize) == 0);
+	}
+
+	bool operator!=(const WireString& pOther) const { return !(*this == pOther); }
+
+private:
+
+	const char* mData;
+	uint32_t mSize;
+};
+
+// Non owning array of scalars. Decoded data is not guaranteed to be aligned so
+// elements are always copied out with memcpy.
+template<class T>
+class WireSpan
+{
+	static_assert(std::is_arithmetic<T>::value, "WireSpan only holds scalar elements");
+
+public:
+
+	WireSpan() : mData(nullptr), mCount(0) {}
+	WireSpan(const void* pData, uint32_t pCount) : mData(static_cast<const uint8_t*>(pData)), mCount(pCount) {}
+	WireSpan(const std::vector<T>& pVector) : mData(reinterpret_cast<const uint8_t*>(pVector.data())), mCount(uint32_t(pVector.size())) {}
+
+	T operator[](size_t pIndex) const
+	{
+		T value;
+		std::memcpy(&value, mData + pIndex * sizeof(T), sizeof(T));
+		return value;
+	}
+
+	const uint8_t* Bytes() const { return mData; }
+	uint32_t Size() const { return mCount; }
+	bool Empty() const { return mCount == 0; }
+
+	void CopyTo(std::vector<T>& pOut) const
+	{
+		pOut.resize(mCount);
+		if(mCount)
+			std::memcpy(pOut.data(), mData, mCount * sizeof(T));
+	}
+
+private:
+
+	const uint8_t* mData;
+	uint32_t mCount;
+};
+
+// WireTraits<T> maps a schema member type to its view and knows how to move it on the wire.
+template<class T, class Enable = void>
+struct WireTraits;
+
+template<class... Members>
+struct WireSchema;
+
+template<class... Members>
+WireSchema<Members...> WireSchemaOf(const BasicSerializable<Members...>*);
+
+template<class Packet>
+struct WirePacket;
+
+// Set for packet classes, which can be nested in other packets.
+template<class T>
+struct WireIsPacket
+{
+	template<class U>
+	static char Test(decltype(WireSchemaOf(static_cast<const U*>(nullptr)))*);
+
+	template<class U>
+	static long Test(...);
+
+	enum { kValue = sizeof(Test<T>(nullptr)) == sizeof(char) };
+};
+
+// Non owning list of elements that are not scalars, such as nested packets.
+// A decoded list keeps the encoded elements and decodes them again on each
+// visit, a list to encode points at caller owned element views.
+template<class T>
+class WireList
+{
+public:
+
+	typedef typename WireTraits<T>::View Element;
+
+	WireList() : mData(nullptr), mBytes(0), mElements(nullptr), mCount(0) {}
+	WireList(const Element* pElements, uint32_t pCount) : mData(nullptr), mBytes(0), mElements(pElements), mCount(pCount) {}
+	WireList(const std::vector<Element>& pElements) : mData(nullptr), mBytes(0), mElements(pElements.data()), mCount(uint32_t(pElements.size())) {}
+
+	uint32_t Size() const { return mCount; }
+	bool Empty() const { return mCount == 0; }
+
+	// Calls pVisitor(const Element&) for each element in order.
+	template<class Visitor>
+	void ForEach(Visitor pVisitor) const
+	{
+		if(mElements)
+		{
+			for(uint32_t i = 0; i < mCount; ++i)
+				pVisitor(mElements[i]);
+			return;
+		}
+
+		WireReader reader(mData, mBytes);
+		for(uint32_t i = 0; i < mCount; ++i)
+		{
+			Element element;
+			WireTraits<T>::Read(reader, element);
+			pVisitor(element);
+		}
+	}
+
+	size_t EncodedSize() const
+	{
+		if(!mElements)
+			return mBytes;
+
+		size_t size = 0;
+		for(uint32_t i = 0; i < mCount; ++i)
+			size += WireTraits<T>::Size(mElements[i]);
+		return size;
+	}
+
+	bool Read(WireReader& pReader)
+	{
+		uint32_t count;
+		if(!pReader.ReadPod(count))
+			return false;
+		if(WireTraits<T>::kMinSize != 0 && count > pReader.Remaining() / WireTraits<T>::kMinSize)
+			return false;
+
+		const uint8_t* data = pReader.Position();
+		for(uint32_t i = 0; i < count; ++i)
+		{
+			Element element;
+			if(!WireTraits<T>::Read(pReader, element))
+				return false;
+		}
+
+		*this = WireList();
+		mData = data;
+		mBytes = size_t(pReader.Position() - data);
+		mCount = count;
+		return true;
+	}
+
+	bool Write(WireWriter& pWriter) const
+	{
+		if(!pWriter.WritePod(mCount))
+			return false;
+		if(!mElements)
+			return pWriter.Write(mData, mBytes);
+
+		for(uint32_t i = 0; i < mCount; ++i)
+		{
+			if(!WireTraits<T>::Write(pWriter, mElements[i]))
+				return false;
+		}
+		return true;
+	}
+
+private:
+
+	const uint8_t* mData;
+	size_t mBytes;
+	const Element* mElements;
+	uint32_t mCount;
+};
+
+template<class T>
+struct WireTraits<T, typename std::enable_if<std::is_arithmetic<T>::value>::type>
+{
+	typedef T View;
+
+	enum { kMinSize = sizeof(T), kMaxSize = sizeof(T), kBounded = 1 };
+
+	static bool Read(WireReader& pReader, View& pView) { return pReader.ReadPod(pView); }
+	static bool Write(WireWriter& pWriter, const View& pView) { return pWriter.WritePod(pView); }
+	static size_t Size(const View&) { return sizeof(T); }
+};
+
+template<>
+struct WireTraits<std::string>
+{
+	typedef WireString View;
+
+	enum { kMinSize = sizeof(uint32_t), kMaxSize = sizeof(uint32_t), kBounded = 0 };
+
+	static size_t Size(const View& pView) { return sizeof(uint32_t) + pView.Size(); }
+
+	static bool Read(WireReader& pReader, View& pView)
+	{
+		uint32_t size;
+		if(!pReader.ReadPod(size))
+			return false;
+		const uint8_t* data = pReader.Take(size);
+		if(!data)
+			return false;
+		pView = WireString(reinterpret_cast<const char*>(data), size);
+		return true;
+	}
+
+	static bool Write(WireWriter& pWriter, const View& pView)
+	{
+		return pWriter.WritePod(pView.Size()) && pWriter.Write(pView.Data(), pView.Size());
+	}
+};
+
+template<class T>
+struct WireSpanTraits
+{
+	typedef WireSpan<T> View;
+
+	enum { kMinSize = sizeof(uint32_t), kMaxSize = sizeof(uint32_t), kBounded = 0 };
+
+	static size_t Size(const View& pView) { return sizeof(uint32_t) + pView.Size() * sizeof(T); }
+
+	static bool Read(WireReader& pReader, View& pView)
+	{
+		uint32_t count;
+		if(!pReader.ReadPod(count) || count > pReader.Remaining() / sizeof(T))
+			return false;
+		pView = WireSpan<T>(pReader.Take(count * sizeof(T)), count);
+		return true;
+	}
+
+	static bool Write(WireWriter& pWriter, const View& pView)
+	{
+		return pWriter.WritePod(pView.Size()) && pWriter.Write(pView.Bytes(), pView.Size() * sizeof(T));
+	}
+};
+
+template<class T>
+struct WireListTraits
+{
+	typedef WireList<T> View;
+
+	enum { kMinSize = sizeof(uint32_t), kMaxSize = sizeof(uint32_t), kBounded = 0 };
+
+	static size_t Size(const View& pView) { return sizeof(uint32_t) + pView.EncodedSize(); }
+	static bool Read(WireReader& pReader, View& pView) { return pView.Read(pReader); }
+	static bool Write(WireWriter& pWriter, const View& pView) { return pView.Write(pWriter); }
+};
+
+// Vectors of scalars are spans over the buffer, anything else is a WireList.
+template<class T>
+struct WireSequenceTraits
+	: std::conditional<std::is_arithmetic<T>::value, WireSpanTraits<T>, WireListTraits<T>>::type
+{
+};
+
+template<class T>
+struct WireTraits<std::vector<T>> : WireSequenceTraits<T> {};
+
+template<class T>
+struct WireTraits<BasicVector<T>> : WireSequenceTraits<T> {};
+
+// Packets nested in packets, ModEntry in ModRegistration for instance.
+template<class T>
+struct WireTraits<T, typename std::enable_if<WireIsPacket<T>::kValue>::type>
+{
+	typedef WirePacket<T> Packet;
+	typedef typename Packet::View View;
+
+	enum { kMinSize = Packet::kMinSize, kMaxSize = Packet::kMaxSize, kBounded = Packet::kBounded };
+
+	static bool Read(WireReader& pReader, View& pView) { return Packet::Decode(pReader, pView); }
+	static bool Write(WireWriter& pWriter, const View& pView) { return Packet::Write(pWriter, pView); }
+	static size_t Size(const View& pView) { return Packet::Size(pView); }
+};
+
+// Fixed arrays are small enough to be decoded by value.
+template<size_t N, class T>
+struct WireTraits<BasicArray<N, T>>
+{
+	struct View
+	{
+		T Values[N];
+
+		T& operator[](size_t pIndex) { return Values[pIndex]; }
+		const T& operator[](size_t pIndex) const { return Values[pIndex]; }
+	};
+
+	enum { kMinSize = N * sizeof(T), kMaxSize = N * sizeof(T), kBounded = 1 };
+
+	static bool Read(WireReader& pReader, View& pView) { return pReader.ReadPod(pView.Values); }
+	static bool Write(WireWriter& pWriter, const View& pView) { return pWriter.WritePod(pView.Values); }
+	static size_t Size(const View&) { return N * sizeof(T); }
+};
+
+// Compile time sums of the size descriptions of a pack of WireTraits.
+template<class... Traits>
+struct WireSizeOf
+{
+	enum { kMinSize = 0, kMaxSize = 0, kBounded = 1 };
+};
+
+template<class First, class... Rest>
+struct WireSizeOf<First, Rest...>
+{
+	enum
+	{
+		kMinSize = First::kMinSize + WireSizeOf<Rest...>::kMinSize,
+		kMaxSize = First::kMaxSize + WireSizeOf<Rest...>::kMaxSize,
+		kBounded = First::kBounded && WireSizeOf<Rest...>::kBounded
+	};
+};
+
+template<size_t... I>
+struct WireIndices {};
+
+template<size_t N, size_t... I>
+struct WireMakeIndices : WireMakeIndices<N - 1, N - 1, I...> {};
+
+template<size_t... I>
+struct WireMakeIndices<0, I...>
+{
+	typedef WireIndices<I...> Type;
+};
+
+inline uint32_t WireLowestBit(uint32_t pMask)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, pMask);
+	return uint32_t(index);
+#else
+	return uint32_t(__builtin_ctz(pMask));
+#endif
+}
+
+template<class Tuple, size_t I = 0, size_t N = std::tuple_size<Tuple>::value>
+struct WireTupleIO
+{
+	template<class Traits>
+	static bool Read(WireReader& pReader, Tuple& pTuple)
+	{
+		typedef typename std::tuple_element<I, Traits>::type Current;
+		return WireTraits<Current>::Read(pReader, std::get<I>(pTuple))
+			&& WireTupleIO<Tuple, I + 1, N>::template Read<Traits>(pReader, pTuple);
+	}
+
+	template<class Traits>
+	static bool Write(WireWriter& pWriter, const Tuple& pTuple)
+	{
+		typedef typename std::tuple_element<I, Traits>::type Current;
+		return WireTraits<Current>::Write(pWriter, std::get<I>(pTuple))
+			&& WireTupleIO<Tuple, I + 1, N>::template Write<Traits>(pWriter, pTuple);
+	}
+
+	template<class Traits>
+	static size_t Size(const Tuple& pTuple)
+	{
+		typedef typename std::tuple_element<I, Traits>::type Current;
+		return WireTraits<Current>::Size(std::get<I>(pTuple))
+			+ WireTupleIO<Tuple, I + 1, N>::template Size<Traits>(pTuple);
+	}
+};
+
+template<class Tuple, size_t N>
+struct WireTupleIO<Tuple, N, N>
+{
+	template<class Traits>
+	static bool Read(WireReader&, Tuple&) { return true; }
+
+	template<class Traits>
+	static bool Write(WireWriter&, const Tuple&) { return true; }
+
+	template<class Traits>
+	static size_t Size(const Tuple&) { return 0; }
+};
+
+template<class Field>
+struct WireSwitchedField;
+
+template<uint32_t Flag, class T>
+struct WireSwitchedField<SwitchedField<Flag, T>>
+{
+	enum { kFlag = Flag };
+	typedef T Type;
+};
+
+// View of a SwitchedSerializable: the mask plus a view slot per field, only the
+// slots whose flag is set hold decoded data.
+//
+// Field I must use flag 1 << I, which all the packets do, so the set bits of
+// the mask index a table of per field functions generated for the schema and
+// unset fields are never visited.
+template<class Mask, class... Fields>
+class WireSwitchedView
+{
+public:
+
+	typedef std::tuple<typename WireSwitchedField<Fields>::Type...> Types;
+	typedef std::tuple<typename WireTraits<typename WireSwitchedField<Fields>::Type>::View...> Views;
+
+	template<size_t I>
+	struct Flag
+	{
+		enum { kValue = WireSwitchedField<typename std::tuple_element<I, std::tuple<Fields...>>::type>::kFlag };
+		static_assert(kValue == (1u << I), "SwitchedField flags must be 1 << field index");
+	};
+
+	enum
+	{
+		kFieldMask = (sizeof...(Fields) >= 32) ? 0xFFFFFFFFu : ((1u << sizeof...(Fields)) - 1),
+		kMinSize = sizeof(Mask),
+		kMaxSize = sizeof(Mask) + WireSizeOf<WireTraits<typename WireSwitchedField<Fields>::Type>...>::kMaxSize,
+		kBounded = WireSizeOf<WireTraits<typename WireSwitchedField<Fields>::Type>...>::kBounded
+	};
+
+	WireSwitchedView() : mMask(0) {}
+
+	Mask GetMask() const { return mMask; }
+
+	template<size_t I>
+	bool Has() const
+	{
+		return (mMask & Mask(Flag<I>::kValue)) != 0;
+	}
+
+	template<size_t I>
+	const typename std::tuple_element<I, Views>::type& Get() const
+	{
+		return std::get<I>(mViews);
+	}
+
+	template<size_t I>
+	void Set(const typename std::tuple_element<I, Views>::type& pView)
+	{
+		std::get<I>(mViews) = pView;
+		mMask |= Mask(Flag<I>::kValue);
+	}
+
+	template<size_t I>
+	void Clear()
+	{
+		mMask &= ~Mask(Flag<I>::kValue);
+	}
+
+	bool Read(WireReader& pReader)
+	{
+		if(!pReader.ReadPod(mMask))
+			return false;
+		for(uint32_t mask = uint32_t(mMask) & kFieldMask; mask; mask &= mask - 1)
+		{
+			if(!Table::Get().Read[WireLowestBit(mask)](pReader, *this))
+				return false;
+		}
+		return true;
+	}
+
+	bool Write(WireWriter& pWriter) const
+	{
+		if(!pWriter.WritePod(mMask))
+			return false;
+		for(uint32_t mask = uint32_t(mMask) & kFieldMask; mask; mask &= mask - 1)
+		{
+			if(!Table::Get().Write[WireLowestBit(mask)](pWriter, *this))
+				return false;
+		}
+		return true;
+	}
+
+	size_t Size() const
+	{
+		size_t size = sizeof(Mask);
+		for(uint32_t mask = uint32_t(mMask) & kFieldMask; mask; mask &= mask - 1)
+			size += Table::Get().Size[WireLowestBit(mask)](*this);
+		return size;
+	}
+
+private:
+
+	template<size_t I>
+	struct FieldIO
+	{
+		typedef WireTraits<typename std::tuple_element<I, Types>::type> Traits;
+
+		static bool Read(WireReader& pReader, WireSwitchedView& pView)
+		{
+			(void)Flag<I>::kValue;
+			return Traits::Read(pReader, std::get<I>(pView.mViews));
+		}
+
+		static bool Write(WireWriter& pWriter, const WireSwitchedView& pView)
+		{
+			return Traits::Write(pWriter, std::get<I>(pView.mViews));
+		}
+
+		static size_t Size(const WireSwitchedView& pView)
+		{
+			return Traits::Size(std::get<I>(pView.mViews));
+		}
+	};
+
+	struct Table
+	{
+		typedef bool (*ReadFunction)(WireReader&, WireSwitchedView&);
+		typedef bool (*WriteFunction)(WireWriter&, const WireSwitchedView&);
+		typedef size_t (*SizeFunction)(const WireSwitchedView&);
+
+		ReadFunction Read[sizeof...(Fields)];
+		WriteFunction Write[sizeof...(Fields)];
+		SizeFunction Size[sizeof...(Fields)];
+
+		static const Table& Get()
+		{
+			static const Table table = Build(typename WireMakeIndices<sizeof...(Fields)>::Type());
+			return table;
+		}
+
+		template<size_t... I>
+		static Table Build(WireIndices<I...>)
+		{
+			Table table = {{&FieldIO<I>::Read...}, {&FieldIO<I>::Write...}, {&FieldIO<I>::Size...}};
+			return table;
+		}
+	};
+
+	Mask mMask;
+	Views mViews;
+};
+
+template<class Mask, class... Fields>
+struct WireTraits<SwitchedSerializable<Mask, Fields...>>
+{
+	typedef WireSwitchedView<Mask, Fields...> View;
+
+	enum { kMinSize = View::kMinSize, kMaxSize = View::kMaxSize, kBounded = View::kBounded };
+
+	static bool Read(WireReader& pReader, View& pView) { return pView.Read(pReader); }
+	static bool Write(WireWriter& pWriter, const View& pView) { return pView.Write(pWriter); }
+	static size_t Size(const View& pView) { return pView.Size(); }
+};
+
+template<class... Members>
+struct WireSchema
+{
+	typedef std::tuple<Members...> Types;
+	typedef std::tuple<typename WireTraits<Members>::View...> View;
+	typedef WireSizeOf<WireTraits<Members>...> Sizes;
+};
+
+// Entry point, WirePacket<PlayerMoveState>::View holds the decoded members in
+// declaration order, switched members are accessed through Has<I>()/Get<I>().
+template<class Packet>
+struct WirePacket
+{
+	typedef decltype(WireSchemaOf(static_cast<const Packet*>(nullptr))) Schema;
+	typedef typename Schema::View View;
+
+	// kMaxSize is only meaningful when kBounded is set, kFixed packets always
+	// encode to exactly kMaxSize bytes.
+	enum
+	{
+		kMinSize = Schema::Sizes::kMinSize,
+		kMaxSize = Schema::Sizes::kMaxSize,
+		kBounded = Schema::Sizes::kBounded,
+		kFixed = kBounded && kMinSize == kMaxSize
+	};
+
+	static size_t Size(const View& pView)
+	{
+		return WireTupleIO<View>::template Size<typename Schema::Types>(pView);
+	}
+
+	static bool Decode(const void* pBuffer, size_t pSize, View& pView)
+	{
+		WireReader reader(pBuffer, pSize);
+		return WireTupleIO<View>::template Read<typename Schema::Types>(reader, pView);
+	}
+
+	static bool Decode(WireReader& pReader, View& pView)
+	{
+		return WireTupleIO<View>::template Read<typename Schema::Types>(pReader, pView);
+	}
+
+	static bool Write(WireWriter& pWriter, const View& pView)
+	{
+		return WireTupleIO<View>::template Write<typename Schema::Types>(pWriter, pView);
+	}
+
+	// Appends the packet to the arena, returns the encoded size or 0 if it did
+	// not fit, in which case the arena is left as it was.
+	static size_t Encode(const View& pView, WireWriter& pWriter)
+	{
+		const size_t start = pWriter.Size();
+		if(!Write(pWriter, pView))
+		{
+			pWriter.Rewind(start);
+			return 0;
+		}
+		return pWriter.Size() - start;
+	}
+};
+
+// Checks pBuffer holds exactly one packet in this format: it must decode
+// completely and re-encode to the same bytes. pScratch must be at least pSize
+// bytes.
+template<class Packet>
+bool WireVerify(const void* pBuffer, size_t pSize, void* pScratch)
+{
+	typename WirePacket<Packet>::View view;
+	WireReader reader(pBuffer, pSize);
+	if(!WirePacket<Packet>::Decode(reader, view) || reader.Remaining() != 0)
+		return false;
+	if(WirePacket<Packet>::Size(view) != pSize)
+		return false;
+
+	WireWriter writer(pScratch, pSize);
+	return WirePacket<Packet>::Encode(view, writer) == pSize && std::memcmp(pScratch, pBuffer, pSize) == 0;
+}
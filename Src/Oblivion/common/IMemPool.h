@@ -277,10 +277,9 @@ public:
 	{
 		PoolItem	* item = reinterpret_cast <PoolItem *>(obj);
 
-		item->next = m_free;
-
 		m_mutex.Enter();
 
+		item->next = m_free;
 		m_free = item;
 
 		m_mutex.Leave();
@@ -295,6 +294,14 @@ public:
 		return m_free == NULL;
 	}
 
+	// true if obj was allocated from this pool
+	bool	Contains(const void * obj)
+	{
+		const PoolItem	* item = reinterpret_cast <const PoolItem *>(obj);
+
+		return item >= m_items && item < m_items + size;
+	}
+
 private:
 	union PoolItem
 	{
@@ -0,0 +1,182 @@
+// Writes random sets of plugins and chunks through CoSaveWriter, then walks the buffer the way
+// Serialization::HandleLoadGame reads a co-save and checks every header, count, length and data byte. Plugins that
+// open no chunks must leave nothing behind, and a second save into the same writer must not see the first.
+//
+// make CoSaveWriterTest
+
+#include "obse/CoSaveWriter.h"
+
+#include <cstdio>
+#include <vector>
+
+using namespace Serialization;
+
+class Random
+{
+public:
+
+	explicit Random(UInt32 seed) : m_state(seed) {}
+
+	UInt32 Next()
+	{
+		m_state = m_state * 1664525u + 1013904223u;
+		return m_state >> 8;
+	}
+
+private:
+
+	UInt32 m_state;
+};
+
+struct ExpectedChunk
+{
+	UInt32				type;
+	UInt32				version;
+	std::vector <UInt8>	data;
+};
+
+struct ExpectedPlugin
+{
+	UInt32						opcodeBase;
+	std::vector <ExpectedChunk>	chunks;
+};
+
+static UInt32 s_failures = 0;
+
+static void Check(bool condition, const char * what, UInt32 save)
+{
+	if(!condition && s_failures++ < 10)
+		std::printf("FAILED save %u: %s\n", save, what);
+}
+
+// reads a value from the buffer, returns false if it would run past the end
+template <typename T>
+static bool Read(const UInt8 * buf, UInt32 size, UInt32 * offset, T * out)
+{
+	if(size - *offset < sizeof(T))
+		return false;
+
+	std::memcpy(out, buf + *offset, sizeof(T));
+	*offset += sizeof(T);
+	return true;
+}
+
+static void Verify(const CoSaveWriter & writer, const std::vector <ExpectedPlugin> & expected, UInt32 save)
+{
+	const UInt8	* buf = writer.Data();
+	UInt32		size = writer.Size();
+	UInt32		offset = 0;
+
+	// only plugins that wrote something get a header
+	std::vector <const ExpectedPlugin *>	written;
+	for(UInt32 i = 0; i < expected.size(); i++)
+		if(!expected[i].chunks.empty())
+			written.push_back(&expected[i]);
+
+	Header	header = { };
+	Check(Read(buf, size, &offset, &header), "file header truncated", save);
+	Check(header.signature == Header::kSignature, "signature", save);
+	Check(size >= 4 && !std::memcmp(buf, "OBSE", 4), "signature bytes", save);
+	Check(header.formatVersion == Header::kVersion, "format version", save);
+	Check(header.obseVersion == 21 && header.obseMinorVersion == 3 && header.oblivionVersion == 0x010201A0, "versions", save);
+	Check(header.numPlugins == written.size(), "plugin count", save);
+
+	for(UInt32 i = 0; i < written.size() && !s_failures; i++)
+	{
+		PluginHeader	pluginHeader = { };
+		Check(Read(buf, size, &offset, &pluginHeader), "plugin header truncated", save);
+		Check(pluginHeader.opcodeBase == written[i]->opcodeBase, "plugin opcode base", save);
+		Check(pluginHeader.numChunks == written[i]->chunks.size(), "chunk count", save);
+		Check(pluginHeader.length <= size - offset, "plugin length past end", save);
+
+		UInt32	pluginEnd = offset + pluginHeader.length;
+
+		for(UInt32 j = 0; j < written[i]->chunks.size() && !s_failures; j++)
+		{
+			const ExpectedChunk	& chunk = written[i]->chunks[j];
+
+			ChunkHeader	chunkHeader = { };
+			Check(Read(buf, size, &offset, &chunkHeader), "chunk header truncated", save);
+			Check(chunkHeader.type == chunk.type && chunkHeader.version == chunk.version, "chunk type and version", save);
+			Check(chunkHeader.length == chunk.data.size(), "chunk length", save);
+			Check(chunkHeader.length <= pluginEnd - offset, "chunk length past plugin", save);
+
+			if(!s_failures)
+			{
+				Check(!chunk.data.size() || !std::memcmp(buf + offset, &chunk.data[0], chunk.data.size()), "chunk data", save);
+				offset += chunkHeader.length;
+			}
+		}
+
+		Check(offset == pluginEnd, "plugin length", save);
+	}
+
+	Check(offset == size, "trailing bytes", save);
+}
+
+int main()
+{
+	static const UInt32	kSaves = 2000;
+
+	Random			random(0xC05A7E);
+	CoSaveWriter	writer;
+	UInt32			totalBytes = 0;
+
+	for(UInt32 save = 0; save < kSaves && !s_failures; save++)
+	{
+		std::vector <ExpectedPlugin>	expected(random.Next() % 6);
+
+		writer.Begin(21, 3, 0x010201A0);
+
+		for(UInt32 i = 0; i < expected.size(); i++)
+		{
+			ExpectedPlugin	& plugin = expected[i];
+			plugin.opcodeBase = 0x1400 + i * 0x1000;
+			plugin.chunks.resize(random.Next() % 3 ? random.Next() % 8 : 0);
+
+			writer.BeginPlugin(plugin.opcodeBase);
+
+			for(UInt32 j = 0; j < plugin.chunks.size(); j++)
+			{
+				ExpectedChunk	& chunk = plugin.chunks[j];
+				chunk.type = random.Next();
+				chunk.version = random.Next() % 4;
+
+				// occasionally large enough to make the buffer grow, sometimes empty
+				UInt32	length = random.Next() % 16 ? random.Next() % 64 : random.Next() % 0x10000;
+				if(random.Next() % 8 == 0)
+					length = 0;
+
+				chunk.data.resize(length);
+				for(UInt32 k = 0; k < length; k++)
+					chunk.data[k] = random.Next();
+
+				writer.OpenChunk(chunk.type, chunk.version);
+
+				// plugins write a record in pieces as often as in one go
+				UInt32	written = 0;
+				while(written < length)
+				{
+					UInt32	piece = 1 + random.Next() % (length - written);
+					writer.WriteData(&chunk.data[written], piece);
+					written += piece;
+				}
+
+				if(random.Next() % 4 == 0)
+					writer.WriteData(NULL, 0);
+			}
+
+			writer.EndPlugin();
+		}
+
+		writer.End();
+
+		Verify(writer, expected, save);
+		totalBytes += writer.Size();
+
+		writer.Trim();
+	}
+
+	std::printf("%u saves, %u bytes, %u failures\n", kSaves, totalBytes, s_failures);
+	return s_failures ? 1 : 0;
+}
@@ -0,0 +1,231 @@
+// Checks the StringSearch kernel behind sv_Find, sv_Count and sv_Replace against the substr based
+// implementation StringVar used before it, over random strings, patterns and ranges in both case modes,
+// including ranges whose end wraps past 2^32. Texts are copied into buffers of their exact length so a read
+// past the end is caught when built with -fsanitize=address.
+//
+// make StringSearchTest
+
+#include "obse/StringSearch.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Small deterministic generator so runs are comparable across machines.
+class Random
+{
+public:
+
+	explicit Random(UInt32 seed) : m_state(seed) {}
+
+	UInt32 Next()
+	{
+		m_state = m_state * 1664525u + 1013904223u;
+		return m_state >> 8;
+	}
+
+private:
+
+	UInt32 m_state;
+};
+
+static bool CaseInsensitiveEqual(char lhs, char rhs)
+{
+	return tolower((unsigned char)lhs) == tolower((unsigned char)rhs);
+}
+
+// The StringVar functions as they were, working on copies of the range.
+static std::string Lower(std::string str)
+{
+	std::transform(str.begin(), str.end(), str.begin(), tolower);
+	return str;
+}
+
+static UInt32 OldFind(const std::string& data, std::string subString, UInt32 startPos, UInt32 numChars, bool bCaseSensitive)
+{
+	UInt32 pos = -1;
+	if (numChars + startPos >= data.length())
+		numChars = data.length() - startPos;
+
+	if (startPos < data.length())
+	{
+		std::string source = data.substr(startPos, numChars);
+		if (!bCaseSensitive)
+		{
+			source = Lower(source);
+			subString = Lower(subString);
+		}
+
+		pos = source.find(subString);
+		if (pos != -1)
+			pos += startPos;
+	}
+	return pos;
+}
+
+static UInt32 OldCount(const std::string& data, std::string subString, UInt32 startPos, UInt32 numChars, bool bCaseSensitive)
+{
+	if (numChars + startPos >= data.length())
+		numChars = data.length() - startPos;
+	if (startPos >= data.length() || subString.empty())
+		return 0;
+
+	std::string source = data.substr(startPos, numChars);
+	if (!bCaseSensitive)
+	{
+		source = Lower(source);
+		subString = Lower(subString);
+	}
+
+	UInt32 strIdx = 0;
+	UInt32 count = 0;
+	while ((strIdx = source.find(subString, strIdx)) != -1)
+	{
+		count++;
+		strIdx += subString.length();
+	}
+	return count;
+}
+
+static UInt32 OldReplace(std::string& data, const std::string& toReplace, const std::string& replaceWith,
+	UInt32 startPos, UInt32 numChars, bool bCaseSensitive, UInt32 numToReplace)
+{
+	if (startPos >= data.length())
+		return 0;
+	else if (numChars + startPos > data.length())
+		numChars = data.length() - startPos;
+
+	std::string srcStr = data.substr(startPos, numChars);
+	data.erase(startPos, numChars);
+
+	UInt32 numReplaced = 0;
+	UInt32 strIdx = 0;
+	while (numReplaced < numToReplace)
+	{
+		if (bCaseSensitive)
+			strIdx = srcStr.find(toReplace, strIdx);
+		else
+		{
+			std::string::iterator iter = std::search(srcStr.begin() + strIdx, srcStr.end(), toReplace.begin(), toReplace.end(), CaseInsensitiveEqual);
+			strIdx = iter != srcStr.end() ? UInt32(iter - srcStr.begin()) : UInt32(-1);
+		}
+		if (strIdx == -1)
+			break;
+
+		numReplaced++;
+		srcStr.erase(strIdx, toReplace.length());
+		srcStr.insert(strIdx, replaceWith);
+		strIdx += replaceWith.length();
+	}
+
+	data.insert(startPos, srcStr);
+	return numReplaced;
+}
+
+// The StringVar functions as they are now.
+static UInt32 NewFind(const char* data, UInt32 length, const char* subString, UInt32 startPos, UInt32 numChars, bool bCaseSensitive)
+{
+	UInt32 pos = -1;
+	if (StringSearch::ClampRange(length, startPos, &numChars))
+	{
+		StringSearch search(subString, bCaseSensitive);
+		pos = search.Find(data + startPos, numChars);
+		if (pos != -1)
+			pos += startPos;
+	}
+	return pos;
+}
+
+static UInt32 NewCount(const char* data, UInt32 length, const char* subString, UInt32 startPos, UInt32 numChars, bool bCaseSensitive)
+{
+	if (!StringSearch::ClampRange(length, startPos, &numChars))
+		return 0;
+
+	StringSearch search(subString, bCaseSensitive);
+	return search.FindAll(data, startPos, startPos + numChars, -1, NULL);
+}
+
+static UInt32 NewReplace(std::string& result, const char* data, UInt32 length, const char* toReplace, const char* replaceWith,
+	UInt32 startPos, UInt32 numChars, bool bCaseSensitive, UInt32 numToReplace)
+{
+	result.assign(data, length);
+	if (!StringSearch::ClampRange(length, startPos, &numChars))
+		return 0;
+
+	StringSearch search(toReplace, bCaseSensitive);
+	std::vector<UInt32> matches;
+	if (!search.FindAll(data, startPos, startPos + numChars, numToReplace, &matches))
+		return 0;
+
+	result = search.Replace(data, length, matches, replaceWith);
+	return matches.size();
+}
+
+static std::string RandomString(Random& random, UInt32 maxLength)
+{
+	// few distinct letters so patterns match often, both cases so folding matters
+	static const char kAlphabet[] = "aAbBcC ";
+	std::string str(random.Next() % (maxLength + 1), ' ');
+	for (size_t i = 0; i < str.size(); ++i)
+		str[i] = kAlphabet[random.Next() % (sizeof(kAlphabet) - 1)];
+	return str;
+}
+
+static UInt32 RandomCount(Random& random, UInt32 length)
+{
+	switch (random.Next() % 4)
+	{
+	case 0:		return -1;							// the default, to the end of the string
+	case 1:		return UInt32(-1) - random.Next() % 4;	// wraps when added to the start
+	default:	return random.Next() % (length + 3);
+	}
+}
+
+int main()
+{
+	static const UInt32 kCases = 200000;
+
+	Random random(0x5EA2C4);
+	UInt32 failures = 0;
+	UInt32 matched = 0;
+
+	for (UInt32 i = 0; i < kCases && failures < 10; ++i)
+	{
+		const std::string text = RandomString(random, 40);
+		const std::string pattern = RandomString(random, 1 + random.Next() % 5);
+		const std::string replacement = RandomString(random, 3);
+		const bool bCaseSensitive = random.Next() % 2 != 0;
+		const UInt32 startPos = random.Next() % (text.size() + 2);
+		const UInt32 numChars = RandomCount(random, text.size());
+		const UInt32 numToReplace = random.Next() % 3 ? UInt32(-1) : random.Next() % 3;
+
+		// exactly sized so reading past the end is an error under the address sanitizer
+		std::vector<char> exact(text.begin(), text.end());
+		const char* data = exact.empty() ? "" : &exact[0];
+		const UInt32 length = text.size();
+
+		const UInt32 oldPos = OldFind(text, pattern, startPos, numChars, bCaseSensitive);
+		const UInt32 newPos = NewFind(data, length, pattern.c_str(), startPos, numChars, bCaseSensitive);
+		const UInt32 oldCount = OldCount(text, pattern, startPos, numChars, bCaseSensitive);
+		const UInt32 newCount = NewCount(data, length, pattern.c_str(), startPos, numChars, bCaseSensitive);
+
+		std::string oldResult = text;
+		std::string newResult;
+		const UInt32 oldReplaced = pattern.empty() ? 0 : OldReplace(oldResult, pattern, replacement, startPos, numChars, bCaseSensitive, numToReplace);
+		const UInt32 newReplaced = NewReplace(newResult, data, length, pattern.c_str(), replacement.c_str(), startPos, numChars, bCaseSensitive, numToReplace);
+
+		if (oldPos != newPos || oldCount != newCount || oldReplaced != newReplaced || oldResult != newResult)
+		{
+			std::printf("FAILED \"%s\" pattern \"%s\" -> \"%s\" start %u chars %u %s: find %d/%d count %u/%u replace %u/%u \"%s\"/\"%s\"\n",
+				text.c_str(), pattern.c_str(), replacement.c_str(), startPos, numChars, bCaseSensitive ? "case sensitive" : "ignoring case",
+				int(oldPos), int(newPos), oldCount, newCount, oldReplaced, newReplaced, oldResult.c_str(), newResult.c_str());
+			++failures;
+		}
+		matched += newCount != 0;
+	}
+
+	std::printf("%u cases, %u with matches, %u failures\n", kCases, matched, failures);
+	return failures ? 1 : 0;
+}
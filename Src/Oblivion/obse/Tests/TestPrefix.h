@@ -0,0 +1,20 @@
+#pragma once
+
+// Stands in for obse_common/obse_prefix.h, which the project force-includes and which pulls in windows.h, so
+// the sources under test build on any host. Types keep their sizes under MSVC, UInt32 is 32 bits there.
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+
+typedef uint8_t		UInt8;
+typedef uint16_t	UInt16;
+typedef uint32_t	UInt32;
+typedef uint64_t	UInt64;
+typedef int8_t		SInt8;
+typedef int16_t		SInt16;
+typedef int32_t		SInt32;
+typedef int64_t		SInt64;
+
+#define ASSERT(a)			assert(a)
+#define MACRO_SWAP32(a)		((((a) & 0x000000FF) << 24) | (((a) & 0x0000FF00) << 8) | (((a) & 0x00FF0000) >> 8) | (((a) & 0xFF000000) >> 24))
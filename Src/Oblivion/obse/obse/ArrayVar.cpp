@@ -2,6 +2,9 @@
 #include "ArrayVar.h"
 #include "GameForms.h"
 #include <algorithm>
+#include <cmath>
+#include <functional>
+#include "common/ICriticalSection.h"
 
 #if OBLIVION
 #include "GameAPI.h"
@@ -12,6 +15,190 @@
 
 ArrayVarMap g_ArrayMap;
 
+//////////////////
+// ArrayString
+/////////////////
+
+ArrayString* ArrayString::Create(const char* str, UInt32 len)
+{
+	ArrayString* result = (ArrayString*)malloc(sizeof(ArrayString) + len);
+	result->m_refCount = 1;
+	result->m_length = len;
+	result->m_hash = 0;
+	result->m_bPooled = false;
+	memcpy(result->m_data, str, len);
+	result->m_data[len] = 0;
+	return result;
+}
+
+// set of pooled strings, linear probing with backward shift deletion. The pool holds no reference of its own,
+// a string removes itself when released for the last time
+// strings are interned by script tokens on whichever thread evaluates them, so lookups and the final release of a
+// pooled string are done under m_lock: a string found by Intern() can't be freed in between
+class ArrayStringPool
+{
+	std::vector<ArrayString*>	m_slots;	// NULL if empty
+	UInt32						m_count;
+	ICriticalSection			m_lock;
+
+	static UInt32 Hash(const char* str, UInt32 len)
+	{
+		UInt32 hash = 2166136261;
+		for (UInt32 i = 0; i < len; i++)
+			hash = (hash ^ (UInt8)str[i]) * 16777619;
+
+		return hash;
+	}
+
+	void Rehash(UInt32 numSlots)
+	{
+		std::vector<ArrayString*> oldSlots(numSlots, (ArrayString*)NULL);
+		oldSlots.swap(m_slots);
+		for (UInt32 i = 0; i < oldSlots.size(); i++)
+		{
+			if (oldSlots[i])
+			{
+				UInt32 slot = oldSlots[i]->m_hash & (m_slots.size() - 1);
+				while (m_slots[slot])
+					slot = (slot + 1) & (m_slots.size() - 1);
+				m_slots[slot] = oldSlots[i];
+			}
+		}
+	}
+
+public:
+	ArrayStringPool() : m_count(0) { }
+
+	ArrayString* Intern(const char* str, UInt32 len)
+	{
+		UInt32 hash = Hash(str, len);
+
+		m_lock.Enter();
+		ArrayString* result = Lookup(str, len, hash);
+		m_lock.Leave();
+
+		return result;
+	}
+
+	// drops the reference of a pooled string whose count may reach zero, removing and freeing it if it does
+	void Release(ArrayString* str)
+	{
+		m_lock.Enter();
+		bool bFree = !InterlockedDecrement(&str->m_refCount);
+		if (bFree)
+			Remove(str);
+		m_lock.Leave();
+
+		if (bFree)
+			free(str);
+	}
+
+	void GetStats(ArrayString::PoolStats* out)
+	{
+		memset(out, 0, sizeof(ArrayString::PoolStats));
+
+		m_lock.Enter();
+		for (UInt32 i = 0; i < m_slots.size(); i++)
+		{
+			if (ArrayString* str = m_slots[i])
+			{
+				UInt32 size = sizeof(ArrayString) + str->m_length;
+				out->numStrings++;
+				out->numRefs += str->m_refCount;
+				out->bytesUsed += size;
+				out->bytesSaved += (str->m_refCount - 1) * size;
+			}
+		}
+		m_lock.Leave();
+	}
+
+private:
+	ArrayString* Lookup(const char* str, UInt32 len, UInt32 hash)
+	{
+		if ((m_count + 1) * 2 > m_slots.size())
+			Rehash(m_slots.size() ? m_slots.size() * 2 : 0x400);
+
+		UInt32 slot = hash & (m_slots.size() - 1);
+		for (ArrayString* cur; (cur = m_slots[slot]) != NULL; slot = (slot + 1) & (m_slots.size() - 1))
+		{
+			if (cur->m_hash == hash && cur->m_length == len && !memcmp(cur->m_data, str, len))
+				return cur->AddRef();
+		}
+
+		ArrayString* result = ArrayString::Create(str, len);
+		result->m_hash = hash;
+		result->m_bPooled = true;
+		m_slots[slot] = result;
+		m_count++;
+		return result;
+	}
+
+	void Remove(ArrayString* str)
+	{
+		UInt32 mask = m_slots.size() - 1;
+		UInt32 slot = str->m_hash & mask;
+		while (m_slots[slot] != str)
+			slot = (slot + 1) & mask;
+
+		// shift back any following entry which would no longer be reachable across the hole
+		UInt32 hole = slot;
+		for (UInt32 next = (hole + 1) & mask; m_slots[next]; next = (next + 1) & mask)
+		{
+			UInt32 home = m_slots[next]->m_hash & mask;
+			if (((next - home) & mask) >= ((next - hole) & mask))
+			{
+				m_slots[hole] = m_slots[next];
+				hole = next;
+			}
+		}
+
+		m_slots[hole] = NULL;
+		m_count--;
+	}
+};
+
+static ArrayStringPool s_stringPool;
+
+ArrayString* ArrayString::Intern(const char* str, UInt32 len)
+{
+	return s_stringPool.Intern(str, len);
+}
+
+ArrayString* ArrayString::Pool()
+{
+	if (m_bPooled)
+		return this;
+
+	ArrayString* pooled = Intern(m_data, m_length);
+	Release();
+	return pooled;
+}
+
+void ArrayString::GetPoolStats(PoolStats* out)
+{
+	s_stringPool.GetStats(out);
+}
+
+void ArrayString::Release()
+{
+	if (!m_bPooled)
+	{
+		if (!InterlockedDecrement(&m_refCount))
+			free(this);
+
+		return;
+	}
+
+	// references other than the last are dropped without locking the pool
+	for (LONG refCount = m_refCount; refCount > 1; refCount = m_refCount)
+	{
+		if (InterlockedCompareExchange(&m_refCount, refCount - 1, refCount) == refCount)
+			return;
+	}
+
+	s_stringPool.Release(this);
+}
+
 //////////////////
 // ArrayElement
 /////////////////
@@ -19,8 +206,34 @@ ArrayVarMap g_ArrayMap;
 ArrayElement::ArrayElement()
 	: m_dataType(kDataType_Invalid), m_owningArray(0)
 {	
-	m_data.formID = 0;
-	m_data.str = "";
+	m_data.num = 0;
+}
+
+ArrayElement::ArrayElement(const ArrayElement& copyFrom)
+	: m_data(copyFrom.m_data), m_dataType(copyFrom.m_dataType), m_owningArray(copyFrom.m_owningArray)
+{
+	if (m_dataType == kDataType_String)
+		m_data.str->AddRef();
+}
+
+ArrayElement& ArrayElement::operator=(const ArrayElement& rhs)
+{
+	// plain copy, like the copy constructor; references to arrays are managed through Set()/Unset()
+	if (rhs.m_dataType == kDataType_String)
+		rhs.m_data.str->AddRef();
+	if (m_dataType == kDataType_String)
+		m_data.str->Release();
+
+	m_data = rhs.m_data;
+	m_dataType = rhs.m_dataType;
+	m_owningArray = rhs.m_owningArray;
+	return *this;
+}
+
+ArrayElement::~ArrayElement()
+{
+	if (m_dataType == kDataType_String)
+		m_data.str->Release();
 }
 
 bool ArrayElement::operator<(const ArrayElement& rhs) const
@@ -35,7 +248,7 @@ bool ArrayElement::operator<(const ArrayElement& rhs) const
 	}
 
 	if (DataType() == kDataType_String)
-		return (_stricmp(m_data.str.c_str(), rhs.m_data.str.c_str()) < 0);
+		return (_stricmp(m_data.str->c_str(), rhs.m_data.str->c_str()) < 0);
 	else if (DataType() == kDataType_Form)
 		return m_data.formID < rhs.m_data.formID;
 	else
@@ -50,7 +263,9 @@ bool ArrayElement::Equals(const ArrayElement& compareTo) const
 	switch (DataType())
 	{
 	case kDataType_String:
-		return (m_data.str.length() == compareTo.m_data.str.length()) ? !_stricmp(m_data.str.c_str(), compareTo.m_data.str.c_str()) : false;
+		if (m_data.str == compareTo.m_data.str)		// same payload
+			return true;
+		return (m_data.str->length() == compareTo.m_data.str->length()) ? !_stricmp(m_data.str->c_str(), compareTo.m_data.str->c_str()) : false;
 	case kDataType_Form:
 		return m_data.formID == compareTo.m_data.formID;
 	default:
@@ -68,7 +283,7 @@ std::string ArrayElement::ToString() const
 		sprintf_s(buf, sizeof(buf), "%f", m_data.num);
 		return buf;
 	case kDataType_String:
-		return m_data.str;
+		return m_data.str->c_str();
 	case kDataType_Array:
 		sprintf_s(buf, sizeof(buf), "Array ID %.0f", m_data.num);
 		return buf;
@@ -126,7 +341,7 @@ bool ArrayElement::SetString(const std::string& str)
 	Unset();
 
 	m_dataType = kDataType_String;
-	m_data.str = str;
+	m_data.str = m_owningArray ? ArrayString::Intern(str) : ArrayString::Create(str);
 	return true;
 }
 
@@ -156,14 +371,19 @@ bool ArrayElement::SetNumber(double num)
 
 bool ArrayElement::Set(const ArrayElement& elem)
 {
-	Unset();
-
-	m_dataType = elem.DataType();
-	switch (m_dataType)
+	switch (elem.DataType())
 	{
 	case kDataType_String:
-		SetString(elem.m_data.str);
-		break;
+		{
+			// share the string, taking our reference first in case elem is this element
+			ArrayString* str = elem.m_data.str->AddRef();
+			if (m_owningArray)
+				str = str->Pool();
+			Unset();
+			m_dataType = kDataType_String;
+			m_data.str = str;
+			break;
+		}
 	case kDataType_Array:
 		SetArray(elem.m_data.num, g_ArrayMap.GetOwningModIndex(m_owningArray));
 		break;
@@ -174,13 +394,35 @@ bool ArrayElement::Set(const ArrayElement& elem)
 		SetFormID(elem.m_data.formID);
 		break;
 	default:
-		m_dataType = kTokenType_Invalid;
+		Unset();
 		return false;
 	}
 
 	return true;
 }
 
+bool ArrayElement::SetFromKey(const ArrayKey& key)
+{
+	switch (key.KeyType())
+	{
+	case kDataType_String:
+		{
+			ArrayString* str = key.Key().str->AddRef();
+			if (m_owningArray)
+				str = str->Pool();
+			Unset();
+			m_dataType = kDataType_String;
+			m_data.str = str;
+			return true;
+		}
+	case kDataType_Numeric:
+		return SetNumber(key.Key().num);
+	default:
+		Unset();
+		return false;
+	}
+}
+
 bool ArrayElement::GetAsArray(ArrayID* out) const
 {
 	if (!out || m_dataType != kDataType_Array)
@@ -212,7 +454,7 @@ bool ArrayElement::GetAsString(std::string& out) const
 {
 	if (m_dataType != kDataType_String)
 		return false;
-	out = m_data.str;
+	out = m_data.str->c_str();
 	return true;
 }
 
@@ -220,6 +462,8 @@ void ArrayElement::Unset()
 {
 	if (m_dataType == kDataType_Array)
 		g_ArrayMap.RemoveReference(&m_data.num, g_ArrayMap.GetOwningModIndex(m_owningArray));
+	else if (m_dataType == kDataType_String)
+		m_data.str->Release();
 	
 	m_dataType = kDataType_Invalid;
 	m_data.num = 0;
@@ -229,7 +473,17 @@ void ArrayElement::Unset()
 // ArrayKey
 //////////////////////
 
-ArrayKey::ArrayKey() : keyType(kDataType_Invalid)
+// FNV-1a over the lowercased key, consistent with the case-insensitive comparisons below
+static UInt32 HashKeyString(const char* str)
+{
+	UInt32 hash = 2166136261;
+	for (; *str; ++str)
+		hash = (hash ^ (UInt8)tolower((UInt8)*str)) * 16777619;
+
+	return hash;
+}
+
+ArrayKey::ArrayKey() : keyType(kDataType_Invalid), hash(0)
 {
 	key.num = 0;
 }
@@ -237,19 +491,40 @@ ArrayKey::ArrayKey() : keyType(kDataType_Invalid)
 ArrayKey::ArrayKey(const std::string& _key)
 {
 	keyType = kDataType_String;
-	key.str = _key;
+	key.str = ArrayString::Create(_key);
+	hash = HashKeyString(_key.c_str());
 }
 
 ArrayKey::ArrayKey(const char* _key)
 {
 	keyType = kDataType_String;
-	key.str = _key;
+	key.str = ArrayString::Create(_key, strlen(_key));
+	hash = HashKeyString(_key);
+}
+
+ArrayKey::ArrayKey(const ArrayKey& rhs) : key(rhs.key), keyType(rhs.keyType), hash(rhs.hash)
+{
+	if (keyType == kDataType_String)
+		key.str->AddRef();
+}
+
+ArrayKey& ArrayKey::operator=(const ArrayKey& rhs)
+{
+	if (rhs.keyType == kDataType_String)
+		rhs.key.str->AddRef();
+	ReleaseString();
+
+	key = rhs.key;
+	keyType = rhs.keyType;
+	hash = rhs.hash;
+	return *this;
 }
 
 ArrayKey::ArrayKey(double _key)
 {
 	keyType = kDataType_Numeric;
 	key.num = _key;
+	hash = 0;
 }
 
 bool ArrayKey::operator<(const ArrayKey& rhs) const
@@ -265,7 +540,7 @@ bool ArrayKey::operator<(const ArrayKey& rhs) const
 	case kDataType_Numeric:
 		return key.num < rhs.key.num;
 	case kDataType_String:
-		return _stricmp(key.str.c_str(), rhs.key.str.c_str()) < 0;
+		return _stricmp(key.str->c_str(), rhs.key.str->c_str()) < 0;
 	default:
 		_MESSAGE("Error: Invalid ArrayKey type %d", rhs.keyType);
 		return true;
@@ -285,26 +560,493 @@ bool ArrayKey::operator==(const ArrayKey& rhs) const
 	case kDataType_Numeric:
 		return key.num == rhs.key.num;
 	case kDataType_String:
-		return (key.str.length() == rhs.key.str.length()) ? !(_stricmp(key.str.c_str(), rhs.key.str.c_str())) : false;
+		if (key.str == rhs.key.str)		// same payload
+			return true;
+		return (key.str->length() == rhs.key.str->length()) ? !(_stricmp(key.str->c_str(), rhs.key.str->c_str())) : false;
 	default:
 		_MESSAGE("Error: Invalid ArrayKey type %d", rhs.keyType);
 		return true;
 	}
 }
 
+///////////////////////
+// ArrayVarElementContainer
+//////////////////////
+
+UInt32 ArrayVarElementContainer::s_nextVersion = 1;
+
+bool ArrayVarElementContainer::GetIndex(const ArrayKey& key, UInt32* outIndex)
+{
+	if (key.KeyType() != kDataType_Numeric)
+		return false;
+
+	double num = key.Key().num;
+	if (num < 0 || num != (UInt32)num)
+		return false;
+
+	*outIndex = num;
+	return true;
+}
+
+const ArrayKey& ArrayVarElementContainer::iterator::GetKey() const
+{
+	switch (m_container->m_storage)
+	{
+	case kStorage_Vector:
+		return m_key;
+	case kStorage_Hash:
+		return GetEntry().first;
+	default:
+		return m_mapIter->first;
+	}
+}
+
+ArrayElement& ArrayVarElementContainer::iterator::GetElement() const
+{
+	switch (m_container->m_storage)
+	{
+	case kStorage_Vector:
+		return m_container->m_vector[m_index];
+	case kStorage_Hash:
+		return GetEntry().second;
+	default:
+		return m_mapIter->second;
+	}
+}
+
+ArrayVarElementContainer::iterator& ArrayVarElementContainer::iterator::operator++()
+{
+	if (m_container->m_storage == kStorage_Map)
+		++m_mapIter;
+	else if (m_container->m_storage == kStorage_Vector)
+		m_key.SetNumericKey(++m_index);
+	else
+		++m_index;
+
+	return *this;
+}
+
+ArrayVarElementContainer::iterator& ArrayVarElementContainer::iterator::operator--()
+{
+	if (m_container->m_storage == kStorage_Map)
+		--m_mapIter;
+	else if (m_container->m_storage == kStorage_Vector)
+		m_key.SetNumericKey(--m_index);
+	else
+		--m_index;
+
+	return *this;
+}
+
+UInt32 ArrayVarElementContainer::size() const
+{
+	switch (m_storage)
+	{
+	case kStorage_Vector:
+		return m_vector.size();
+	case kStorage_Hash:
+		return m_entries.size();
+	default:
+		return m_map.size();
+	}
+}
+
+// returns the slot holding key, or the empty slot ending its probe sequence
+UInt32 ArrayVarElementContainer::FindSlot(const ArrayKey& key) const
+{
+	UInt32 mask = m_slots.size() - 1;
+	UInt32 slot = key.Hash() & mask;
+	while (m_slots[slot])
+	{
+		const ArrayKey& slotKey = m_entries[m_slots[slot] - 1].first;
+		if (slotKey.Hash() == key.Hash() && slotKey == key)
+			break;
+
+		slot = (slot + 1) & mask;
+	}
+
+	return slot;
+}
+
+void ArrayVarElementContainer::Rehash(UInt32 numSlots)
+{
+	m_slots.assign(numSlots, 0);
+	for (UInt32 i = 0; i < m_entries.size(); i++)
+		m_slots[FindSlot(m_entries[i].first)] = i + 1;
+}
+
+// erases the entry at position sortedIdx of the sorted index, keeping the index valid
+void ArrayVarElementContainer::EraseEntry(UInt32 sortedIdx)
+{
+	UInt32 entryIdx = m_sorted[sortedIdx];
+	m_sorted.erase(m_sorted.begin() + sortedIdx);
+	if (sortedIdx < m_numSorted)
+		m_numSorted--;
+
+	UInt32 mask = m_slots.size() - 1;
+	UInt32 slot = FindSlot(m_entries[entryIdx].first);
+	m_slots[slot] = 0;
+
+	// shift back any entries in the same probe sequence which would no longer be reachable
+	for (UInt32 next = (slot + 1) & mask; m_slots[next]; next = (next + 1) & mask)
+	{
+		UInt32 home = m_entries[m_slots[next] - 1].first.Hash() & mask;
+		if (((next - home) & mask) >= ((next - slot) & mask))
+		{
+			m_slots[slot] = m_slots[next];
+			m_slots[next] = 0;
+			slot = next;
+		}
+	}
+
+	// move the last entry into the hole, its position in the sorted index is unchanged
+	UInt32 lastIdx = m_entries.size() - 1;
+	if (entryIdx != lastIdx)
+	{
+		m_slots[FindSlot(m_entries[lastIdx].first)] = entryIdx + 1;
+		m_entries[entryIdx] = m_entries[lastIdx];
+		*std::find(m_sorted.begin(), m_sorted.end(), lastIdx) = entryIdx;
+	}
+
+	m_entries.pop_back();
+}
+
+// sorts the entries added since the last call and merges them into the sorted index
+void ArrayVarElementContainer::Sort()
+{
+	if (m_numSorted == m_sorted.size())
+		return;
+
+	struct KeyLess
+	{
+		const _EntryVector& entries;
+		KeyLess(const _EntryVector& _entries) : entries(_entries) { }
+		bool operator()(UInt32 lhs, UInt32 rhs) const { return entries[lhs].first < entries[rhs].first; }
+	};
+
+	std::vector<UInt32>::iterator added = m_sorted.begin() + m_numSorted;
+	std::sort(added, m_sorted.end(), KeyLess(m_entries));
+	std::inplace_merge(m_sorted.begin(), added, m_sorted.end(), KeyLess(m_entries));
+	m_numSorted = m_sorted.size();
+}
+
+ArrayVarElementContainer::iterator ArrayVarElementContainer::begin()
+{
+	switch (m_storage)
+	{
+	case kStorage_Vector:
+		return iterator(this, (UInt32)0);
+	case kStorage_Hash:
+		Sort();
+		return iterator(this, (UInt32)0);
+	default:
+		return iterator(this, m_map.begin());
+	}
+}
+
+ArrayVarElementContainer::iterator ArrayVarElementContainer::end()
+{
+	return m_storage == kStorage_Map ? iterator(this, m_map.end()) : iterator(this, size());
+}
+
+ArrayVarElementContainer::iterator ArrayVarElementContainer::find(const ArrayKey& key)
+{
+	if (m_storage == kStorage_Map)
+		return iterator(this, m_map.find(key));
+
+	if (m_storage == kStorage_Hash)
+	{
+		if (!Lookup(key))
+			return end();
+
+		// locate the key's position in the sorted index
+		Sort();
+		UInt32 lo = 0;
+		UInt32 hi = m_sorted.size();
+		while (lo < hi)
+		{
+			UInt32 mid = (lo + hi) / 2;
+			if (m_entries[m_sorted[mid]].first < key)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+
+		return iterator(this, lo);
+	}
+
+	UInt32 idx;
+	if (GetIndex(key, &idx) && idx < m_vector.size())
+		return iterator(this, idx);
+
+	return end();
+}
+
+ArrayVarElementContainer::iterator ArrayVarElementContainer::upper_bound(const ArrayKey& key)
+{
+	switch (m_storage)
+	{
+	case kStorage_Vector:
+		{
+			// keys are 0 through size() - 1
+			if (key.KeyType() != kDataType_Numeric)
+				return end();
+			else if (key.Key().num < 0)
+				return begin();
+
+			double next = floor(key.Key().num) + 1;
+			return next < m_vector.size() ? iterator(this, (UInt32)next) : end();
+		}
+	case kStorage_Hash:
+		{
+			Sort();
+			UInt32 lo = 0;
+			UInt32 hi = m_sorted.size();
+			while (lo < hi)
+			{
+				UInt32 mid = (lo + hi) / 2;
+				if (key < m_entries[m_sorted[mid]].first)
+					hi = mid;
+				else
+					lo = mid + 1;
+			}
+
+			return iterator(this, lo);
+		}
+	default:
+		return iterator(this, m_map.upper_bound(key));
+	}
+}
+
+ArrayVarElementContainer::iterator ArrayVarElementContainer::erase(iterator iter)
+{
+	switch (m_storage)
+	{
+	case kStorage_Vector:
+		// elements above shift down, so the next element takes the erased one's index
+		m_vector.erase(m_vector.begin() + iter.m_index);
+		Modified();
+		return iterator(this, iter.m_index);
+	case kStorage_Hash:
+		{
+			// the sorted index stays valid so iteration can continue from the same position
+			EraseEntry(iter.m_index);
+			Modified();
+			return iterator(this, iter.m_index);
+		}
+	default:
+		Modified();
+		return iterator(this, m_map.erase(iter.m_mapIter));
+	}
+}
+
+void ArrayVarElementContainer::clear()
+{
+	m_map.clear();
+	m_vector.clear();
+	m_entries.clear();
+	m_slots.clear();
+	m_sorted.clear();
+	m_numSorted = 0;
+	Modified();
+}
+
+ArrayElement* ArrayVarElementContainer::Lookup(const ArrayKey& key)
+{
+	if (m_storage != kStorage_Hash)
+	{
+		iterator iter = find(key);
+		return iter != end() ? &iter.GetElement() : NULL;
+	}
+
+	if (key.KeyType() != kDataType_String || m_slots.empty())
+		return NULL;
+
+	UInt32 slot = FindSlot(key);
+	return m_slots[slot] ? &m_entries[m_slots[slot] - 1].second : NULL;
+}
+
+ArrayElement& ArrayVarElementContainer::operator[](const ArrayKey& key)
+{
+	switch (m_storage)
+	{
+	case kStorage_Vector:
+		{
+			// ArrayVar::Get() only creates whole, non-negative keys no greater than size(), anything else would alias element 0
+			UInt32 idx = 0;
+			bool bIsIndex = GetIndex(key, &idx);
+			ASSERT(bIsIndex && idx <= m_vector.size());
+
+			if (idx == m_vector.size())
+			{
+				m_vector.push_back(ArrayElement());
+				Modified();
+			}
+
+			return m_vector[idx];
+		}
+	case kStorage_Hash:
+		{
+			ArrayElement* existing = Lookup(key);
+			if (existing)
+				return *existing;
+
+			// keep the load factor at or below 1/2
+			if ((m_entries.size() + 1) * 2 > m_slots.size())
+				Rehash(m_slots.empty() ? 16 : m_slots.size() * 2);
+
+			m_slots[FindSlot(key)] = m_entries.size() + 1;
+			m_sorted.push_back(m_entries.size());
+			m_entries.push_back(_Entry(key, ArrayElement()));
+			Modified();
+			return m_entries.back().second;
+		}
+	default:
+		{
+			_ElementMap::iterator iter = m_map.lower_bound(key);
+			if (iter == m_map.end() || key < iter->first)
+			{
+				iter = m_map.insert(iter, _ElementMap::value_type(key, ArrayElement()));
+				Modified();
+			}
+
+			return iter->second;
+		}
+	}
+}
+
+void ArrayVarElementContainer::InsertAt(UInt32 index, UInt32 count, const ArrayElement& fill)
+{
+	ASSERT(IsVector() && index <= m_vector.size());
+	m_vector.insert(m_vector.begin() + index, count, fill);
+	Modified();
+}
+
+void ArrayVarElementContainer::EraseAt(UInt32 index, UInt32 count)
+{
+	ASSERT(IsVector() && index + count <= m_vector.size());
+	m_vector.erase(m_vector.begin() + index, m_vector.begin() + index + count);
+	Modified();
+}
+
+void ArrayVarElementContainer::UnsetAll()
+{
+	for (_ElementMap::iterator iter = m_map.begin(); iter != m_map.end(); ++iter)
+		iter->second.Unset();
+	for (_ElementVector::iterator iter = m_vector.begin(); iter != m_vector.end(); ++iter)
+		iter->Unset();
+	for (_EntryVector::iterator iter = m_entries.begin(); iter != m_entries.end(); ++iter)
+		iter->second.Unset();
+}
+
+void ArrayVarElementContainer::reserve(UInt32 count)
+{
+	if (m_storage == kStorage_Vector)
+		m_vector.reserve(count);
+	else if (m_storage == kStorage_Hash)
+	{
+		m_entries.reserve(count);
+		m_sorted.reserve(count);
+		if (count * 2 > m_slots.size())
+			Rehash(count * 2);
+	}
+}
+
+void ArrayVarElementContainer::GetArrayIDs(std::vector<ArrayID>& out) const
+{
+	for (_ElementMap::const_iterator iter = m_map.begin(); iter != m_map.end(); ++iter)
+	{
+		if (iter->second.DataType() == kDataType_Array && iter->second.m_data.num)
+			out.push_back(iter->second.m_data.num);
+	}
+
+	for (_ElementVector::const_iterator iter = m_vector.begin(); iter != m_vector.end(); ++iter)
+	{
+		if (iter->DataType() == kDataType_Array && iter->m_data.num)
+			out.push_back(iter->m_data.num);
+	}
+
+	for (_EntryVector::const_iterator iter = m_entries.begin(); iter != m_entries.end(); ++iter)
+	{
+		if (iter->second.DataType() == kDataType_Array && iter->second.m_data.num)
+			out.push_back(iter->second.m_data.num);
+	}
+}
+
+bool ArrayVarElementContainer::Contains(const ArrayElement* elem) const
+{
+	const void* p = elem;
+	if (m_storage == kStorage_Vector)
+		return !m_vector.empty() && p >= &m_vector.front() && p < &m_vector.front() + m_vector.size();
+	else if (m_storage == kStorage_Hash)
+		return !m_entries.empty() && p >= &m_entries.front() && p < &m_entries.front() + m_entries.size();
+
+	return false;
+}
+
+//////////////////
+// ArrayRefCounts
+/////////////////
+
+void ArrayRefCounts::Add(UInt8 modIndex, UInt32 count)
+{
+	m_total += count;
+	for (UInt32 i = 0; i < m_entries.size(); i++)
+	{
+		if (m_entries[i].modIndex == modIndex)
+		{
+			m_entries[i].count += count;
+			return;
+		}
+	}
+
+	Entry entry = { modIndex, count };
+	m_entries.push_back(entry);
+}
+
+bool ArrayRefCounts::Remove(UInt8 modIndex)
+{
+	for (UInt32 i = 0; i < m_entries.size(); i++)
+	{
+		if (m_entries[i].modIndex == modIndex)
+		{
+			m_total--;
+			if (!--m_entries[i].count)
+			{
+				m_entries[i] = m_entries.back();
+				m_entries.pop_back();
+			}
+
+			return true;
+		}
+	}
+
+	return false;
+}
+
 ///////////////////////
 // ArrayVar
 //////////////////////
 
 
+static ArrayVarElementContainer::StorageType StorageTypeFor(UInt32 keyType, bool bPacked)
+{
+	if (keyType == kDataType_String)
+		return bPacked ? ArrayVarElementContainer::kStorage_Map : ArrayVarElementContainer::kStorage_Hash;
+	else
+		return bPacked ? ArrayVarElementContainer::kStorage_Vector : ArrayVarElementContainer::kStorage_Map;
+}
+
 ArrayVar::ArrayVar(UInt8 modIndex)
-	: m_ID(0), m_keyType(kDataType_Invalid), m_bPacked(false), m_owningModIndex(modIndex)
+	: m_elements(ArrayVarElementContainer::kStorage_Map), m_ID(0), m_keyType(kDataType_Invalid), m_bPacked(false), m_owningModIndex(modIndex),
+	  m_gcMark(0), m_gcCountCycle(0), m_gcInternalRefs(0), m_bGarbage(false)
 {
 	//
 }
 
 ArrayVar::ArrayVar(UInt32 _keyType, bool _packed, UInt8 modIndex)
-	: m_ID(0), m_keyType(_keyType), m_bPacked(_packed), m_owningModIndex(modIndex)
+	: m_elements(StorageTypeFor(_keyType, _packed)), m_ID(0), m_keyType(_keyType), m_bPacked(_packed), m_owningModIndex(modIndex),
+	  m_gcMark(0), m_gcCountCycle(0), m_gcInternalRefs(0), m_bGarbage(false)
 {
 	//
 }
@@ -312,13 +1054,7 @@ ArrayVar::ArrayVar(UInt32 _keyType, bool _packed, UInt8 modIndex)
 ArrayVar::~ArrayVar()
 {
 	// erase all elements. Important because doing so decrements refCounts of arrays stored within this array
-	for (ArrayIterator iter = m_elements.begin(); iter != m_elements.end(); ++iter)
-	{
-		ArrayKey key = iter->first;
-		ArrayElement* elem = Get(key, false);
-		if (elem)
-			elem->Unset();
-	}
+	m_elements.UnsetAll();
 }
 
 ArrayElement* ArrayVar::Get(ArrayKey key, bool bCanCreateNew)
@@ -332,9 +1068,9 @@ ArrayElement* ArrayVar::Get(ArrayKey key, bool bCanCreateNew)
 		key.SetNumericKey(intIdx);
 	}
 
-	_ElementMap::iterator it = m_elements.find(key);
-	if (it != m_elements.end()) {
-		return &it->second;
+	ArrayElement* elem = m_elements.Lookup(key);
+	if (elem) {
+		return elem;
 	}
 
 	if (bCanCreateNew)
@@ -343,7 +1079,8 @@ ArrayElement* ArrayVar::Get(ArrayKey key, bool bCanCreateNew)
 		{
 			if (!IsPacked() || (key.Key().num <= Size()))
 			{
-				// create a new, uninitialized element
+				// create a new, uninitialized element. The key is kept for the life of the element, so its string is pooled
+				key.Pool();
 				ArrayElement* newElem = &m_elements[key];
 				newElem->m_owningArray = m_ID;
 				return newElem;
@@ -356,10 +1093,21 @@ ArrayElement* ArrayVar::Get(ArrayKey key, bool bCanCreateNew)
 
 UInt32 ArrayVar::GetUnusedIndex()
 {
+	// packed arrays have no holes
+	if (m_elements.IsVector())
+		return Size();
+	else if (KeyType() != kDataType_Numeric)
+		return 0;
+
+	// keys are visited in increasing order, so a single pass finds the first hole
 	UInt32 id = 0;
-	while (m_elements.find(id) != m_elements.end())
+	for (ArrayIterator iter = m_elements.begin(); iter != m_elements.end(); ++iter)
 	{
-		id++;
+		double key = iter.GetKey().Key().num;
+		if (key == id)
+			id++;
+		else if (key > id)
+			break;
 	}
 
 	return id;
@@ -372,7 +1120,7 @@ void ArrayVar::Dump()
 	Console_Print("Refs: %d Owner %02X: %s", m_refs.size(), m_owningModIndex, owningModName);
 	_MESSAGE("Refs: %d Owner %02X: %s", m_refs.size(), m_owningModIndex, owningModName);
 
-	for (std::map<ArrayKey, ArrayElement>::iterator iter = m_elements.begin(); iter != m_elements.end(); ++iter)
+	for (ArrayIterator iter = m_elements.begin(); iter != m_elements.end(); ++iter)
 	{
 		char numBuf[0x50] = { 0 };
 		std::string elementInfo("[ ");
@@ -380,11 +1128,11 @@ void ArrayVar::Dump()
 		switch (KeyType())
 		{
 		case kDataType_Numeric:
-			sprintf_s(numBuf, sizeof(numBuf), "%f", iter->first.Key().num);
+			sprintf_s(numBuf, sizeof(numBuf), "%f", iter.GetKey().Key().num);
 			elementInfo += numBuf;
 			break;
 		case kDataType_String:
-			elementInfo += iter->first.Key().str;
+			elementInfo += iter.GetKey().Key().str->c_str();
 			break;
 		default:
 			elementInfo += "?Unknown Key Type?";
@@ -392,24 +1140,25 @@ void ArrayVar::Dump()
 
 		elementInfo += " ] : ";
 
-		switch (iter->second.m_dataType)
+		const ArrayElement& elem = iter.GetElement();
+		switch (elem.m_dataType)
 		{
 		case kDataType_Numeric:
-			sprintf_s(numBuf, sizeof(numBuf), "%f", iter->second.m_data.num);
+			sprintf_s(numBuf, sizeof(numBuf), "%f", elem.m_data.num);
 			elementInfo += numBuf;
 			break;
 		case kDataType_String:
-			elementInfo += iter->second.m_data.str;
+			elementInfo += elem.m_data.str->c_str();
 			break;
 		case kDataType_Array:
 			elementInfo += "(Array ID #";
-			sprintf_s(numBuf, sizeof(numBuf), "%.0f", iter->second.m_data.num);
+			sprintf_s(numBuf, sizeof(numBuf), "%.0f", elem.m_data.num);
 			elementInfo += numBuf;
 			elementInfo += ")";
 			break;
 		case kDataType_Form:
 			{
-				UInt32 refID = iter->second.m_data.formID;
+				UInt32 refID = elem.m_data.formID;
 				sprintf_s(numBuf, sizeof(numBuf), "%08X", refID);
 				TESForm* form = LookupFormByID(refID);
 				if (form)
@@ -433,7 +1182,8 @@ void ArrayVar::Dump()
 
 void ArrayVar::Pack()
 {
-	if (!IsPacked() || !Size())
+	// vector storage shifts elements down as they are erased
+	if (!IsPacked() || !Size() || m_elements.IsVector())
 		return;
 
 	// assume only one hole exists (i.e. we previously erased 0 or more contiguous elements)
@@ -443,11 +1193,11 @@ void ArrayVar::Pack()
 	ArrayIterator iter;
 	for (iter = m_elements.begin(); iter != m_elements.end(); )
 	{
-		if (!(iter->first == curIdx))
+		if (!(iter.GetKey() == curIdx))
 		{
 			ArrayElement* elem = Get(ArrayKey(curIdx), true);
-			elem->Set(iter->second);
-			iter->second.Unset();
+			elem->Set(iter.GetElement());
+			iter.GetElement().Unset();
 			ArrayIterator toDelete = iter;
 			++iter;
 			m_elements.erase(toDelete);
@@ -478,10 +1228,7 @@ void ArrayVarMap::Erase(ArrayID toErase)
 	if (var)
 	{
 		// delete any arrays contained in array
-		for (ArrayIterator iter = var->m_elements.begin(); iter != var->m_elements.end(); ++iter)
-		{
-			iter->second.Unset();
-		}
+		var->m_elements.UnsetAll();
 			
 		delete var;
 	}
@@ -500,12 +1247,13 @@ void ArrayVarMap::Add(ArrayVar* var, UInt32 varID, UInt32 numRefs, UInt8* refs)
 
 	VarMap::Insert(varID, var);
 	var->m_ID = varID;
+	var->m_gcMark = m_collectCycle;
 	if (!numRefs)		// nobody refers to this array, queue for deletion
 		MarkTemporary(varID, true);
 	else				// record references to this array
 	{
 		for (UInt32 i = 0; i < numRefs; i++)
-			var->m_refs.push_back(refs[i]);
+			var->m_refs.Add(refs[i]);
 	}
 }
 
@@ -514,8 +1262,10 @@ ArrayID	ArrayVarMap::Create(UInt32 keyType, bool bPacked, UInt8 modIndex)
 	ArrayVar* newVar = new ArrayVar(keyType, bPacked, modIndex);
 	ArrayID varID = GetUnusedID();
 	newVar->m_ID = varID;
+	newVar->m_gcMark = m_collectCycle;	// arrays created during a collection are treated as reachable
 	VarMap::Insert(varID, newVar);
 	MarkTemporary(varID, true);		// queue for deletion until a reference to this array is made
+	m_numCreatedSinceScan++;
 	return varID;
 }
 
@@ -528,21 +1278,21 @@ ArrayID ArrayVarMap::Copy(ArrayID from, UInt8 modIndex, bool bDeepCopy)
 	ArrayID copyID = Create(src->KeyType(), src->IsPacked(), modIndex);
 	for (ArrayIterator iter = src->m_elements.begin(); iter != src->m_elements.end(); ++iter)
 	{
-		if (iter->second.DataType() == kDataType_Array && bDeepCopy)
+		if (iter.GetElement().DataType() == kDataType_Array && bDeepCopy)
 		{
 			ArrayID innerID = 0;
 			ArrayID innerCopyID = 0;
-			if (iter->second.GetAsArray(&innerID))
+			if (iter.GetElement().GetAsArray(&innerID))
 				innerCopyID = Copy(innerID, modIndex, true);
 
-			if (!SetElementArray(copyID, iter->first, innerCopyID))
+			if (!SetElementArray(copyID, iter.GetKey(), innerCopyID))
 			{
 				DEBUG_PRINT("ArrayVarMap::Copy failed to make deep copy of inner array");
 			}
 		}
 		else
 		{
-			if (!SetElement(copyID, iter->first, iter->second))
+			if (!SetElement(copyID, iter.GetKey(), iter.GetElement()))
 			{
 				DEBUG_PRINT("ArrayVarMap::Copy failed to set element in copied array");
 			}
@@ -563,7 +1313,7 @@ void ArrayVarMap::AddReference(ArrayID* ref, ArrayID toRef, UInt8 referringModIn
 	ArrayVar* arr = Get(toRef);
 	if (arr)
 	{
-		arr->m_refs.push_back(referringModIndex);	// record reference, increment refcount
+		arr->m_refs.Add(referringModIndex);			// record reference, increment refcount
 		*ref = toRef;								// store ref'ed ArrayID in reference
 		MarkTemporary(toRef, false);
 	}
@@ -575,14 +1325,7 @@ void ArrayVarMap::RemoveReference(ArrayID* ref, UInt8 referringModIndex)
 	if (var)
 	{
 		// decrement refcount
-		for (std::vector<UInt8>::iterator iter = var->m_refs.begin(); iter != var->m_refs.end(); ++iter)
-		{
-			if (*iter == referringModIndex)
-			{
-				var->m_refs.erase(iter);
-				break;
-			}
-		}
+		var->m_refs.Remove(referringModIndex);
 	}
 
 	// if refcount is zero, queue for deletion
@@ -617,7 +1360,7 @@ ArrayID ArrayVarMap::MakeSlice(ArrayID src, const Slice* slice, UInt8 modIndex)
 	if (!srcVar)
 		return 0;
 	
-	std::map<ArrayKey, ArrayElement>::iterator start, end;
+	ArrayIterator start, end;
 	ArrayKey lo;
 	ArrayKey hi;
 
@@ -640,7 +1383,7 @@ ArrayID ArrayVarMap::MakeSlice(ArrayID src, const Slice* slice, UInt8 modIndex)
 
 	for (start = srcVar->m_elements.begin(); start != srcVar->m_elements.end(); ++start)
 	{
-		if (start->first >= lo)
+		if (start.GetKey() >= lo)
 			break;
 	}
 
@@ -648,13 +1391,13 @@ ArrayID ArrayVarMap::MakeSlice(ArrayID src, const Slice* slice, UInt8 modIndex)
 
 	for (end = start; end != srcVar->m_elements.end(); ++end)
 	{
-		if (end->first > hi)
+		if (end.GetKey() > hi)
 			break;
 
 		if (bPacked)
-			SetElement(newID, packedIndex++, end->second);
+			SetElement(newID, packedIndex++, end.GetElement());
 		else
-			SetElement(newID, end->first, end->second);
+			SetElement(newID, end.GetKey(), end.GetElement());
 	}
 
 	return newID;
@@ -692,9 +1435,9 @@ ArrayID ArrayVarMap::GetKeys(ArrayID id, UInt8 modIndex)
 	for (ArrayIterator iter = src->m_elements.begin(); iter != src->m_elements.end(); ++iter)
 	{
 		if (keysType == kDataType_Numeric)
-			SetElementNumber(keyArrID, curIdx, iter->first.Key().num);
+			SetElementNumber(keyArrID, curIdx, iter.GetKey().Key().num);
 		else
-			SetElementString(keyArrID, curIdx, iter->first.Key().str);
+			SetElementString(keyArrID, curIdx, iter.GetKey().Key().str->c_str());
 		curIdx++;
 	}
 
@@ -707,7 +1450,7 @@ bool ArrayVarMap::HasKey(ArrayID id, const ArrayKey& key)
 	if (!arr || arr->KeyType() != key.KeyType())
 		return false;
 
-	return (arr->m_elements.find(key) != arr->m_elements.end());
+	return arr->m_elements.Lookup(key) != NULL;
 }
 
 bool ArrayVarMap::AsVector(ArrayID id, std::vector<const ArrayElement*> &vecOut)
@@ -747,7 +1490,14 @@ bool ArrayVarMap::Insert(ArrayID id, UInt32 atIndex, const ArrayElement& toInser
 	if (!arr || !arr->IsPacked() || atIndex > arr->Size())
 		return false;
 	
-	if (atIndex < arr->Size())	
+	if (arr->m_elements.IsVector())
+	{
+		// shift higher elements up by one, they keep their references to any arrays they contain
+		ArrayElement blank;
+		blank.m_owningArray = id;
+		arr->m_elements.InsertAt(atIndex, 1, blank);
+	}
+	else if (atIndex < arr->Size())	
 	{
 		// shift higher elements up by one
 		for (SInt32 i = arr->Size(); i >= (SInt32)atIndex; i--)
@@ -768,6 +1518,26 @@ bool ArrayVarMap::Insert(ArrayID id, UInt32 atIndex, ArrayID rangeID)
 
 	UInt32 shiftDelta = src->Size();
 
+	if (dest->m_elements.IsVector())
+	{
+		// inserting an array into itself, take a copy before shifting
+		std::vector<ArrayElement> srcCopy;
+		if (src == dest)
+		{
+			for (ArrayIterator iter = src->m_elements.begin(); iter != src->m_elements.end(); ++iter)
+				srcCopy.push_back(iter.GetElement());
+		}
+
+		ArrayElement blank;
+		blank.m_owningArray = id;
+		dest->m_elements.InsertAt(atIndex, shiftDelta, blank);
+
+		for (UInt32 i = 0; i < shiftDelta; i++)
+			SetElement(id, ArrayKey(i + atIndex), src == dest ? srcCopy[i] : *src->Get(ArrayKey(i), false));
+
+		return true;
+	}
+
 	// resize, pad with empty elements
 	SetSize(id, dest->Size() + shiftDelta, ArrayElement());
 
@@ -782,116 +1552,385 @@ bool ArrayVarMap::Insert(ArrayID id, UInt32 atIndex, ArrayID rangeID)
 	for (UInt32 i = 0; i < shiftDelta; i++)
 		SetElement(id, ArrayKey(i + atIndex), src->m_elements[i]);
 
-	return true;
-}
+	return true;
+}
+
+// calls a function script either as a comparator taking two arrays (ar_CustomSort), or as a key function taking one
+// array (ar_SortByKey). Each argument is a packed array holding the element at index 0
+class SortFunctionCaller : public FunctionCaller
+{
+	Script			* m_comparator;
+	ArrayID			m_lhs;
+	ArrayID			m_rhs;
+	UInt32			m_numArgs;
+
+public:
+	SortFunctionCaller(Script* comparator, UInt32 numArgs) : m_comparator(comparator), m_lhs(0), m_rhs(0), m_numArgs(numArgs) { 
+		if (comparator) {
+			m_lhs = g_ArrayMap.Create(kDataType_Numeric, true, comparator->GetModIndex());
+			m_rhs = g_ArrayMap.Create(kDataType_Numeric, true, comparator->GetModIndex());
+		}
+	}
+
+	virtual ~SortFunctionCaller() { }
+
+	virtual UInt8 ReadCallerVersion() { return UserFunctionManager::kVersion; }
+	virtual Script * ReadScript() { return m_comparator; }
+	virtual bool PopulateArgs(ScriptEventList* eventList, FunctionInfo* info) {
+		DynamicParamInfo& dParams = info->ParamInfo();
+		UInt32 numParams = dParams.NumParams();
+		if (numParams != m_numArgs)
+			return false;
+
+		for (UInt32 i = 0; i < numParams; i++) {
+			UserFunctionParam* param = info->GetParam(i);
+			if (!param || param->varType != Script::eVarType_Array)
+				return false;
+
+			ScriptEventList::Var* var = eventList->GetVariable(param->varIdx);
+			if (!var) {
+				ShowRuntimeError(m_comparator, "Could not look up argument variable for function script");
+				return false;
+			}
+
+			g_ArrayMap.AddReference(&var->data, i ? m_rhs : m_lhs, m_comparator->GetModIndex());
+		}
+
+		return true;
+	}
+
+	virtual TESObjectREFR* ThisObj() { return NULL; }
+	virtual TESObjectREFR* ContainingObj() { return NULL; }
+
+	bool operator()(const ArrayElement& lhs, const ArrayElement& rhs) {
+		g_ArrayMap.SetElement(m_lhs, 0.0, lhs);
+		g_ArrayMap.SetElement(m_rhs, 0.0, rhs);
+		ScriptToken* result = UserFunctionManager::Call(*this);
+		bool bResult = result ? result->GetBool() : false;
+		delete result;
+		return bResult;
+	}
+
+	bool GetKey(const ArrayElement& elem, ArrayElement& keyOut) {
+		g_ArrayMap.SetElement(m_lhs, 0.0, elem);
+		ScriptToken* result = UserFunctionManager::Call(*this);
+		bool bResult = result ? BasicTokenToElem(result, keyOut, NULL) : false;
+		delete result;
+		return bResult;
+	}
+};
+
+// arrays with at least this many elements are sorted in chunks on worker threads, then merged
+static const UInt32 kParallelSortThreshold = 0x2000;
+static const UInt32 kMaxSortThreads = 8;
+
+// threads which sort chunks for ParallelSort, started on first use and kept for the lifetime of the process so that
+// a sort only costs a pair of event signals per chunk
+class SortWorkerPool
+{
+public:
+	typedef void (* TaskProc)(void * param);
+
+	enum { kMaxWorkers = kMaxSortThreads - 1 };
+
+	static SortWorkerPool* GetSingleton();
+
+	UInt32	NumWorkers() const	{ return m_numWorkers; }
+
+	// starts proc(params[i]) on a worker for each i < count (count <= NumWorkers()), Wait() must follow
+	// only one thread can use the pool at a time, returns false without starting anything if it is busy
+	bool	Start(TaskProc proc, void** params, UInt32 count);
+	void	Wait();
+
+private:
+	struct Worker
+	{
+		HANDLE		start;		// auto-reset, signalled by Run()
+		HANDLE		done;		// auto-reset, signalled by the worker
+		TaskProc	proc;
+		void		* param;
+	};
+
+	Worker				m_workers[kMaxWorkers];
+	UInt32				m_numWorkers;
+	UInt32				m_numStarted;
+	ICriticalSection	m_lock;
+
+	SortWorkerPool();
+
+	static DWORD WINAPI ThreadProc(void* param);
+};
+
+SortWorkerPool* SortWorkerPool::GetSingleton()
+{
+	static SortWorkerPool s_pool;
+	return &s_pool;
+}
+
+SortWorkerPool::SortWorkerPool() : m_numWorkers(0), m_numStarted(0)
+{
+	SYSTEM_INFO sysInfo;
+	GetSystemInfo(&sysInfo);
+	UInt32 numWorkers = sysInfo.dwNumberOfProcessors > 1 ? sysInfo.dwNumberOfProcessors - 1 : 0;
+	if (numWorkers > kMaxWorkers)
+		numWorkers = kMaxWorkers;
+
+	for (UInt32 i = 0; i < numWorkers; i++)
+	{
+		Worker& worker = m_workers[m_numWorkers];
+		worker.start = CreateEvent(NULL, FALSE, FALSE, NULL);
+		worker.done = CreateEvent(NULL, FALSE, FALSE, NULL);
+		worker.proc = NULL;
+		worker.param = NULL;
+
+		HANDLE thread = (worker.start && worker.done) ? CreateThread(NULL, 0, ThreadProc, &worker, 0, NULL) : NULL;
+		if (!thread)
+		{
+			if (worker.start)
+				CloseHandle(worker.start);
+			if (worker.done)
+				CloseHandle(worker.done);
+			break;
+		}
+
+		CloseHandle(thread);
+		m_numWorkers++;
+	}
+
+	_MESSAGE("Started %d array sort worker threads", m_numWorkers);
+}
+
+DWORD WINAPI SortWorkerPool::ThreadProc(void* param)
+{
+	Worker* worker = (Worker*)param;
+	while (WaitForSingleObject(worker->start, INFINITE) == WAIT_OBJECT_0)
+	{
+		worker->proc(worker->param);
+		SetEvent(worker->done);
+	}
+
+	return 0;
+}
+
+bool SortWorkerPool::Start(TaskProc proc, void** params, UInt32 count)
+{
+	if (!m_lock.TryEnter())
+		return false;
+
+	for (UInt32 i = 0; i < count; i++)
+	{
+		m_workers[i].proc = proc;
+		m_workers[i].param = params[i];
+		SetEvent(m_workers[i].start);
+	}
+
+	m_numStarted = count;
+	return true;
+}
+
+void SortWorkerPool::Wait()
+{
+	HANDLE done[kMaxWorkers];
+	for (UInt32 i = 0; i < m_numStarted; i++)
+		done[i] = m_workers[i].done;
+
+	if (m_numStarted)
+		WaitForMultipleObjects(m_numStarted, done, TRUE, INFINITE);
+
+	m_numStarted = 0;
+	m_lock.Leave();
+}
+
+template <typename T, typename Compare>
+struct SortChunk
+{
+	typedef typename std::vector<T>::iterator Iterator;
+
+	Iterator	begin;
+	Iterator	end;
+	Compare		comp;
+
+	SortChunk(Iterator _begin, Iterator _end, Compare _comp) : begin(_begin), end(_end), comp(_comp) { }
+
+	static void Run(void* param)
+	{
+		SortChunk* chunk = (SortChunk*)param;
+		std::sort(chunk->begin, chunk->end, chunk->comp);
+	}
+};
+
+// comp runs on worker threads so must not touch game or script state
+template <typename T, typename Compare>
+static void ParallelSort(std::vector<T>& vec, Compare comp)
+{
+	SortWorkerPool* pool = vec.size() >= kParallelSortThreshold ? SortWorkerPool::GetSingleton() : NULL;
+	UInt32 numChunks = pool ? pool->NumWorkers() + 1 : 1;
+	if (numChunks < 2)
+	{
+		std::sort(vec.begin(), vec.end(), comp);
+		return;
+	}
+
+	typedef SortChunk<T, Compare> Chunk;
+	std::vector<Chunk> chunks;
+	chunks.reserve(numChunks);
+	UInt32 chunkSize = vec.size() / numChunks;
+	for (UInt32 i = 0; i < numChunks; i++)
+	{
+		typename Chunk::Iterator end = (i == numChunks - 1) ? vec.end() : vec.begin() + (i + 1) * chunkSize;
+		chunks.push_back(Chunk(vec.begin() + i * chunkSize, end, comp));
+	}
+
+	// the first chunk is sorted on this thread while the workers sort the rest
+	void* params[SortWorkerPool::kMaxWorkers];
+	for (UInt32 i = 1; i < numChunks; i++)
+		params[i - 1] = &chunks[i];
 
-class SortFunctionCaller : public FunctionCaller
-{
-	Script			* m_comparator;
-	ArrayID			m_lhs;
-	ArrayID			m_rhs;
+	if (!pool->Start(Chunk::Run, params, numChunks - 1))
+	{
+		// pool in use by another thread
+		std::sort(vec.begin(), vec.end(), comp);
+		return;
+	}
 
-public:
-	SortFunctionCaller(Script* comparator) : m_comparator(comparator), m_lhs(0), m_rhs(0) { 
-		if (comparator) {
-			m_lhs = g_ArrayMap.Create(kDataType_Numeric, true, comparator->GetModIndex());
-			m_rhs = g_ArrayMap.Create(kDataType_Numeric, true, comparator->GetModIndex());
+	Chunk::Run(&chunks[0]);
+	pool->Wait();
+
+	// merge adjacent runs until one remains
+	for (UInt32 width = 1; width < numChunks; width *= 2)
+	{
+		for (UInt32 i = 0; i + width < numChunks; i += width * 2)
+		{
+			UInt32 last = (i + width * 2 < numChunks ? i + width * 2 : numChunks) - 1;
+			std::inplace_merge(chunks[i].begin, chunks[i + width].begin, chunks[last].end, comp);
 		}
 	}
+}
 
-	virtual ~SortFunctionCaller() { }
+struct ElementPtrLess
+{
+	bool operator()(const ArrayElement* lhs, const ArrayElement* rhs) const { return *lhs < *rhs; }
+};
 
-	virtual UInt8 ReadCallerVersion() { return UserFunctionManager::kVersion; }
-	virtual Script * ReadScript() { return m_comparator; }
-	virtual bool PopulateArgs(ScriptEventList* eventList, FunctionInfo* info) {
-		DynamicParamInfo& dParams = info->ParamInfo();
-		if (dParams.NumParams() == 2) {
-			UserFunctionParam* lhs = info->GetParam(0);
-			UserFunctionParam* rhs = info->GetParam(1);
-			if (lhs && rhs && lhs->varType == Script::eVarType_Array && rhs->varType == Script::eVarType_Array) {
-				ScriptEventList::Var* var = eventList->GetVariable(lhs->varIdx);
-				if (!var) {
-					ShowRuntimeError(m_comparator, "Could not look up argument variable for function script");
-					return false;
-				}
-				else {
-					g_ArrayMap.AddReference(&var->data, m_lhs, m_comparator->GetModIndex());
-				}
+// orders indexes into a list of precomputed sort keys
+template <typename T, typename Compare>
+struct SortKeyLess
+{
+	const std::vector<T>	* m_keys;
+	Compare					m_comp;
 
-				var = eventList->GetVariable(rhs->varIdx);
-				if (!var) {
-					ShowRuntimeError(m_comparator, "Could not look up argument variable for function script");
-					return false;
-				}
-				else {
-					g_ArrayMap.AddReference(&var->data, m_rhs, m_comparator->GetModIndex());
-				}
+	explicit SortKeyLess(const std::vector<T>& keys) : m_keys(&keys) { }
+	bool operator()(UInt32 lhs, UInt32 rhs) const { return m_comp((*m_keys)[lhs], (*m_keys)[rhs]); }
+};
 
-				return true;
-			}
-		}
+struct StringLess
+{
+	bool operator()(const std::string& lhs, const std::string& rhs) const { return _stricmp(lhs.c_str(), rhs.c_str()) < 0; }
+};
 
-		return false;
+ArrayID ArrayVarMap::CreateArray(const std::vector<const ArrayElement*>& elements, UInt8 modIndex)
+{
+	ArrayID id = Create(kDataType_Numeric, true, modIndex);
+	ArrayVar* var = Get(id);
+	var->m_elements.reserve(elements.size());
+	for (UInt32 i = 0; i < elements.size(); i++)
+	{
+		ArrayElement& elem = var->m_elements[ArrayKey(i)];
+		elem.m_owningArray = id;
+		elem.Set(*elements[i]);
 	}
 
-	virtual TESObjectREFR* ThisObj() { return NULL; }
-	virtual TESObjectREFR* ContainingObj() { return NULL; }
-
-	bool operator()(const ArrayElement& lhs, const ArrayElement& rhs) {
-		g_ArrayMap.SetElement(m_lhs, 0.0, lhs);
-		g_ArrayMap.SetElement(m_rhs, 0.0, rhs);
-		ScriptToken* result = UserFunctionManager::Call(*this);
-		bool bResult = result ? result->GetBool() : false;
-		delete result;
-		return bResult;
-	}
-};
+	return id;
+}
 
 ArrayID ArrayVarMap::Sort(ArrayID src, SortOrder order, SortType type, UInt8 modIndex, Script* comparator)
 {
 	// result is a packed integer-based array of the elements in sorted order
 	// if array cannot be sorted we return empty array
 	ArrayVar* srcVar = Get(src);
-	ArrayID result = Create(kDataType_Numeric, true, modIndex);
 	if (!srcVar || !srcVar->Size())
-		return result;
+		return Create(kDataType_Numeric, true, modIndex);
 
 	// restriction: all elements of src must be of the same type for default sort
 	// restriction not in effect for alpha sort (all values treated as strings) or custom sort (all values boxed as arrays)
-	std::vector<ArrayElement> vec;
 	ArrayIterator iter = srcVar->m_elements.begin();
-	UInt32 dataType = iter->second.DataType();
+	UInt32 dataType = iter.GetElement().DataType();
 	if (dataType == kDataType_Invalid || dataType == kDataType_Array)	// nonsensical to sort array of arrays
-		return result;
+		return Create(kDataType_Numeric, true, modIndex);
 
-	// copy elems to vec, verify all are of same type
+	// default and alpha sorts order pointers to the elements of src, nothing runs that could modify it
+	// a function script can modify src, so custom sorts work on copies
+	std::vector<const ArrayElement*> sorted;
+	sorted.reserve(srcVar->Size());
 	for ( ; iter != srcVar->m_elements.end(); ++iter)
 	{
-		if (type == kSortType_Default && iter->second.DataType() != dataType)
-			return result;
-		vec.push_back(iter->second);
+		if (type == kSortType_Default && iter.GetElement().DataType() != dataType)
+			return Create(kDataType_Numeric, true, modIndex);
+		sorted.push_back(&iter.GetElement());
 	}
 
-	// let STL do the sort
+	std::vector<ArrayElement> copies;
 	if (type == kSortType_Default)
-		std::sort(vec.begin(), vec.end());
+		ParallelSort(sorted, ElementPtrLess());
 	else if (type == kSortType_Alpha)
-		std::sort(vec.begin(), vec.end(), ArrayElement::CompareAsString);
-	else if (type == kSortType_UserFunction) {
+	{
+		// form names are looked up here, once per element, so that the sort itself only compares strings
+		std::vector<std::string> strings;
+		std::vector<UInt32> indexes;
+		strings.reserve(sorted.size());
+		indexes.reserve(sorted.size());
+		for (UInt32 i = 0; i < sorted.size(); i++)
+		{
+			strings.push_back(sorted[i]->ToString());
+			indexes.push_back(i);
+		}
+
+		ParallelSort(indexes, SortKeyLess<std::string, StringLess>(strings));
+
+		std::vector<const ArrayElement*> unsorted;
+		unsorted.swap(sorted);
+		for (UInt32 i = 0; i < indexes.size(); i++)
+			sorted.push_back(unsorted[indexes[i]]);
+	}
+	else if (type == kSortType_UserFunction || type == kSortType_UserKeyFunction) {
 		if (!comparator) {
-			return result;
+			return Create(kDataType_Numeric, true, modIndex);
+		}
+
+		copies.reserve(sorted.size());
+		for (UInt32 i = 0; i < sorted.size(); i++)
+			copies.push_back(*sorted[i]);
+
+		SortFunctionCaller sorter(comparator, type == kSortType_UserKeyFunction ? 1 : 2);
+		if (type == kSortType_UserKeyFunction)
+		{
+			// script is called once per element to get its key, keys must all be numbers, strings or forms of the same type
+			std::vector<ArrayElement> keys(copies.size());
+			std::vector<UInt32> indexes;
+			indexes.reserve(copies.size());
+			for (UInt32 i = 0; i < copies.size(); i++)
+			{
+				if (!sorter.GetKey(copies[i], keys[i]) || keys[i].DataType() != keys[0].DataType() || keys[i].DataType() == kDataType_Array)
+					return Create(kDataType_Numeric, true, modIndex);
+				indexes.push_back(i);
+			}
+
+			std::sort(indexes.begin(), indexes.end(), SortKeyLess<ArrayElement, std::less<ArrayElement> >(keys));
+			for (UInt32 i = 0; i < indexes.size(); i++)
+				sorted[i] = &copies[indexes[i]];
+		}
+		else
+		{
+			std::sort(copies.begin(), copies.end(), sorter);
+			for (UInt32 i = 0; i < copies.size(); i++)
+				sorted[i] = &copies[i];
 		}
-		SortFunctionCaller sorter(comparator);
-		std::sort(vec.begin(), vec.end(), sorter);
 	}
 
 	if (order == kSort_Descending)
-		std::reverse(vec.begin(), vec.end());
-
-	for (UInt32 i = 0; i < vec.size(); i++)
-		SetElement(result, i, vec[i]);
+		std::reverse(sorted.begin(), sorted.end());
 
-	return result;
+	return CreateArray(sorted, modIndex);
 }
 
 UInt32 ArrayVarMap::EraseElements(ArrayID id, const ArrayKey& lo, const ArrayKey& hi)
@@ -900,17 +1939,39 @@ UInt32 ArrayVarMap::EraseElements(ArrayID id, const ArrayKey& lo, const ArrayKey
 	if (!var || lo.KeyType() != hi.KeyType() || lo.KeyType() != var->KeyType())
 		return -1;
 
+	UInt32 numErased = 0;
+
+	if (var->m_elements.IsVector())
+	{
+		// erase the whole numbers within [lo, hi] in one pass, elements above shift down
+		double first = ceil(lo.Key().num);
+		double last = floor(hi.Key().num);
+		if (first < 0)
+			first = 0;
+		if (last > (double)var->Size() - 1)
+			last = (double)var->Size() - 1;
+
+		if (first <= last)
+		{
+			numErased = last - first + 1;
+			for (UInt32 i = first; i <= (UInt32)last; i++)
+				var->Get(ArrayKey(i), false)->Unset();
+
+			var->m_elements.EraseAt(first, numErased);
+		}
+
+		return numErased;
+	}
+
 	// find first elem to erase
-	std::map<ArrayKey, ArrayElement>::iterator iter = var->m_elements.begin();
-	while (iter != var->m_elements.end() && iter->first < lo)
+	ArrayIterator iter = var->m_elements.begin();
+	while (iter != var->m_elements.end() && iter.GetKey() < lo)
 		++iter;
 
-	UInt32 numErased = 0;
-
 	// erase. if element is an arrayID, clean up that array
-	while (iter != var->m_elements.end() && iter->first <= hi)
+	while (iter != var->m_elements.end() && iter.GetKey() <= hi)
 	{
-		iter->second.Unset();
+		iter.GetElement().Unset();
 		iter = var->m_elements.erase(iter);
 		numErased++;
 	}
@@ -927,12 +1988,9 @@ UInt32 ArrayVarMap::EraseAllElements(ArrayID id)
 	UInt32 numErased = -1;
 	ArrayVar* var = Get(id);	
 	if (var) {
-		while (var->m_elements.begin() != var->m_elements.end())
-		{
-			var->m_elements.begin()->second.Unset();
-			var->m_elements.erase(var->m_elements.begin());
-			numErased++;
-		}
+		numErased += var->Size();
+		var->m_elements.UnsetAll();
+		var->m_elements.clear();
 	}
 
 	return numErased;
@@ -996,6 +2054,13 @@ bool ArrayVarMap::SetElement(ArrayID id, const ArrayKey& key, const ArrayElement
 	if (!arr)
 		return false;
 
+	// an element of a packed array moves when the array grows, copy it first
+	if (arr->m_elements.Contains(&val))
+	{
+		ArrayElement copy = val;
+		return SetElement(id, key, copy);
+	}
+
 	ArrayElement* elem = arr->Get(key, true);
 	if (!elem || !elem->Set(val))
 		return false;
@@ -1003,6 +2068,19 @@ bool ArrayVarMap::SetElement(ArrayID id, const ArrayKey& key, const ArrayElement
 	return true;
 }
 
+bool ArrayVarMap::SetElementFromKey(ArrayID id, const ArrayKey& key, const ArrayKey& val)
+{
+	ArrayVar* arr = Get(id);
+	if (!arr)
+		return false;
+
+	ArrayElement* elem = arr->Get(key, true);
+	if (!elem || !elem->SetFromKey(val))
+		return false;
+
+	return true;
+}
+
 bool ArrayVarMap::GetElementNumber(ArrayID id, const ArrayKey& key, double* out)
 {
 	ArrayVar* arr = Get(id);
@@ -1031,7 +2109,7 @@ bool ArrayVarMap::GetElementCString(ArrayID id, const ArrayKey& key, const char*
 		ArrayElement* elem = arr->Get(key, false);
 		if (elem && elem->DataType() == kDataType_String)
 		{
-			*out = elem->m_data.str.c_str();
+			*out = elem->m_data.str->c_str();
 			return true;
 		}
 	}
@@ -1128,8 +2206,8 @@ void ArrayVarMap::Save(OBSESerializationInterface* intfc)
 
 	intfc->OpenRecord('ARVS', kVersion);
 
-	std::map<UInt32, ArrayVar*> & vars = m_state->vars;
-	for (std::map<UInt32, ArrayVar*>::iterator iter = vars.begin(); iter != vars.end(); ++iter)
+	_VarMap & vars = m_state->vars;
+	for (_VarMap::iterator iter = vars.begin(); iter != vars.end(); ++iter)
 	{
 		if (IsTemporary(iter->first))
 			continue;
@@ -1145,50 +2223,57 @@ void ArrayVarMap::Save(OBSESerializationInterface* intfc)
 		if (!numRefs)
 			_MESSAGE("ArrayVarMap::Save(): saving array with no references");
 
-		for (UInt32 i = 0; i < numRefs; i++)
-			intfc->WriteRecordData(&iter->second->m_refs[i], sizeof(UInt8));
+		// one modIndex per reference
+		const ArrayRefCounts& refs = iter->second->m_refs;
+		for (UInt32 i = 0; i < refs.NumMods(); i++)
+		{
+			UInt8 modIndex = refs.ModIndex(i);
+			for (UInt32 j = 0; j < refs.Count(i); j++)
+				intfc->WriteRecordData(&modIndex, sizeof(UInt8));
+		}
 
 		UInt32 numElements = iter->second->Size();
 		intfc->WriteRecordData(&numElements, sizeof(UInt32));
 
 		UInt8 keyType = iter->second->m_keyType;
-		for (std::map<ArrayKey, ArrayElement>::iterator elems = iter->second->m_elements.begin();
+		for (ArrayIterator elems = iter->second->m_elements.begin();
 			elems != iter->second->m_elements.end(); ++elems)
 		{
-			ArrayType key = elems->first.Key();
+			const ArrayType& key = elems.GetKey().Key();
+			const ArrayElement& elem = elems.GetElement();
 			if (keyType == kDataType_Numeric)
 				intfc->WriteRecordData(&key.num, sizeof(double));
 			else
 			{
-				UInt16 len = key.str.length();
+				UInt16 len = key.str->length();
 				intfc->WriteRecordData(&len, sizeof(len));
-				intfc->WriteRecordData(key.str.c_str(), key.str.length());
+				intfc->WriteRecordData(key.str->c_str(), key.str->length());
 			}
 
-			intfc->WriteRecordData(&elems->second.m_dataType, sizeof(UInt8));
-			switch (elems->second.m_dataType)
+			intfc->WriteRecordData(&elem.m_dataType, sizeof(UInt8));
+			switch (elem.m_dataType)
 			{
 			case kDataType_Numeric:
-				intfc->WriteRecordData(&elems->second.m_data.num, sizeof(double));
+				intfc->WriteRecordData(&elem.m_data.num, sizeof(double));
 				break;
 			case kDataType_String:
 				{
-					UInt16 len = elems->second.m_data.str.length();
+					UInt16 len = elem.m_data.str->length();
 					intfc->WriteRecordData(&len, sizeof(len));
-					intfc->WriteRecordData(elems->second.m_data.str.c_str(), elems->second.m_data.str.length());
+					intfc->WriteRecordData(elem.m_data.str->c_str(), elem.m_data.str->length());
 					break;
 				}
 			case kDataType_Array:
 				{
-					ArrayID id = elems->second.m_data.num;
+					ArrayID id = elem.m_data.num;
 					intfc->WriteRecordData(&id, sizeof(id));
 					break;
 				}
 			case kDataType_Form:
-				intfc->WriteRecordData(&elems->second.m_data.formID, sizeof(UInt32));
+				intfc->WriteRecordData(&elem.m_data.formID, sizeof(UInt32));
 				break;
 			default:
-				_MESSAGE("Error in ArrayVarMap::Save() - unhandled element type %d. Element not saved.", elems->second.m_dataType);
+				_MESSAGE("Error in ArrayVarMap::Save() - unhandled element type %d. Element not saved.", elem.m_dataType);
 			}
 		}
 	}
@@ -1289,6 +2374,13 @@ void ArrayVarMap::Load(OBSESerializationInterface* intfc)
 					continue;
 				}
 
+				if (!IsValidLoadedID(arrayID))
+				{
+					_MESSAGE("Array ID %d is out of range, the co-save may be corrupt. Discarding", arrayID);
+					delete[] refs;
+					continue;
+				}
+
 				// record gaps between IDs for easy lookup later in GetUnusedID()
 				lastIndexRead++;
 				while (lastIndexRead < arrayID)
@@ -1393,9 +2485,9 @@ bool ArrayVarMap::GetFirstElement(ArrayID id, ArrayElement* outElem, ArrayKey* o
 	if (!var || !var->Size() || !outElem || !outKey)
 		return false;
 
-	std::map<ArrayKey, ArrayElement>::iterator iter = var->m_elements.begin();
-	*outKey = iter->first;
-	*outElem = iter->second;
+	ArrayIterator iter = var->m_elements.begin();
+	*outKey = iter.GetKey();
+	*outElem = iter.GetElement();
 	return true;
 }
 
@@ -1411,8 +2503,8 @@ bool ArrayVarMap::GetLastElement(ArrayID id, ArrayElement* outElem, ArrayKey* ou
 	else		// only one element
 		iter= var->m_elements.begin();
 
-	*outKey = iter->first;
-	*outElem = iter->second;
+	*outKey = iter.GetKey();
+	*outElem = iter.GetElement();
 	return true;
 }
 
@@ -1422,7 +2514,7 @@ bool ArrayVarMap::GetNextElement(ArrayID id, ArrayKey* prevKey, ArrayElement* ou
 	if (!var || !var->Size() || !outElem || !outKey || !prevKey)
 		return false;
 
-	std::map<ArrayKey, ArrayElement>::iterator iter = var->m_elements.find(*prevKey);
+	ArrayIterator iter = var->m_elements.find(*prevKey);
 	if (iter != var->m_elements.end())
 	{
 		++iter;
@@ -1430,8 +2522,8 @@ bool ArrayVarMap::GetNextElement(ArrayID id, ArrayKey* prevKey, ArrayElement* ou
 		{
 			//var->m_cachedIterator = iter;
 
-			*outKey = iter->first;
-			*outElem = iter->second;
+			*outKey = iter.GetKey();
+			*outElem = iter.GetElement();
 			return true;
 		}
 	}
@@ -1449,14 +2541,52 @@ bool ArrayVarMap::GetPrevElement(ArrayID id, ArrayKey* prevKey, ArrayElement* ou
 	if (iter != var->m_elements.end() && iter != var->m_elements.begin())
 	{
 		--iter;
-		*outKey = iter->first;
-		*outElem = iter->second;
+		*outKey = iter.GetKey();
+		*outElem = iter.GetElement();
 		return true;
 	}
 
 	return false;
 }
 
+bool ArrayVarMap::BeginCursor(ArrayID id, ArrayCursor* cursor)
+{
+	ArrayVar* var = Get(id);
+	if (!var || !var->Size())
+		return false;
+
+	cursor->iter = var->m_elements.begin();
+	cursor->key = cursor->iter.GetKey();
+	cursor->version = var->m_elements.Version();
+	return true;
+}
+
+bool ArrayVarMap::AdvanceCursor(ArrayID id, ArrayCursor* cursor)
+{
+	ArrayVar* var = Get(id);
+	if (!var)
+		return false;
+
+	if (cursor->version == var->m_elements.Version())
+		++cursor->iter;
+	else
+	{
+		// the ID was freed and reused by an array with the other key type, keys can't be compared against it
+		if (cursor->key.KeyType() != var->KeyType())
+			return false;
+
+		// elements were added or removed (or the ID now belongs to another array), resume after the current key
+		cursor->iter = var->m_elements.upper_bound(cursor->key);
+		cursor->version = var->m_elements.Version();
+	}
+
+	if (cursor->iter == var->m_elements.end())
+		return false;
+
+	cursor->key = cursor->iter.GetKey();
+	return true;
+}
+
 ArrayKey ArrayVarMap::Find(ArrayID toSearch, const ArrayElement& toFind, const Slice* range)
 {
 	ArrayKey foundIndex;
@@ -1476,20 +2606,20 @@ ArrayKey ArrayVarMap::Find(ArrayID toSearch, const ArrayElement& toFind, const S
 		ArrayKey hi;
 		range->GetArrayBounds(lo, hi);
 
-		while (start != var->m_elements.end() && start->first < lo)
+		while (start != var->m_elements.end() && start.GetKey() < lo)
 			++start;
 
 		end = start;
-		while (end != var->m_elements.end() && end->first <= hi)
+		while (end != var->m_elements.end() && end.GetKey() <= hi)
 			++end;
 	}
 
 	// do the search
 	for (ArrayIterator iter = start; iter != end; ++iter)
 	{
-		if (iter->second.Equals(toFind))
+		if (iter.GetElement().Equals(toFind))
 		{
-			foundIndex = iter->first;
+			foundIndex = iter.GetKey();
 			break;
 		}
 	}
@@ -1515,15 +2645,294 @@ std::string ArrayVarMap::GetTypeString(ArrayID arr)
 void ArrayVarMap::Clean()		// garbage collection: delete unreferenced arrays
 {
 	// ArrayVar destructor may queue more IDs for deletion if deleted array contains other arrays
-	// so on each pass through the loop we delete the first ID in the queue until none remain
+	// DeleteTemporaries() keeps going until none remain
+
+	if (m_state) {
+		if (m_collectPhase != kCollect_Idle)
+			StepCollection(0);
+
+		StartCollection();
+		StepCollection(0);
+		DeleteTemporaries();
+	}
+}
 
+void ArrayVarMap::Collect(UInt32 budgetMicroseconds)
+{
+	// unreferenced arrays are deleted over as many frames as the budget requires
+	// cycles are looked for whenever the number of arrays has doubled since the last look, or as many arrays have
+	// been created since then as now exist, so cycles leaked at a steady rate are found too
+	// a collection in progress gets half the budget
 	if (m_state) {
-		while (m_state->tempVars.size())
+		if (m_collectPhase == kCollect_Idle) {
+			UInt32 numArrays = NumVars();
+			if (numArrays >= kMinArraysForCycleScan &&
+				(numArrays >= m_numArraysAtLastScan * 2 || m_numCreatedSinceScan >= numArrays))
+				StartCollection();
+		}
+
+		UInt32 deleteBudget = budgetMicroseconds;
+		if (m_collectPhase != kCollect_Idle) {
+			UInt32 collectBudget = budgetMicroseconds ? (budgetMicroseconds + 1) / 2 : 0;
+			StepCollection(collectBudget);
+			if (budgetMicroseconds)
+				deleteBudget = budgetMicroseconds > collectBudget ? budgetMicroseconds - collectBudget : 1;
+		}
+
+		DeleteTemporaries(deleteBudget);
+	}
+}
+
+void ArrayVarMap::StartCollection()
+{
+	if (!++m_collectCycle)
+		m_collectCycle = 1;
+
+	m_collectPhase = kCollect_Count;
+	m_collectState = m_state;
+	m_collectCursor = 0;
+	m_collectToVisit.clear();
+	m_collectGarbage.clear();
+
+	m_numArraysAtLastScan = NumVars();
+	m_numCreatedSinceScan = 0;
+}
+
+// Finds arrays only referred to by other unreachable arrays and releases the references they hold, after which they
+// are deleted as temporaries. Arrays referred to from outside of any array (script variables, plugins) and temporary
+// arrays are roots, anything not reachable from a root is garbage.
+// Each step handles one array so a collection can be spread over frames. Scripts run in between and may move
+// references around, so the unmarked arrays are verified before anything is released: an array is only garbage if
+// all its references come from other unmarked arrays, and nothing it is reachable from fails that test. Verifying
+// and releasing only touch the garbage, the steps proportional to the number of arrays are the resumable ones.
+bool ArrayVarMap::StepCollection(UInt32 budgetMicroseconds)
+{
+	static const UInt32 kStepsPerTimeCheck = 16;
+
+	if (m_collectState != m_state)
+	{
+		// vars were reloaded, the IDs gathered so far are meaningless
+		m_collectPhase = kCollect_Idle;
+		m_collectToVisit.clear();
+		m_collectGarbage.clear();
+	}
+
+	LARGE_INTEGER freq, start, now;
+	if (budgetMicroseconds)
+	{
+		QueryPerformanceFrequency(&freq);
+		QueryPerformanceCounter(&start);
+	}
+
+	_VarMap& vars = m_state->vars;
+	const UInt32 cycle = m_collectCycle;
+	UInt32 numSteps = 0;
+
+	while (m_collectPhase != kCollect_Idle)
+	{
+		if (budgetMicroseconds && !(++numSteps % kStepsPerTimeCheck))
+		{
+			QueryPerformanceCounter(&now);
+			if ((now.QuadPart - start.QuadPart) * 1000000 / freq.QuadPart >= budgetMicroseconds)
+				return false;
+		}
+
+		switch (m_collectPhase)
+		{
+		case kCollect_Count:
+			{
+				if (m_collectCursor > vars.MaxID())
+				{
+					m_collectPhase = kCollect_Roots;
+					m_collectCursor = 0;
+					break;
+				}
+
+				ArrayVar* arr = vars.Find(m_collectCursor++);
+				if (!arr)
+					break;
+
+				m_collectScratch.clear();
+				arr->m_elements.GetArrayIDs(m_collectScratch);
+				for (UInt32 i = 0; i < m_collectScratch.size(); i++)
+				{
+					ArrayVar* inner = vars.Find(m_collectScratch[i]);
+					if (inner)
+					{
+						if (inner->m_gcCountCycle != cycle)
+						{
+							inner->m_gcCountCycle = cycle;
+							inner->m_gcInternalRefs = 0;
+						}
+
+						inner->m_gcInternalRefs++;
+					}
+				}
+			}
+			break;
+		case kCollect_Roots:
+			{
+				if (m_collectCursor > vars.MaxID())
+				{
+					m_collectPhase = kCollect_Mark;
+					break;
+				}
+
+				ArrayID id = m_collectCursor++;
+				ArrayVar* arr = vars.Find(id);
+				if (!arr || arr->m_gcMark == cycle)
+					break;
+
+				UInt32 internalRefs = arr->m_gcCountCycle == cycle ? arr->m_gcInternalRefs : 0;
+				if (arr->m_refs.size() > internalRefs || IsTemporary(id))
+				{
+					arr->m_gcMark = cycle;
+					m_collectToVisit.push_back(id);
+				}
+			}
+			break;
+		case kCollect_Mark:
+			{
+				if (!m_collectToVisit.size())
+				{
+					m_collectPhase = kCollect_Gather;
+					m_collectCursor = 0;
+					break;
+				}
+
+				ArrayVar* arr = vars.Find(m_collectToVisit.back());
+				m_collectToVisit.pop_back();
+				if (!arr)
+					break;
+
+				m_collectScratch.clear();
+				arr->m_elements.GetArrayIDs(m_collectScratch);
+				for (UInt32 i = 0; i < m_collectScratch.size(); i++)
+				{
+					ArrayVar* inner = vars.Find(m_collectScratch[i]);
+					if (inner && inner->m_gcMark != cycle)
+					{
+						inner->m_gcMark = cycle;
+						m_collectToVisit.push_back(m_collectScratch[i]);
+					}
+				}
+			}
+			break;
+		case kCollect_Gather:
+			{
+				if (m_collectCursor > vars.MaxID())
+				{
+					VerifyGarbage();
+					m_collectPhase = kCollect_Release;
+					m_collectCursor = 0;
+					break;
+				}
+
+				ArrayID id = m_collectCursor++;
+				ArrayVar* arr = vars.Find(id);
+				if (arr && arr->m_gcMark != cycle)
+					m_collectGarbage.push_back(id);
+			}
+			break;
+		case kCollect_Release:
+			{
+				if (m_collectCursor >= m_collectGarbage.size())
+				{
+					if (m_collectGarbage.size())
+						_MESSAGE("ArrayVarMap::StepCollection() released %d unreachable arrays", m_collectGarbage.size());
+
+					m_collectGarbage.clear();
+					m_collectPhase = kCollect_Idle;
+					break;
+				}
+
+				// arrays whose last reference is released become temporary and may be deleted before their turn comes,
+				// their IDs are then either unused or belong to a new array which isn't flagged
+				ArrayVar* arr = vars.Find(m_collectGarbage[m_collectCursor++]);
+				if (arr && arr->m_bGarbage)
+				{
+					arr->m_bGarbage = false;
+					arr->m_elements.UnsetAll();
+				}
+			}
+			break;
+		}
+	}
+
+	return true;
+}
+
+void ArrayVarMap::VerifyGarbage()
+{
+	_VarMap& vars = m_state->vars;
+	const UInt32 cycle = m_collectCycle;
+
+	// drop arrays deleted since they were gathered, or whose IDs were reused by arrays created since
+	UInt32 numCandidates = 0;
+	for (UInt32 i = 0; i < m_collectGarbage.size(); i++)
+	{
+		ArrayVar* arr = vars.Find(m_collectGarbage[i]);
+		if (arr && arr->m_gcMark != cycle)
+		{
+			arr->m_bGarbage = true;
+			arr->m_gcInternalRefs = 0;
+			m_collectGarbage[numCandidates++] = m_collectGarbage[i];
+		}
+	}
+
+	m_collectGarbage.resize(numCandidates);
+
+	// count the references candidates hold to each other, as they are now
+	for (UInt32 i = 0; i < m_collectGarbage.size(); i++)
+	{
+		m_collectScratch.clear();
+		vars.Find(m_collectGarbage[i])->m_elements.GetArrayIDs(m_collectScratch);
+		for (UInt32 j = 0; j < m_collectScratch.size(); j++)
+		{
+			ArrayVar* inner = vars.Find(m_collectScratch[j]);
+			if (inner && inner->m_bGarbage)
+				inner->m_gcInternalRefs++;
+		}
+	}
+
+	// a candidate referred to from elsewhere is reachable, as is everything reachable from it
+	m_collectToVisit.clear();
+	for (UInt32 i = 0; i < m_collectGarbage.size(); i++)
+	{
+		ArrayVar* arr = vars.Find(m_collectGarbage[i]);
+		if (arr->m_refs.size() != arr->m_gcInternalRefs || IsTemporary(m_collectGarbage[i]))
+		{
+			arr->m_bGarbage = false;
+			m_collectToVisit.push_back(m_collectGarbage[i]);
+		}
+	}
+
+	while (m_collectToVisit.size())
+	{
+		ArrayVar* arr = vars.Find(m_collectToVisit.back());
+		m_collectToVisit.pop_back();
+
+		m_collectScratch.clear();
+		arr->m_elements.GetArrayIDs(m_collectScratch);
+		for (UInt32 i = 0; i < m_collectScratch.size(); i++)
 		{
-			UInt32 idToDelete = *(m_state->tempVars.begin());
-			Delete(idToDelete);
+			ArrayVar* inner = vars.Find(m_collectScratch[i]);
+			if (inner && inner->m_bGarbage)
+			{
+				inner->m_bGarbage = false;
+				m_collectToVisit.push_back(m_collectScratch[i]);
+			}
 		}
 	}
+
+	numCandidates = 0;
+	for (UInt32 i = 0; i < m_collectGarbage.size(); i++)
+	{
+		if (vars.Find(m_collectGarbage[i])->m_bGarbage)
+			m_collectGarbage[numCandidates++] = m_collectGarbage[i];
+	}
+
+	m_collectGarbage.resize(numCandidates);
 }
 
 namespace PluginAPI
@@ -1684,17 +3093,17 @@ namespace PluginAPI
 					if (keys) {
 						switch (keyType) {
 							case kDataType_Numeric:
-								keys[i] = iter->first.Key().num;
+								keys[i] = iter.GetKey().Key().num;
 								break;
 							case kDataType_String:
 								{
-									keys[i] = OBSEArrayVarInterface::Element(iter->first.Key().str.c_str());
+									keys[i] = OBSEArrayVarInterface::Element(iter.GetKey().Key().str->c_str());
 									break;
 								}
 						}
 					}
 					
-					InternalElemToPluginElem(iter->second, elements[i]);
+					InternalElemToPluginElem(iter.GetElement(), elements[i]);
 					i++;
 				}
 
@@ -15,7 +15,7 @@ struct ScriptToken;
 #include "GameAPI.h"
 #include <map>
 
-// OBSE array datatype, represented by std::map<ArrayKey, ArrayElement>
+// OBSE array datatype, a mapping of ArrayKey to ArrayElement (see ArrayVarElementContainer for storage)
 // Data elements can be of mixed types (string, UInt32/formID, float)
 // Keys can be doubles or strings
 // Can optionally be treated as vector (i.e. removal of an element shifts upper elements down)
@@ -63,19 +63,65 @@ enum
 	kDataType_Array,
 };
 
+// immutable, reference-counted string payload of elements and keys, shared between copies
+// strings obtained from Intern() are pooled: equal strings share one payload until the last reference is released
+// Create() is used for keys and values that don't outlive the expression being evaluated, only strings stored in an
+// array or a string var are pooled
+// Intern(), Pool() and Release() may be called from any thread
+class ArrayString
+{
+	volatile LONG	m_refCount;
+	UInt32			m_length;
+	UInt32			m_hash;			// pooled strings only
+	bool			m_bPooled;
+	char			m_data[1];
+
+	ArrayString();	// allocated by Create() only
+	ArrayString(const ArrayString& rhs);
+
+	friend class ArrayStringPool;
+public:
+	static ArrayString* Create(const char* str, UInt32 len);
+	static ArrayString* Create(const std::string& str)	{ return Create(str.c_str(), str.length()); }
+
+	// returns the pooled string equal to str, adding it to the pool if not present
+	static ArrayString* Intern(const char* str, UInt32 len);
+	static ArrayString* Intern(const std::string& str)	{ return Intern(str.c_str(), str.length()); }
+
+	// returns the pooled string equal to this one in exchange for the caller's reference
+	ArrayString *	Pool();
+
+	struct PoolStats
+	{
+		UInt32	numStrings;		// distinct strings in the pool
+		UInt32	numRefs;		// references held to them
+		UInt32	bytesUsed;		// size of the pooled strings
+		UInt32	bytesSaved;		// size of the copies the shared references would otherwise have made
+	};
+
+	static void		GetPoolStats(PoolStats* out);
+
+	ArrayString *	AddRef()		{ InterlockedIncrement(&m_refCount); return this; }
+	void			Release();
+
+	const char *	c_str() const	{ return m_data; }
+	UInt32			length() const	{ return m_length; }
+};
+
+// the active member is given by the owning element's data type or key's key type, str is never NULL for strings
 struct ArrayType {
 	union {
-		double		num;
-		UInt32		formID;
+		double			num;
+		UInt32			formID;
+		ArrayString		* str;
 	};
-
-	std::string		str;
 };
 
 struct ArrayElement
 {
-//	ArrayElement(const ArrayElement& copyFrom);
-//	ArrayElement& operator=(const ArrayElement& rhs);
+	ArrayElement(const ArrayElement& copyFrom);
+	ArrayElement& operator=(const ArrayElement& rhs);
+	~ArrayElement();
 
 	friend class ArrayVar;
 	friend class ArrayVarMap;
@@ -100,6 +146,7 @@ public:
 	bool SetArray(ArrayID arr, UInt8 modIndex);	
 	bool SetNumber(double num);
 	bool Set(const ArrayElement& elem);
+	bool SetFromKey(const ArrayKey& key);
 
 	ArrayElement();
 
@@ -116,16 +163,24 @@ struct ArrayKey
 private:
 	ArrayType	key;
 	UInt8		keyType;
+	UInt32		hash;		// case-insensitive hash of string keys
+
+	void		ReleaseString()	{	if (keyType == kDataType_String) key.str->Release();	}
 public:
 	ArrayKey();
 	ArrayKey(const std::string& _key);
 	ArrayKey(double _key);
 	ArrayKey(const char* _key);
+	ArrayKey(const ArrayKey& rhs);
+	ArrayKey& operator=(const ArrayKey& rhs);
+	~ArrayKey()			{	ReleaseString();	}
 
-	ArrayType	Key() const	{	return key;	}
+	const ArrayType&	Key() const	{	return key;	}
 	UInt8		KeyType() const { return keyType; }
-	void		SetNumericKey(double newVal)	{	keyType = kDataType_Numeric; key.num = newVal;	}
+	void		SetNumericKey(double newVal)	{	ReleaseString(); keyType = kDataType_Numeric; key.num = newVal;	}
 	bool		IsValid() const { return keyType != kDataType_Invalid;	}
+	UInt32		Hash() const { return hash; }
+	void		Pool()	{	if (keyType == kDataType_String) key.str = key.str->Pool();	}
 
 	bool operator<(const ArrayKey& rhs) const;
 	bool operator==(const ArrayKey& rhs) const;
@@ -134,7 +189,159 @@ public:
 	bool operator<=(const ArrayKey& rhs) const { return !(*this > rhs); }
 };
 
-typedef std::map<ArrayKey, ArrayElement>::iterator ArrayIterator;
+// Element storage for an ArrayVar
+// Packed arrays with numeric keys store their elements contiguously, the key being the index
+// String maps store their elements in an open-addressed hash table, ordered iteration goes through a sorted index
+// built on demand and discarded when keys are added or removed
+// Other maps use a std::map
+// The interface mirrors the subset of std::map used by ArrayVar; iterators expose GetKey() and GetElement()
+// Adding or removing elements changes Version(), which is unique across containers. Iterators obtained under an
+// older version must not be used
+class ArrayVarElementContainer
+{
+public:
+	enum StorageType
+	{
+		kStorage_Map,
+		kStorage_Vector,
+		kStorage_Hash,
+	};
+
+private:
+	typedef std::map<ArrayKey, ArrayElement>		_ElementMap;
+	typedef std::vector<ArrayElement>				_ElementVector;
+	typedef std::pair<ArrayKey, ArrayElement>		_Entry;
+	typedef std::vector<_Entry>						_EntryVector;
+
+	_ElementMap		m_map;
+	_ElementVector	m_vector;
+
+	// hash storage
+	_EntryVector		m_entries;		// in insertion order, erased entries are replaced by the last one
+	std::vector<UInt32>	m_slots;		// linear probing, index into m_entries + 1 (0 = empty)
+	std::vector<UInt32>	m_sorted;		// indexes into m_entries, the first m_numSorted in key order followed by those added since
+	UInt32				m_numSorted;
+
+	UInt8			m_storage;
+	UInt32			m_version;
+
+	static UInt32	s_nextVersion;
+
+	void			Modified()	{ m_version = s_nextVersion++; }
+
+	static bool GetIndex(const ArrayKey& key, UInt32* outIndex);	// true if key is a whole non-negative number
+
+	UInt32			FindSlot(const ArrayKey& key) const;
+	void			Rehash(UInt32 numSlots);
+	void			EraseEntry(UInt32 sortedIdx);
+	void			Sort();
+
+public:
+	class iterator
+	{
+		friend class ArrayVarElementContainer;
+
+		ArrayVarElementContainer	* m_container;
+		_ElementMap::iterator		m_mapIter;
+		UInt32						m_index;		// vector index or position in sorted index
+		ArrayKey					m_key;			// key of current element, vector only
+
+		iterator(ArrayVarElementContainer* container, _ElementMap::iterator mapIter)
+			: m_container(container), m_mapIter(mapIter), m_index(0) { }
+		iterator(ArrayVarElementContainer* container, UInt32 index)
+			: m_container(container), m_index(index) { if (container->m_storage == kStorage_Vector) m_key.SetNumericKey(index); }
+
+		_Entry&	GetEntry() const	{ return m_container->m_entries[m_container->m_sorted[m_index]]; }
+
+	public:
+		iterator() : m_container(NULL), m_index(0) { }
+
+		const ArrayKey&	GetKey() const;
+		ArrayElement&	GetElement() const;
+
+		iterator& operator++();
+		iterator& operator--();
+		bool operator==(const iterator& rhs) const	{ return m_container->m_storage == kStorage_Map ? m_mapIter == rhs.m_mapIter : m_index == rhs.m_index; }
+		bool operator!=(const iterator& rhs) const	{ return !(*this == rhs); }
+	};
+
+	explicit ArrayVarElementContainer(StorageType storage) : m_numSorted(0), m_storage(storage) { Modified(); }
+
+	bool			IsVector() const	{ return m_storage == kStorage_Vector; }
+	UInt32			Version() const		{ return m_version; }
+	UInt32			size() const;
+
+	iterator		begin();
+	iterator		end();
+	iterator		find(const ArrayKey& key);
+	iterator		upper_bound(const ArrayKey& key);		// first element with a key greater than key
+	iterator		erase(iterator iter);
+	void			clear();
+
+	// point lookup without ordering, returns NULL if key not found
+	ArrayElement*	Lookup(const ArrayKey& key);
+
+	// returns existing element or creates a new, uninitialized one. For vectors key must be <= size()
+	ArrayElement&	operator[](const ArrayKey& key);
+
+	// vector only: shift elements at and above index, inserting count copies of fill or erasing count elements
+	void			InsertAt(UInt32 index, UInt32 count, const ArrayElement& fill);
+	void			EraseAt(UInt32 index, UInt32 count);
+
+	// unsets every element in storage order, releasing references to arrays stored within
+	void			UnsetAll();
+
+	// appends the IDs of arrays stored in elements, in storage order
+	void			GetArrayIDs(std::vector<ArrayID>& out) const;
+
+	// preallocates storage for count elements
+	void			reserve(UInt32 count);
+
+	// true if elem is stored in contiguous storage, and therefore moved by any insertion
+	bool			Contains(const ArrayElement* elem) const;
+};
+
+typedef ArrayVarElementContainer::iterator ArrayIterator;
+
+// position of a ForEach loop within an array
+// iter is followed while the container's version is unchanged, after elements are added or removed the cursor
+// resumes at the first key greater than key. Iteration ends if the array's key type no longer matches key
+struct ArrayCursor
+{
+	ArrayIterator	iter;
+	ArrayKey		key;		// key of the current element
+	UInt32			version;	// container version iter belongs to
+
+	ArrayCursor() : version(0) { }
+
+	const ArrayKey&	GetKey() const		{ return key; }
+	ArrayElement&	GetElement() const	{ return iter.GetElement(); }
+};
+
+// references to an array, counted per referring mod
+// an array is rarely referred to by more than a couple of mods so each mod's count is found in near constant time
+class ArrayRefCounts
+{
+	struct Entry
+	{
+		UInt8	modIndex;
+		UInt32	count;
+	};
+
+	std::vector<Entry>	m_entries;
+	UInt32				m_total;
+
+public:
+	ArrayRefCounts() : m_total(0) { }
+
+	void	Add(UInt8 modIndex, UInt32 count = 1);
+	bool	Remove(UInt8 modIndex);			// false if modIndex holds no reference
+
+	UInt32	size() const					{ return m_total; }
+	UInt32	NumMods() const					{ return m_entries.size(); }
+	UInt8	ModIndex(UInt32 idx) const		{ return m_entries[idx].modIndex; }
+	UInt32	Count(UInt32 idx) const			{ return m_entries[idx].count; }
+};
 
 class ArrayVar
 {
@@ -142,13 +349,18 @@ class ArrayVar
 	friend class Matrix;
 	friend class PluginAPI::ArrayAPI;
 
-	typedef std::map<ArrayKey, ArrayElement> _ElementMap;
-	_ElementMap m_elements;
+	ArrayVarElementContainer m_elements;
 	ArrayID				m_ID;
 	UInt8				m_owningModIndex;
 	UInt8				m_keyType;
 	bool				m_bPacked;
-	std::vector<UInt8>	m_refs;		// data is modIndex of referring object; size() is number of references
+	ArrayRefCounts		m_refs;		// size() is number of references
+
+	// cycle collection state, see ArrayVarMap::StepCollection()
+	UInt32				m_gcMark;			// last collection which found this array reachable or during which it was created
+	UInt32				m_gcCountCycle;		// collection m_gcInternalRefs was counted for
+	UInt32				m_gcInternalRefs;	// references held by other arrays
+	bool				m_bGarbage;			// verified unreachable, not yet released
 
 	UInt32 GetUnusedIndex();
 
@@ -175,8 +387,40 @@ class ArrayVarMap : public VarMap<ArrayVar>
 	// this gets incremented whenever serialization format changes
 	static const UInt32 kVersion = 1;
 
+	// below this many arrays Collect() does not look for cycles
+	static const UInt32 kMinArraysForCycleScan = 0x100;
+
+	// phases of a collection of unreachable cycles, each resumable from m_collectCursor
+	enum CollectPhase
+	{
+		kCollect_Idle,
+		kCollect_Count,		// count references held by arrays to other arrays
+		kCollect_Roots,		// mark arrays referred to from outside any array, and temporary arrays
+		kCollect_Mark,		// mark arrays reachable from those
+		kCollect_Gather,	// list unmarked arrays, then verify them
+		kCollect_Release,	// release the references held by verified unreachable arrays
+	};
+
+	UInt32	m_numArraysAtLastScan;
+	UInt32	m_numCreatedSinceScan;
+
+	UInt8					m_collectPhase;
+	UInt32					m_collectCycle;
+	const State				* m_collectState;	// state the collection was started on, abandoned if vars are reloaded
+	UInt32					m_collectCursor;	// next array ID, or index into m_collectGarbage when releasing
+	std::vector<ArrayID>	m_collectToVisit;
+	std::vector<ArrayID>	m_collectGarbage;
+	std::vector<ArrayID>	m_collectScratch;
+
+	void	StartCollection();
+	bool	StepCollection(UInt32 budgetMicroseconds);		// returns true once the collection is complete
+	void	VerifyGarbage();
+
 	void Add(ArrayVar* var, UInt32 varID, UInt32 numRefs, UInt8* refs);
 public:
+	ArrayVarMap() : m_numArraysAtLastScan(0), m_numCreatedSinceScan(0), m_collectPhase(kCollect_Idle),
+		m_collectCycle(0), m_collectState(NULL), m_collectCursor(0) { }
+
 	enum SortOrder
 	{
 		kSort_Ascending,
@@ -188,16 +432,21 @@ public:
 		kSortType_Default,
 		kSortType_Alpha,
 		kSortType_UserFunction,
+		kSortType_UserKeyFunction,	// function script maps each element to a sort key
 	};
 
 	void Save(OBSESerializationInterface* intfc);
 	void Load(OBSESerializationInterface* intfc);
 	void Clean();
+	void Collect(UInt32 budgetMicroseconds);	// incremental Clean() for the main loop
 
 	ArrayID	Create(UInt32 keyType, bool bPacked, UInt8 modIndex);
 	ArrayID CreateArray(UInt8 modIndex) { return Create(kDataType_Numeric, true, modIndex); }
 	ArrayID CreateMap(UInt8 modIndex)	{ return Create(kDataType_Numeric, false, modIndex); }
 	ArrayID CreateStringMap(UInt8 modIndex)	{ return Create(kDataType_String, false, modIndex); }
+
+	// creates a packed array holding copies of elements, in order
+	ArrayID CreateArray(const std::vector<const ArrayElement*>& elements, UInt8 modIndex);
 	
 	// operations on ArrayVars
 	void    AddReference(ArrayID* ref, ArrayID toRef, UInt8 referringModIndex);
@@ -231,6 +480,7 @@ public:
 	bool SetElementFormID(ArrayID id, const ArrayKey& key, UInt32 refID);
 	bool SetElementArray(ArrayID id, const ArrayKey& key, ArrayID srcID);
 	bool SetElement(ArrayID id, const ArrayKey& key, const ArrayElement& val);
+	bool SetElementFromKey(ArrayID id, const ArrayKey& key, const ArrayKey& val);
 
 	bool GetElementNumber(ArrayID id, const ArrayKey& key, double* out);
 	bool GetElementString(ArrayID id, const ArrayKey& key, std::string& out);
@@ -245,6 +495,11 @@ public:
 	bool GetNextElement(ArrayID id, ArrayKey* prevKey, ArrayElement* outElem, ArrayKey* outKey);
 	bool GetPrevElement(ArrayID id, ArrayKey* prevKey, ArrayElement* outElem, ArrayKey* outKey);
 
+	// cursor iteration, a step costs O(1) unless elements were added or removed since the previous one
+	// the cursor's element is only valid until the array is next modified
+	bool BeginCursor(ArrayID id, ArrayCursor* cursor);
+	bool AdvanceCursor(ArrayID id, ArrayCursor* cursor);
+
 	UInt8 GetElementType(ArrayID id, const ArrayKey& key);
 };
 
@@ -0,0 +1,128 @@
+#include "CoSaveWriter.h"
+
+namespace Serialization
+{
+
+CoSaveWriter::CoSaveWriter()
+:m_pluginHeaderOffset(0), m_chunkOpen(false), m_chunkHeaderOffset(0)
+{
+	memset(&m_fileHeader, 0, sizeof(m_fileHeader));
+	memset(&m_pluginHeader, 0, sizeof(m_pluginHeader));
+	memset(&m_chunkHeader, 0, sizeof(m_chunkHeader));
+}
+
+void CoSaveWriter::Begin(UInt16 obseVersion, UInt16 obseMinorVersion, UInt32 oblivionVersion)
+{
+	m_buffer.clear();
+	m_buffer.reserve(kInitialSize);
+
+	m_fileHeader.signature =		Header::kSignature;
+	m_fileHeader.formatVersion =	Header::kVersion;
+	m_fileHeader.obseVersion =		obseVersion;
+	m_fileHeader.obseMinorVersion =	obseMinorVersion;
+	m_fileHeader.oblivionVersion =	oblivionVersion;
+	m_fileHeader.numPlugins =		0;
+
+	Reserve(sizeof(m_fileHeader));
+
+	m_chunkOpen = false;
+}
+
+void CoSaveWriter::BeginPlugin(UInt32 opcodeBase)
+{
+	m_pluginHeader.opcodeBase = opcodeBase;
+	m_pluginHeader.numChunks = 0;
+	m_pluginHeader.length = 0;
+
+	m_chunkOpen = false;
+}
+
+void CoSaveWriter::OpenChunk(UInt32 type, UInt32 version)
+{
+	if(!m_pluginHeader.numChunks)
+	{
+		ASSERT(!m_chunkOpen);
+
+		m_pluginHeaderOffset = Reserve(sizeof(m_pluginHeader));
+	}
+
+	FlushChunk();
+
+	m_chunkHeaderOffset = Reserve(sizeof(m_chunkHeader));
+
+	m_pluginHeader.numChunks++;
+
+	m_chunkHeader.type = type;
+	m_chunkHeader.version = version;
+	m_chunkHeader.length = 0;
+
+	m_chunkOpen = true;
+}
+
+void CoSaveWriter::WriteData(const void * buf, UInt32 length)
+{
+	if(length)
+		Patch(Reserve(length), buf, length);
+}
+
+void CoSaveWriter::EndPlugin(void)
+{
+	// flush the remaining chunk data
+	FlushChunk();
+
+	if(m_pluginHeader.numChunks)
+	{
+		Patch(m_pluginHeaderOffset, &m_pluginHeader, sizeof(m_pluginHeader));
+
+		m_fileHeader.numPlugins++;
+	}
+}
+
+void CoSaveWriter::End(void)
+{
+	Patch(0, &m_fileHeader, sizeof(m_fileHeader));
+}
+
+void CoSaveWriter::Trim(void)
+{
+	if(m_buffer.capacity() > kInitialSize * 16)
+		std::vector <UInt8>().swap(m_buffer);
+}
+
+// append length zeroed bytes to the buffer, returns their offset
+UInt32 CoSaveWriter::Reserve(UInt32 length)
+{
+	UInt32	offset = m_buffer.size();
+
+	m_buffer.resize(offset + length);
+
+	return offset;
+}
+
+void CoSaveWriter::Patch(UInt32 offset, const void * buf, UInt32 length)
+{
+	ASSERT(offset + length <= m_buffer.size());
+
+	memcpy(&m_buffer[offset], buf, length);
+}
+
+// flush a chunk header to the buffer if one is currently open
+void CoSaveWriter::FlushChunk(void)
+{
+	if(!m_chunkOpen)
+		return;
+
+	UInt32	chunkSize = m_buffer.size() - m_chunkHeaderOffset - sizeof(m_chunkHeader);
+
+	ASSERT(chunkSize < 0x80000000);	// stupidity check
+
+	m_chunkHeader.length = chunkSize;
+
+	Patch(m_chunkHeaderOffset, &m_chunkHeader, sizeof(m_chunkHeader));
+
+	m_pluginHeader.length += chunkSize + sizeof(m_chunkHeader);
+
+	m_chunkOpen = false;
+}
+
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <vector>
+
+namespace Serialization
+{
+
+// file format internals
+
+//	general format:
+//	Header			header
+//		PluginHeader	plugin[header.numPlugins]
+//			ChunkHeader		chunk[plugin.numChunks]
+//				UInt8			data[chunk.length]
+
+struct Header
+{
+	enum
+	{
+		kSignature =		MACRO_SWAP32('OBSE'),	// endian-swapping so the order matches
+		kVersion =			1,
+
+		kVersion_Invalid =	0
+	};
+
+	UInt32	signature;
+	UInt32	formatVersion;
+	UInt16	obseVersion;
+	UInt16	obseMinorVersion;
+	UInt32	oblivionVersion;
+	UInt32	numPlugins;
+};
+
+struct PluginHeader
+{
+	UInt32	opcodeBase;
+	UInt32	numChunks;
+	UInt32	length;		// length of following data including ChunkHeader
+};
+
+struct ChunkHeader
+{
+	UInt32	type;
+	UInt32	version;
+	UInt32	length;
+};
+
+// assembles a co-save in memory so it can be written with a single sequential write, headers are
+// patched in the buffer instead of seeking back through the file
+class CoSaveWriter
+{
+public:
+	CoSaveWriter();
+
+	// discards any previous contents and reserves space for the file header
+	void	Begin(UInt16 obseVersion, UInt16 obseMinorVersion, UInt32 oblivionVersion);
+
+	// the plugin header is only written once the plugin opens a chunk
+	void	BeginPlugin(UInt32 opcodeBase);
+	void	OpenChunk(UInt32 type, UInt32 version);
+	void	WriteData(const void * buf, UInt32 length);
+	void	EndPlugin(void);
+
+	// patches the file header, the buffer is complete afterwards
+	void	End(void);
+
+	const UInt8	* Data(void) const	{ return m_buffer.empty() ? NULL : &m_buffer[0]; }
+	UInt32		Size(void) const	{ return m_buffer.size(); }
+
+	// don't hold on to the memory of an unusually large save
+	void	Trim(void);
+
+private:
+	enum
+	{
+		kInitialSize =	0x40000,
+	};
+
+	UInt32	Reserve(UInt32 length);
+	void	Patch(UInt32 offset, const void * buf, UInt32 length);
+	void	FlushChunk(void);
+
+	std::vector <UInt8>	m_buffer;
+
+	Header			m_fileHeader;
+
+	UInt32			m_pluginHeaderOffset;
+	PluginHeader	m_pluginHeader;
+
+	bool			m_chunkOpen;
+	UInt32			m_chunkHeaderOffset;
+	ChunkHeader		m_chunkHeader;
+};
+
+}
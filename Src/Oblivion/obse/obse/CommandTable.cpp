@@ -505,7 +505,7 @@ bool Cmd_Default_Parse(UInt32 numParams, ParamInfo* paramInfo, ScriptLineBuffer*
 	return g_defaultParseCommand(numParams, paramInfo, lineBuf, scriptBuf);
 }
 
-CommandTable::CommandTable()
+CommandTable::CommandTable() : m_nameIndexDirty(true), m_dispatchCount(0), m_lastFrameDispatchCount(0)
 {
 	//
 }
@@ -3143,6 +3143,15 @@ void CommandTable::Init(void)
 
 	ADD_CMD(ToggleSkillPerk);
 
+	ADD_CMD(PrintStringPoolInfo);
+	ADD_CMD(PrintEventHandlerInfo);
+	ADD_CMD_RET(ar_SortByKey, kRetnType_Array);
+	ADD_CMD(SetVarCacheSize);
+	ADD_CMD(PrintVarCacheInfo);
+	ADD_CMD(PrintTokenPoolInfo);
+	ADD_CMD(PrintCommandDispatchInfo);
+	ADD_CMD(PrintDeferredEventInfo);
+
 	/* to add later if problems can be solved
 	g_scriptCommands.Add(&kCommandInfo_SetCurrentClimate); // too many problems
 	g_scriptCommands.Add(&kCommandInfo_SetWorldspaceClimate);
@@ -3238,12 +3247,9 @@ void CommandTable::Add(CommandInfo * info, CommandReturnType retnType, UInt32 pa
 	}
 
 	m_curID++;
+	m_nameIndexDirty = true;
 
-	// record return value if other than default
-	if (retnType != kRetnType_Default)
-		m_returnTypes[info->opcode] = retnType;
-	if(parentPluginOpcodeBase)
-		m_opcodesByPlugin[info->opcode] = parentPluginOpcodeBase;
+	SetMetadata(info->opcode, retnType, parentPluginOpcodeBase);
 }
 
 bool CommandTable::Replace(UInt32 opcodeToReplace, CommandInfo* replaceWith)
@@ -3254,6 +3260,7 @@ bool CommandTable::Replace(UInt32 opcodeToReplace, CommandInfo* replaceWith)
 		{
 			*iter = *replaceWith;
 			iter->opcode = opcodeToReplace;
+			m_nameIndexDirty = true;
 			return true;
 		}
 	}
@@ -3269,9 +3276,11 @@ void CommandTable::PadTo(UInt32 id, CommandInfo * info)
 	{
 		info->opcode = m_baseID + m_commands.size();
 		m_commands.push_back(*info);
+		SetMetadata(info->opcode, kRetnType_Default, 0);
 	}
 	
 	m_curID = id;
+	m_nameIndexDirty = true;
 }
 
 void CommandTable::Dump(void)
@@ -3313,18 +3322,94 @@ CommandInfo * CommandTable::GetEnd(void)
 	return &m_commands[0] + m_commands.size();
 }
 
+static UInt32 HashCommandName(const char * name)
+{
+	// FNV-1a over the lowercased name
+	UInt32	hash = 2166136261;
+	for(; *name; ++name)
+		hash = (hash ^ (UInt8)tolower((UInt8)*name)) * 16777619;
+
+	return hash;
+}
+
+static bool CommandHasName(const CommandInfo * info, const char * name)
+{
+	return !_stricmp(name, info->longName) || (info->shortName && !_stricmp(name, info->shortName));
+}
+
+// returns the slot holding the first command with a matching name, or the empty slot ending the probe sequence
+UInt32 CommandTable::FindNameSlot(const char * name)
+{
+	UInt32	mask = m_nameIndex.size() - 1;
+	UInt32	slot = HashCommandName(name) & mask;
+
+	while(m_nameIndex[slot] && !CommandHasName(&m_commands[m_nameIndex[slot] - 1], name))
+		slot = (slot + 1) & mask;
+
+	return slot;
+}
+
+void CommandTable::BuildNameIndex(void)
+{
+	UInt32	size = 64;
+	while(size < m_commands.size() * 4)	// up to two names per command, keep the load factor at or below 1/2
+		size <<= 1;
+
+	m_nameIndex.assign(size, 0);
+
+	// insert in table order and keep existing entries so the first command with a given name wins, as the linear search did
+	for(UInt32 i = 0; i < m_commands.size(); i++)
+	{
+		const CommandInfo	* info = &m_commands[i];
+		const char			* names[2] = { info->longName, info->shortName };
+
+		for(UInt32 j = 0; j < 2; j++)
+		{
+			if(names[j] && *names[j])
+			{
+				UInt32	slot = FindNameSlot(names[j]);
+				if(!m_nameIndex[slot])
+					m_nameIndex[slot] = i + 1;
+			}
+		}
+	}
+
+	m_nameIndexDirty = false;
+}
+
 CommandInfo * CommandTable::GetByName(const char * name)
 {
-	for(CommandList::iterator iter = m_commands.begin(); iter != m_commands.end(); ++iter)
-		if(!_stricmp(name, iter->longName) || (iter->shortName && !_stricmp(name, iter->shortName)))
-			return &(*iter);
+	if(!name)
+		return NULL;
 
-	return NULL;
+	if(!*name)
+	{
+		// empty names aren't indexed
+		for(CommandList::iterator iter = m_commands.begin(); iter != m_commands.end(); ++iter)
+			if(CommandHasName(&(*iter), name))
+				return &(*iter);
+
+		return NULL;
+	}
+
+	if(m_nameIndexDirty)
+		BuildNameIndex();
+
+	UInt32	slot = FindNameSlot(name);
+	return m_nameIndex[slot] ? &m_commands[m_nameIndex[slot] - 1] : NULL;
 }
 
 CommandInfo* CommandTable::GetByOpcode(UInt32 opcode)
 {
-	// could do binary search here but padding command has opcode 0
+	// commands are stored by opcode, including padding
+	if (opcode < m_baseID || opcode - m_baseID >= m_commands.size())
+		return NULL;
+
+	CommandInfo* info = &m_commands[opcode - m_baseID];
+	if (info->opcode == opcode)
+		return info;
+
+	// entry was modified outside of Add/PadTo/Replace
 	for (CommandList::iterator iter = m_commands.begin(); iter != m_commands.end(); ++iter)
 		if (iter->opcode == opcode)
 			return &(*iter);
@@ -3332,21 +3417,37 @@ CommandInfo* CommandTable::GetByOpcode(UInt32 opcode)
 	return NULL;
 }
 
-CommandReturnType CommandTable::GetReturnType(const CommandInfo* cmd)
+CommandTable::CommandMetadata * CommandTable::GetMetadata(UInt32 opcode)
 {
-	if (m_returnTypes.find(cmd->opcode) != m_returnTypes.end())
-		return m_returnTypes[cmd->opcode];
+	UInt32	idx = opcode - m_baseID;	// wraps for opcodes below the base
+	return idx < m_metadata.size() ? &m_metadata[idx] : NULL;
+}
 
-	return kRetnType_Default;
+void CommandTable::SetMetadata(UInt32 opcode, CommandReturnType retnType, UInt32 parentPluginOpcodeBase)
+{
+	UInt32	idx = opcode - m_baseID;
+	if(idx >= m_metadata.size())
+		m_metadata.resize(idx + 1);
+
+	CommandMetadata	& metadata = m_metadata[idx];
+	metadata.returnType = retnType;
+	metadata.parentPlugin = parentPluginOpcodeBase;
+	metadata.requiredVersion = CalcRequiredOBSEVersion(opcode);
+}
+
+CommandReturnType CommandTable::GetReturnType(const CommandInfo* cmd)
+{
+	CommandMetadata* metadata = GetMetadata(cmd->opcode);
+	return metadata ? metadata->returnType : kRetnType_Default;
 }
 
 void CommandTable::SetReturnType(UInt32 opcode, CommandReturnType retnType)
 {
-	CommandInfo* cmdInfo = GetByOpcode(opcode);
-	if (!cmdInfo)
+	CommandMetadata* metadata = GetByOpcode(opcode) ? GetMetadata(opcode) : NULL;
+	if (!metadata)
 		_MESSAGE("CommandTable::SetReturnType() - cannot locate command with opcode %04X", opcode);
 	else
-		m_returnTypes[opcode] = retnType;
+		metadata->returnType = retnType;
 }
 
 void CommandTable::RecordReleaseVersion(void)
@@ -3354,22 +3455,21 @@ void CommandTable::RecordReleaseVersion(void)
 	m_opcodesByRelease.push_back(GetCurID());
 }
 
-UInt32 CommandTable::GetRequiredOBSEVersion(const CommandInfo* cmd)
+// releases are recorded before their commands are added, so this is final by the time a command is added
+UInt32 CommandTable::CalcRequiredOBSEVersion(UInt32 opcode)
 {
 	UInt32  ver = 0;
-	if (cmd) {
-		if (cmd->opcode < m_opcodesByRelease[0])	// vanilla cmd
-			ver = 0;
-		else if (cmd->opcode >= 0x2000)	// plugin cmd, we have no way of knowing
-			ver = -1;
-		else {
-			for (UInt32 i = 0; i < m_opcodesByRelease.size(); i++) {
-				if (cmd->opcode >= m_opcodesByRelease[i]) {
-					ver = i+8;
-				}
-				else {
-					break;
-				}
+	if (m_opcodesByRelease.empty() || opcode < m_opcodesByRelease[0])	// vanilla cmd
+		ver = 0;
+	else if (opcode >= 0x2000)	// plugin cmd, we have no way of knowing
+		ver = -1;
+	else {
+		for (UInt32 i = 0; i < m_opcodesByRelease.size(); i++) {
+			if (opcode >= m_opcodesByRelease[i]) {
+				ver = i+8;
+			}
+			else {
+				break;
 			}
 		}
 	}
@@ -3377,30 +3477,37 @@ UInt32 CommandTable::GetRequiredOBSEVersion(const CommandInfo* cmd)
 	return ver;
 }
 
+UInt32 CommandTable::GetRequiredOBSEVersion(const CommandInfo* cmd)
+{
+	UInt32  ver = 0;
+	if (cmd) {
+		CommandMetadata* metadata = GetMetadata(cmd->opcode);
+		ver = metadata ? metadata->requiredVersion : CalcRequiredOBSEVersion(cmd->opcode);
+	}
+
+	return ver;
+}
+
 void CommandTable::RemoveDisabledPlugins(void)
 {
-	for(OpcodeToPluginMap::iterator iter = m_opcodesByPlugin.begin(); iter != m_opcodesByPlugin.end();)
+	for(MetadataList::iterator iter = m_metadata.begin(); iter != m_metadata.end(); ++iter)
 	{
-		// we are removing items from the map, so update iter before moving on
-		OpcodeToPluginMap::iterator	cur = iter;
-		++iter;
-
 		// plugin failed to load but still registered some commands?
 		// realistically the game is going to go down hard if this happens anyway
-		if(g_pluginManager.LookupHandleFromBaseOpcode(cur->second) == kPluginHandle_Invalid)
+		if(iter->parentPlugin && g_pluginManager.LookupHandleFromBaseOpcode(iter->parentPlugin) == kPluginHandle_Invalid)
 		{
-			_MESSAGE("removing orphaned command %04X (parent %04X)", cur->first, cur->second);
-			m_opcodesByPlugin.erase(cur);
+			_MESSAGE("removing orphaned command %04X (parent %04X)", m_baseID + (iter - m_metadata.begin()), iter->parentPlugin);
+			iter->parentPlugin = 0;
 		}
 	}
 }
 
 PluginInfo * CommandTable::GetParentPlugin(const CommandInfo * cmd)
 {
-	OpcodeToPluginMap::iterator iter = m_opcodesByPlugin.find(cmd->opcode);
-	if(iter != m_opcodesByPlugin.end())
+	CommandMetadata	* metadata = GetMetadata(cmd->opcode);
+	if(metadata && metadata->parentPlugin)
 	{
-		PluginInfo	* info = g_pluginManager.GetInfoFromBase(iter->second);
+		PluginInfo	* info = g_pluginManager.GetInfoFromBase(metadata->parentPlugin);
 		if(info)
 			return info;
 	}
@@ -285,24 +285,47 @@ public:
 	UInt32				GetRequiredOBSEVersion(const CommandInfo * cmd);
 	PluginInfo *		GetParentPlugin(const CommandInfo * cmd);
 
+	// number of commands executed by ExpressionEvaluator, counted per frame
+	// expressions can be evaluated off the main thread, so the count is updated atomically
+	void				RecordDispatch(void)				{ InterlockedIncrement(&m_dispatchCount); }
+	void				EndFrame(void)						{ m_lastFrameDispatchCount = InterlockedExchange(&m_dispatchCount, 0); }
+	UInt32				GetLastFrameDispatchCount(void)		{ return m_lastFrameDispatchCount; }
+
 private:
-	typedef std::vector <CommandInfo>				CommandList;
-	typedef std::map <UInt32, CommandReturnType>	OpcodeReturnTypeMap;
-	typedef std::map <UInt32, UInt32>				OpcodeToPluginMap;
+	// per-opcode data, stored in parallel with m_commands
+	struct CommandMetadata
+	{
+		UInt32				parentPlugin;		// owning plugin opcode base, 0 if none
+		UInt32				requiredVersion;	// 0 for vanilla commands, -1 for plugin commands
+		CommandReturnType	returnType;
+	};
 
-	CommandList	m_commands;
+	typedef std::vector <CommandInfo>		CommandList;
+	typedef std::vector <CommandMetadata>	MetadataList;
+
+	CommandList		m_commands;
+	MetadataList	m_metadata;
 
 	UInt32		m_baseID;
 	UInt32		m_curID;
 
-	// todo: combine these in to a single struct
-	OpcodeReturnTypeMap	m_returnTypes;		// maps opcode to return type, only string/array-returning cmds included
-	OpcodeToPluginMap	m_opcodesByPlugin;	// maps opcode to owning plugin opcode base
+	volatile LONG	m_dispatchCount;
+	UInt32			m_lastFrameDispatchCount;
 
 	std::vector<UInt32>	m_opcodesByRelease;	// maps an OBSE major version # to opcode of first command added to that release, beginning with v0008
 
+	// open-addressed case-insensitive index of long and short names, each slot holds an index into m_commands + 1 (0 = empty)
+	// rebuilt on the first lookup after the table changes
+	std::vector<UInt32>	m_nameIndex;
+	bool				m_nameIndexDirty;
+
 	void	RecordReleaseVersion(void);
 	void	RemoveDisabledPlugins(void);
+	void	BuildNameIndex(void);
+	void	SetMetadata(UInt32 opcode, CommandReturnType retnType, UInt32 parentPluginOpcodeBase);
+	UInt32	CalcRequiredOBSEVersion(UInt32 opcode);
+	CommandMetadata *	GetMetadata(UInt32 opcode);
+	UInt32	FindNameSlot(const char * name);
 };
 
 extern CommandTable	g_consoleCommands;
@@ -7,6 +7,9 @@
 #if OBLIVION
 
 #include "GameAPI.h"
+#include "StringVar.h"
+
+static const UInt32 kMaxVarCacheSize = 0x40;		// caches are searched linearly
 
 static const double s_arrayErrorCodeNum = -99999;		// sigil return values for cmds returning array keys
 static std::string s_arrayErrorCodeStr = "";		// indicating invalid/non-existent key
@@ -285,9 +288,8 @@ static bool Cmd_ar_Sort_Execute(COMMAND_ARGS)
 	return true;
 }
 
-static bool Cmd_ar_CustomSort_Execute(COMMAND_ARGS)
+static bool SortWithFunction(COMMAND_ARGS, ArrayVarMap::SortType type)
 {
-	// user provides a function script to perform comparison
 	ArrayID sortedID = g_ArrayMap.Create(kDataType_Numeric, true, scriptObj->GetModIndex());
 
 	ExpressionEvaluator eval(PASS_COMMAND_ARGS);
@@ -301,7 +303,7 @@ static bool Cmd_ar_CustomSort_Execute(COMMAND_ARGS)
 		}
 
 		if (toSort && compare) {
-			sortedID = g_ArrayMap.Sort(toSort, order, ArrayVarMap::kSortType_UserFunction, scriptObj->GetModIndex(), compare);
+			sortedID = g_ArrayMap.Sort(toSort, order, type, scriptObj->GetModIndex(), compare);
 		}
 	}
 
@@ -309,6 +311,19 @@ static bool Cmd_ar_CustomSort_Execute(COMMAND_ARGS)
 	return true;
 }
 
+static bool Cmd_ar_CustomSort_Execute(COMMAND_ARGS)
+{
+	// user provides a function script taking two arrays and returning true if the first sorts before the second
+	return SortWithFunction(PASS_COMMAND_ARGS, ArrayVarMap::kSortType_UserFunction);
+}
+
+static bool Cmd_ar_SortByKey_Execute(COMMAND_ARGS)
+{
+	// user provides a function script taking one array and returning the element's sort key
+	// it is called once per element, keys must all be numbers, strings or forms
+	return SortWithFunction(PASS_COMMAND_ARGS, ArrayVarMap::kSortType_UserKeyFunction);
+}
+
 static bool Cmd_ar_SortAlpha_Execute(COMMAND_ARGS)
 {
 	// we return this empty array if something goes wrong
@@ -375,7 +390,7 @@ static bool Cmd_ar_Find_Execute(COMMAND_ARGS)
 		if (keyType == kDataType_Numeric)
 			*result = idx.Key().num;
 		else
-			*result = g_StringMap.Add(scriptObj->GetModIndex(), idx.Key().str.c_str(), true);
+			*result = g_StringMap.Add(scriptObj->GetModIndex(), idx.Key().str->c_str(), true);
 	}
 
 	return true;
@@ -456,7 +471,7 @@ static bool ArrayIterCommand(COMMAND_ARGS, eIterMode iterMode)
 				}
 
 				if (foundKey.IsValid())
-					keyStr = foundKey.Key().str;
+					keyStr = foundKey.Key().str->c_str();
 
 				AssignToStringVar(PASS_COMMAND_ARGS, keyStr.c_str());
 				return true;
@@ -755,6 +770,33 @@ static bool Cmd_ar_Range_Execute(COMMAND_ARGS)
 	return true;
 }
 
+static bool Cmd_SetVarCacheSize_Execute(COMMAND_ARGS)
+{
+	// number of recently used array and string vars looked up without a table access, 0 disables the caches
+	UInt32 size = 0;
+	if (ExtractArgs(PASS_EXTRACT_ARGS, &size))
+	{
+		if (size > kMaxVarCacheSize)
+			size = kMaxVarCacheSize;
+
+		g_ArrayMap.SetCacheSize(size);
+		g_StringMap.SetCacheSize(size);
+	}
+
+	*result = g_ArrayMap.GetCacheSize();
+	return true;
+}
+
+static bool Cmd_PrintVarCacheInfo_Execute(COMMAND_ARGS)
+{
+	Console_Print("Var cache: %d entries", g_ArrayMap.GetCacheSize());
+	Console_Print("Array vars: %d hits, %d misses", g_ArrayMap.GetCacheHits(), g_ArrayMap.GetCacheMisses());
+	Console_Print("String vars: %d hits, %d misses", g_StringMap.GetCacheHits(), g_StringMap.GetCacheMisses());
+
+	*result = g_ArrayMap.GetCacheHits() + g_StringMap.GetCacheHits();
+	return true;
+}
+
 #else
 #include "obse_editor\EditorAPI.h"
 #endif
@@ -810,6 +852,8 @@ CommandInfo kCommandInfo_ar_Dump =
 };
 
 DEFINE_COMMAND(ar_DumpID, dumps an array given an integer ID, 0, 1, kParams_OneInt);
+DEFINE_COMMAND(SetVarCacheSize, sets the number of recently used array and string vars cached, 0, 1, kParams_OneInt);
+DEFINE_COMMAND(PrintVarCacheInfo, prints the hit and miss counts of the array and string var caches, 0, 0, NULL);
 
 
 static ParamInfo kParams_ar_Erase[] =
@@ -851,6 +895,13 @@ static ParamInfo kOBSEParams_ar_CustomSort[] =
 	{	"bDescending",	kOBSEParamType_Number,	1	},
 };
 
+static ParamInfo kOBSEParams_ar_SortByKey[] =
+{
+	{	"array",		kOBSEParamType_Array,	0	},
+	{	"keyFunction",	kOBSEParamType_Form,	0	},
+	{	"bDescending",	kOBSEParamType_Number,	1	},
+};
+
 CommandInfo kCommandInfo_ar_Sort =
 {
 	"ar_Sort",
@@ -876,6 +927,16 @@ CommandInfo kCommandInfo_ar_CustomSort =
 	NULL, 0
 };
 
+CommandInfo kCommandInfo_ar_SortByKey =
+{
+	"ar_SortByKey", "", 0,
+	"returns an array containing the source array's elements sorted by the keys the passed function script returns for them",
+	0, 3, kOBSEParams_ar_SortByKey,
+	HANDLER(Cmd_ar_SortByKey_Execute),
+	Cmd_Expression_Parse,
+	NULL, 0
+};
+
 CommandInfo kCommandInfo_ar_SortAlpha =
 {
 	"ar_SortAlpha",
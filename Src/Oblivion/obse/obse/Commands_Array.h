@@ -36,4 +36,8 @@ extern CommandInfo kCommandInfo_ar_Map;
 
 extern CommandInfo kCommandInfo_ar_Append;
 
-extern CommandInfo kCommandInfo_ar_CustomSort;
\ No newline at end of file
+extern CommandInfo kCommandInfo_ar_CustomSort;
+extern CommandInfo kCommandInfo_ar_SortByKey;
+
+extern CommandInfo kCommandInfo_SetVarCacheSize;
+extern CommandInfo kCommandInfo_PrintVarCacheInfo;
\ No newline at end of file
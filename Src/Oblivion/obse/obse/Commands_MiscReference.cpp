@@ -11,6 +11,7 @@
 #include "GameTasks.h"
 #include <set>
 #include <map>
+#include <algorithm>
 #include "InternalSerialization.h"
 #include "Hooks_Script.h"
 #include "Hooks_Gameplay.h"
@@ -476,7 +477,10 @@ static bool Cmd_SetDoorTeleport_Execute(COMMAND_ARGS)
 
 struct CellScanInfo
 {
-	const	TESObjectCELL::ObjectListEntry *	prev;	//last ref returned to script
+	TESObjectREFR	* prev;								//last ref returned to script
+	TESObjectREFR	* next;								//candidate following prev when it was returned, to resume from if prev is destroyed
+	UInt32	pos;										//position in curCell's candidate list
+	UInt32	indexVersion;								//version of curCell's index pos refers to, 0 on entering a cell
 	const	TESObjectCELL * curCell;					//cell currently being scanned
 	const	TESObjectCELL * cell;						//player's current cell
 	const	TESWorldSpace * world;
@@ -490,7 +494,7 @@ struct CellScanInfo
 	{	}
 
 	CellScanInfo(UInt8 _cellDepth, UInt8 _formType, bool _includeTaken, TESObjectCELL* _cell) 
-					:	cellDepth(_cellDepth), formType(_formType), includeTakenRefs(_includeTaken), prev(NULL), cell(_cell)
+					:	cellDepth(_cellDepth), formType(_formType), includeTakenRefs(_includeTaken), prev(NULL), next(NULL), pos(0), indexVersion(0), cell(_cell)
 	{
 		world = cell->worldSpace;
 
@@ -730,29 +734,186 @@ public:
 	}
 };
 
-static const TESObjectCELL::ObjectListEntry* GetCellRefEntry(CellListVisitor visitor, UInt32 formType, const TESObjectCELL::ObjectListEntry* prev, bool includeTaken, ProjectileFinder* projFinder = NULL)
+static bool AcceptRef(UInt32 formType, const TESObjectREFR* refr, bool includeTaken, ProjectileFinder* projFinder = NULL)
 {
-	const TESObjectCELL::ObjectListEntry* entry = NULL;
 	switch(formType)
 	{
 	case 0:		//Any type
-		entry = visitor.Find(RefMatcherAnyForm(includeTaken), prev);
-		break;
+		return RefMatcherAnyForm(includeTaken).Accept(refr);
 	case 69:	//Actor
-		entry = visitor.Find(RefMatcherActor(), prev);
-		break;
+		return RefMatcherActor().Accept(refr);
 	case 70:	//Inventory Item
-		entry = visitor.Find(RefMatcherItem(includeTaken), prev);
-		break;
+		return RefMatcherItem(includeTaken).Accept(refr);
 	case 71:	//Owned Projectile
-		if (projFinder)
-			entry = visitor.Find(*projFinder, prev);
-		break;
+		return projFinder ? projFinder->Accept(refr) : false;
 	default:
-		entry = visitor.Find(RefMatcherFormType(formType, includeTaken), prev);
+		return RefMatcherFormType(formType, includeTaken).Accept(refr);
+	}
+}
+
+// Refs in a cell bucketed by base form type, so a scan for one type only visits refs of that type. Buckets keep the
+// order of the cell's object list.
+// The game gives no notice of refs being added to or removed from a cell, so the index is checked against the object
+// list - one pass comparing pointers, no form lookups - and rebuilt if they differ whenever a scan enters the cell or
+// GetNumRefs counts it. GetNextRef continues from the index as it was validated when the scan entered the cell
+class CellRefIndex
+{
+public:
+	typedef std::vector<TESObjectREFR*>	RefList;
+
+	CellRefIndex() : m_version(s_nextVersion++) { }
+
+	void			Update(const TESObjectCELL* cell);
+	const RefList&	Candidates(UInt32 formType) const;		// refs which may match formType as passed to GetFirstRef
+	UInt32			Version() const	{ return m_version; }	// changes whenever the index is rebuilt, never 0
+
+	static CellRefIndex& Get(const TESObjectCELL* cell, bool bUpdate);
+
+private:
+	enum
+	{
+		kNumFormTypes = kFormType_TOFT + 1,
+
+		// GetFirstRef's pseudo form types
+		kBucket_Any = kNumFormTypes,	// 0
+		kBucket_Actor,					// 69
+		kBucket_Item,					// 70
+
+		kBucket_Max
+	};
+
+	// indexes are cached in a direct-mapped table of this many slots, a cell evicts whichever cell shares its slot
+	enum { kNumCacheSlotsShift = 6 };
+
+	struct CacheSlot
+	{
+		const TESObjectCELL	* cell;		// NULL if unused
+		CellRefIndex		* index;
+
+		CacheSlot() : cell(NULL), index(NULL) { }
+	};
+
+	RefList			m_buckets[kBucket_Max];
+	std::vector<TESForm*>	m_baseForms;	// base form of each ref in m_buckets[kBucket_Any], in case a ref's memory is reused
+	UInt32			m_version;
+
+	static UInt32		s_nextVersion;
+	static CacheSlot	s_cache[1 << kNumCacheSlotsShift];
+
+	void			Rebuild(const TESObjectCELL* cell);
+};
+
+UInt32 CellRefIndex::s_nextVersion = 1;
+CellRefIndex::CacheSlot CellRefIndex::s_cache[1 << kNumCacheSlotsShift];
+
+CellRefIndex& CellRefIndex::Get(const TESObjectCELL* cell, bool bUpdate)
+{
+	// Fibonacci hash of the cell's address, low bits are alignment
+	CacheSlot& slot = s_cache[(((UInt32)cell >> 4) * 0x9E3779B9) >> (32 - kNumCacheSlotsShift)];
+	if (!slot.index)
+		slot.index = new CellRefIndex();
+
+	if (slot.cell != cell)
+	{
+		// reuse the evicted cell's buffers
+		slot.cell = cell;
+		slot.index->Rebuild(cell);
 	}
+	else if (bUpdate)
+		slot.index->Update(cell);
 
-	return entry;
+	return *slot.index;
+}
+
+void CellRefIndex::Update(const TESObjectCELL* cell)
+{
+	const RefList& refs = m_buckets[kBucket_Any];
+	UInt32 idx = 0;
+	for (const TESObjectCELL::ObjectListEntry* entry = &cell->objectList; entry; entry = entry->next)
+	{
+		if (!entry->refr)
+			continue;
+		else if (idx == refs.size() || refs[idx] != entry->refr || m_baseForms[idx] != entry->refr->baseForm)
+		{
+			Rebuild(cell);
+			return;
+		}
+
+		idx++;
+	}
+
+	if (idx != refs.size())
+		Rebuild(cell);
+}
+
+void CellRefIndex::Rebuild(const TESObjectCELL* cell)
+{
+	for (UInt32 i = 0; i < kBucket_Max; i++)
+		m_buckets[i].clear();
+
+	m_baseForms.clear();
+
+	for (const TESObjectCELL::ObjectListEntry* entry = &cell->objectList; entry; entry = entry->next)
+	{
+		TESObjectREFR* refr = entry->refr;
+		if (!refr)
+			continue;
+
+		m_buckets[kBucket_Any].push_back(refr);
+		m_baseForms.push_back(refr->baseForm);
+		if (!refr->baseForm)
+			continue;
+
+		UInt8 typeID = refr->baseForm->typeID;
+		if (typeID < kNumFormTypes)
+			m_buckets[typeID].push_back(refr);
+
+		switch (typeID)
+		{
+		case kFormType_NPC:
+		case kFormType_Creature:
+			m_buckets[kBucket_Actor].push_back(refr);
+			break;
+		case kFormType_Apparatus:
+		case kFormType_Armor:
+		case kFormType_Book:
+		case kFormType_Clothing:
+		case kFormType_Ingredient:
+		case kFormType_Misc:
+		case kFormType_Weapon:
+		case kFormType_Ammo:
+		case kFormType_SoulGem:
+		case kFormType_Key:
+		case kFormType_AlchemyItem:
+		case kFormType_SigilStone:
+		case kFormType_Light:		// if carriable
+			m_buckets[kBucket_Item].push_back(refr);
+			break;
+		}
+	}
+
+	m_version = s_nextVersion++;
+	if (!m_version)
+		m_version = s_nextVersion++;
+}
+
+const CellRefIndex::RefList& CellRefIndex::Candidates(UInt32 formType) const
+{
+	static const RefList s_empty;
+
+	switch (formType)
+	{
+	case 0:
+		return m_buckets[kBucket_Any];
+	case 69:
+		return m_buckets[kBucket_Actor];
+	case 70:
+		return m_buckets[kBucket_Item];
+	case 71:	// projectiles have an ammo base form
+		return m_buckets[kFormType_Ammo];
+	default:
+		return formType < kNumFormTypes ? m_buckets[formType] : s_empty;
+	}
 }
 
 static TESObjectREFR* CellScan(Script* scriptObj, TESObjectCELL* cellToScan = NULL, UInt32 formType = 0, UInt32 cellDepth = 0, bool getFirst = false, bool includeTaken = false, ProjectileFinder* projFinder = NULL)
@@ -771,21 +932,56 @@ static TESObjectREFR* CellScan(Script* scriptObj, TESObjectCELL* cellToScan = NU
 
 	CellScanInfo* info = &(scanScripts[idx]);
 
-	bool bContinue = true;
-	while (bContinue)
+	TESObjectREFR* found = NULL;
+	while (info->curCell && !found)
 	{
-		info->prev = GetCellRefEntry(CellListVisitor(&info->curCell->objectList), info->formType, info->prev, info->includeTakenRefs, projFinder);
-		if (!info->prev || !info->prev->refr)				//no ref found
+		// the index is checked against the cell's contents once per scan of the cell, checking on every call would make
+		// a full sweep with GetNextRef quadratic in the number of refs
+		const CellRefIndex& index = CellRefIndex::Get(info->curCell, !info->indexVersion);
+		const CellRefIndex::RefList& candidates = index.Candidates(info->formType);
+
+		if (info->indexVersion != index.Version())
+		{
+			// index rebuilt since the last ref was returned, continue after that ref or from the one following it if it
+			// has gone. prev and next may no longer exist and are only compared, never dereferenced
+			if (info->indexVersion)
+			{
+				CellRefIndex::RefList::const_iterator iter = std::find(candidates.begin(), candidates.end(), info->prev);
+				if (iter != candidates.end())
+					info->pos = iter - candidates.begin() + 1;
+				else if (info->next && (iter = std::find(candidates.begin(), candidates.end(), info->next)) != candidates.end())
+					info->pos = iter - candidates.begin();
+				else
+					info->pos = candidates.size();
+			}
+
+			info->indexVersion = index.Version();
+		}
+
+		while (info->pos < candidates.size() && !found)
+		{
+			TESObjectREFR* refr = candidates[info->pos++];
+			if (AcceptRef(info->formType, refr, info->includeTakenRefs, projFinder) &&
+				!(*g_ioManager)->IsInQueue(refr))	// don't include newly-queued refs
+			{
+				found = refr;
+				info->next = info->pos < candidates.size() ? candidates[info->pos] : NULL;
+			}
+		}
+
+		if (!found)		//check next cell if possible
 		{
-			if (!info->NextCell())			//check next cell if possible
-				bContinue = false;
+			info->NextCell();
+			info->pos = 0;
+			info->indexVersion = 0;
 		}
-		else if (!(*g_ioManager)->IsInQueue(info->prev->refr))	// don't include newly-queued refs
-			bContinue = false;			//found a ref
 	}
 
-	if (info->prev)
-		return info->prev->refr;
+	if (found)
+	{
+		info->prev = found;
+		return found;
+	}
 	else
 	{
 		scanScripts.erase(idx);
@@ -896,21 +1092,13 @@ static bool GetNumRefs_Execute(COMMAND_ARGS, bool bUsePlayerCell = true)
 
 	while (info.curCell)
 	{
-		CellListVisitor visitor(&info.curCell->objectList);
-		switch (formType)
+		const CellRefIndex::RefList& candidates = CellRefIndex::Get(info.curCell, true).Candidates(formType);
+		for (CellRefIndex::RefList::const_iterator iter = candidates.begin(); iter != candidates.end(); ++iter)
 		{
-		case 0:
-			*result += visitor.CountIf(RefMatcherAnyForm(bIncludeTakenRefs));
-			break;
-		case 69:
-			*result += visitor.CountIf(RefMatcherActor());
-			break;
-		case 70:
-			*result += visitor.CountIf(RefMatcherItem(bIncludeTakenRefs));
-			break;
-		default:
-			*result += visitor.CountIf(RefMatcherFormType(formType, bIncludeTakenRefs));
+			if (AcceptRef(formType, *iter, bIncludeTakenRefs))
+				*result += 1;
 		}
+
 		info.NextCell();
 	}
 
@@ -424,8 +424,10 @@ static bool ExtractEventCallback(ExpressionEvaluator& eval, EventManager::EventC
 			TESObjectREFR* sourceFilter = NULL;
 			TESForm* targetFilter = NULL;
 			TESObjectREFR* thisObjFilter = NULL;
+			bool bCoalesce = false;
+			UInt32 rateLimit = 0;
 			
-			// any filters?
+			// any filters or options?
 			for (UInt32 i = 2; i < eval.NumArgs(); i++) {
 				const TokenPair* pair = eval.Arg(i)->GetPair();
 				if (pair && pair->left && pair->right) {
@@ -450,11 +452,26 @@ static bool ExtractEventCallback(ExpressionEvaluator& eval, EventManager::EventC
 								targetFilter = pair->right->GetTESForm();
 							}
 						}
+						else if (!_stricmp(key, "coalesce")) {
+							// at most one call per frame for the same arguments
+							bCoalesce = pair->right->GetNumber() != 0;
+						}
+						else if (!_stricmp(key, "ratelimit")) {
+							// minimum milliseconds between calls, at most an hour. negative intervals disable the limit
+							static const UInt32 kMaxRateLimit = 60 * 60 * 1000;
+							double interval = pair->right->GetNumber();
+							if (interval > kMaxRateLimit)
+								rateLimit = kMaxRateLimit;
+							else
+								rateLimit = interval > 0 ? (UInt32)interval : 0;
+						}
 					}
 				}
 			}
 
 			*outCallback = EventManager::EventCallback(script, sourceFilter, targetFilter, thisObjFilter);
+			outCallback->SetCoalesced(bCoalesce);
+			outCallback->rateLimit = rateLimit;
 			return true;
 		}
 	}
@@ -488,6 +505,44 @@ static bool Cmd_RemoveEventHandler_Execute(COMMAND_ARGS)
 	return true;
 }
 
+static bool Cmd_PrintEventHandlerInfo_Execute(COMMAND_ARGS)
+{
+	EventManager::PrintHandlerInfo();
+	return true;
+}
+
+static bool Cmd_PrintTokenPoolInfo_Execute(COMMAND_ARGS)
+{
+	// counters are for the previous frame, heap allocations mean the pools were exhausted or a token was too large
+	const ScriptTokenPool::Stats& stats = ScriptTokenPool::LastFrame();
+	Console_Print("Token pool: %d pooled, %d heap allocations last frame", stats.pooled, stats.heap);
+
+	*result = stats.heap;
+	return true;
+}
+
+static bool Cmd_PrintCommandDispatchInfo_Execute(COMMAND_ARGS)
+{
+	// commands called from OBSE expressions during the previous frame
+	UInt32 count = g_scriptCommands.GetLastFrameDispatchCount();
+	Console_Print("Command dispatch: %d commands executed by expressions last frame", count);
+
+	*result = count;
+	return true;
+}
+
+static bool Cmd_PrintDeferredEventInfo_Execute(COMMAND_ARGS)
+{
+	// handlers for events raised outside the main thread are queued until the next frame, the queue doesn't grow
+	EventManager::DeferredQueueStats stats;
+	EventManager::GetDeferredQueueStats(&stats);
+	Console_Print("Deferred events: capacity %d, calls raised while full are dropped", stats.capacity);
+	Console_Print("%d queued, %d dropped, %d pending, peak %d", stats.numQueued, stats.numDropped, stats.numPending, stats.peakDepth);
+
+	*result = stats.numDropped;
+	return true;
+}
+
 static bool Cmd_GetCurrentEventName_Execute(COMMAND_ARGS)
 {
 	const char* eventName = EventManager::GetCurrentEventName();
@@ -734,36 +789,52 @@ DEFINE_COMMAND(RunScript,
 			   1,
 			   kParams_OneInventoryObject);
 
-static ParamInfo kOBSEParams_SetEventHandler[4] =
+// optional pairs are filters ("ref", "object") or options ("coalesce", "ratelimit")
+static ParamInfo kOBSEParams_SetEventHandler[6] =
 {
 	{ "event name",			kOBSEParamType_String,	0 },
 	{ "function script",	kOBSEParamType_Form,	0 },
 	{ "filter",				kOBSEParamType_Pair,	1 },
 	{ "filter",				kOBSEParamType_Pair,	1 },
+	{ "option",				kOBSEParamType_Pair,	1 },
+	{ "option",				kOBSEParamType_Pair,	1 },
 };
 
 CommandInfo kCommandInfo_SetEventHandler = 
 {
 	"SetEventHandler", "", 0,
 	"defines a function script to serve as a callback for game events",
-	0, 4, kOBSEParams_SetEventHandler,
+	0, 6, kOBSEParams_SetEventHandler,
 	HANDLER(Cmd_SetEventHandler_Execute),
 	Cmd_Expression_Parse,
 	NULL,
 	0
 };
 
+// options don't identify a handler, so RemoveEventHandler only takes filters
+static ParamInfo kOBSEParams_RemoveEventHandler[4] =
+{
+	{ "event name",			kOBSEParamType_String,	0 },
+	{ "function script",	kOBSEParamType_Form,	0 },
+	{ "filter",				kOBSEParamType_Pair,	1 },
+	{ "filter",				kOBSEParamType_Pair,	1 },
+};
+
 CommandInfo kCommandInfo_RemoveEventHandler = 
 {
 	"RemoveEventHandler", "", 0,
 	"removes event handlers matching the event, script, and optional filters specified",
-	0, 4, kOBSEParams_SetEventHandler,
+	0, 4, kOBSEParams_RemoveEventHandler,
 	HANDLER(Cmd_RemoveEventHandler_Execute),
 	Cmd_Expression_Parse,
 	NULL,
 	0
 };
 
+DEFINE_COMMAND(PrintEventHandlerInfo, prints registered event handlers and the calls suppressed by coalescing or rate limiting, 0, 0, NULL);
+DEFINE_COMMAND(PrintTokenPoolInfo, prints the number of script tokens allocated from the pools and from the heap last frame, 0, 0, NULL);
+DEFINE_COMMAND(PrintCommandDispatchInfo, prints the number of commands executed by OBSE expressions last frame, 0, 0, NULL);
+DEFINE_COMMAND(PrintDeferredEventInfo, prints the capacity of the deferred event queue and the handler calls it dropped, 0, 0, NULL);
 DEFINE_COMMAND(GetCurrentEventName, returns the name of the event currently being processed by an event handler, 
 			   0, 0, NULL);
 DEFINE_COMMAND(GetCurrentScript, returns the calling script, 0, 0, NULL);
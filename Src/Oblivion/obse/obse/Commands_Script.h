@@ -29,6 +29,10 @@ extern CommandInfo kCommandInfo_GetArrayVariable;
 
 extern CommandInfo kCommandInfo_SetEventHandler;
 extern CommandInfo kCommandInfo_RemoveEventHandler;
+extern CommandInfo kCommandInfo_PrintEventHandlerInfo;
+extern CommandInfo kCommandInfo_PrintTokenPoolInfo;
+extern CommandInfo kCommandInfo_PrintCommandDispatchInfo;
+extern CommandInfo kCommandInfo_PrintDeferredEventInfo;
 
 extern CommandInfo kCommandInfo_GetCurrentEventName;
 
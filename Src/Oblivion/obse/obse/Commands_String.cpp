@@ -868,6 +868,18 @@ static bool Cmd_sv_Percentify_Execute(COMMAND_ARGS)
 	return true;
 }
 
+static bool Cmd_PrintStringPoolInfo_Execute(COMMAND_ARGS)
+{
+	// strings, array keys/elements and string literals longer than a few characters share one pooled copy
+	ArrayString::PoolStats stats;
+	ArrayString::GetPoolStats(&stats);
+	Console_Print("String pool: %d strings, %d references, %d bytes used, %d bytes saved",
+		stats.numStrings, stats.numRefs, stats.bytesUsed, stats.bytesSaved);
+
+	*result = stats.bytesSaved;
+	return true;
+}
+
 #endif
 
 static ParamInfo kParams_sv_Destruct[10] =
@@ -1353,3 +1365,5 @@ CommandInfo kCommandInfo_GetRawFormIDString =
 	HANDLER(Cmd_GetRawFormIDString_Execute),
 	Cmd_Expression_Parse, NULL, 0
 };
+
+DEFINE_COMMAND(PrintStringPoolInfo, prints the number of pooled strings and the memory saved by sharing them, 0, 0, NULL);
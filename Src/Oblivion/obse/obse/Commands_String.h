@@ -62,4 +62,6 @@ extern CommandInfo kCommandInfo_sv_Percentify;
 extern CommandInfo kCommandInfo_GetTexturePath;
 extern CommandInfo kCommandInfo_SetTexturePath;
 
-extern CommandInfo kCommandInfo_GetRawFormIDString;
\ No newline at end of file
+extern CommandInfo kCommandInfo_GetRawFormIDString;
+
+extern CommandInfo kCommandInfo_PrintStringPoolInfo;
@@ -1,4 +1,8 @@
 #include <list>
+#include <set>
+#include <vector>
+#include <hash_map>
+#include <algorithm>
 #include <stdarg.h>
 #include "EventManager.h"
 #include "ArrayVar.h"
@@ -17,7 +21,54 @@ namespace EventManager {
 
 void __stdcall HandleEventForCallingObject(eEventID id, TESObjectREFR* callingObj, void* arg0, void* arg1);
 
-static ICriticalSection s_criticalSection;
+// Reader-writer lock on which readers don't exclude each other. IReadWriteLock passes every reader through a
+// critical section, serializing event dispatch across threads; here a reader only increments a count. Writes are
+// rare (registering and purging handlers), so a writer announces itself to hold off new readers and spins until
+// the current ones leave. Not recursive.
+class HandlerLock
+{
+	enum { kWriting = -1 };
+
+	volatile LONG		m_readers;			// number of readers, or kWriting
+	volatile LONG		m_writerWaiting;
+	ICriticalSection	m_writeLock;		// one writer at a time
+
+public:
+	HandlerLock() : m_readers(0), m_writerWaiting(0) { }
+
+	void StartRead() {
+		for (;;) {
+			LONG readers = m_readers;
+			if (readers != kWriting && !m_writerWaiting &&
+				InterlockedCompareExchange(&m_readers, readers + 1, readers) == readers)
+				return;
+
+			Sleep(0);
+		}
+	}
+
+	void EndRead() {
+		InterlockedDecrement(&m_readers);
+	}
+
+	void StartWrite() {
+		m_writeLock.Enter();
+		InterlockedExchange(&m_writerWaiting, 1);
+		while (InterlockedCompareExchange(&m_readers, kWriting, 0) != 0)
+			Sleep(0);
+	}
+
+	void EndWrite() {
+		InterlockedExchange(&m_readers, 0);
+		InterlockedExchange(&m_writerWaiting, 0);
+		m_writeLock.Leave();
+	}
+};
+
+static ICriticalSection s_criticalSection;		// duplicate event checks
+static HandlerLock s_handlerLock;				// registered handlers, written only by Set/RemoveHandler and Tick()
+
+class CallbackIndex;
 
 //////////////////////
 // Event definitions
@@ -60,7 +111,7 @@ struct EventInfo
 	UInt8						* paramTypes;
 	UInt8						numParams;
 	bool						isDeferred;		// dispatch event in Tick() instead of immediately - currently unused
-	std::list<EventCallback>	* callbacks;
+	CallbackIndex				* callbacks;
 	EventHookInstaller			* installHook;	// if a hook is needed for this event type, this will be non-null. 
 												// install it once and then set *installHook to NULL. Allows multiple events
 												// to use the same hook, installing it only once.
@@ -1017,11 +1068,278 @@ bool EventCallback::Equals(const EventCallback& rhs) const
 
 typedef std::list<EventCallback>	CallbackList;
 
-bool SetHandler(eEventID id, EventCallback& handler)
+// handlers matching one event. Kept on the stack so that dispatching, and deferring events raised by other threads,
+// doesn't allocate unless an unusually large number of handlers match
+class MatchList
 {
-	ScopedLock lock(s_criticalSection);
+	enum { kInlineSize = 32 };
+
+	EventCallback				* m_inline[kInlineSize];
+	std::vector<EventCallback*>	m_overflow;		// holds every match once there are more than kInlineSize
+	UInt32						m_size;
+
+public:
+	typedef EventCallback** iterator;
+
+	MatchList() : m_size(0) { }
+
+	void push_back(EventCallback* callback)
+	{
+		if (m_size < kInlineSize)
+			m_inline[m_size] = callback;
+		else {
+			if (m_size == kInlineSize)
+				m_overflow.assign(m_inline, m_inline + kInlineSize);
+
+			m_overflow.push_back(callback);
+		}
+
+		m_size++;
+	}
+
+	UInt32		size() const	{ return m_size; }
+	bool		empty() const	{ return !m_size; }
+	iterator	begin()			{ return m_size > kInlineSize ? &m_overflow[0] : m_inline; }
+	iterator	end()			{ return begin() + m_size; }
+};
+
+// handlers registered for one event, bucketed by filter so dispatch only visits handlers which can match the event
+// a handler with a source filter is bucketed by source, one with only an object filter by object, the rest are wildcards
+// filters are compared by pointer, as HandleEvent does, so the buckets are keyed by form rather than refID/formID
+class CallbackIndex
+{
+	typedef std::vector<EventCallback*>				Bucket;
+	typedef stdext::hash_map<UInt32, Bucket>		BucketMap;
+
+	eEventID		m_eventID;
+	CallbackList	m_callbacks;		// owns the handlers, in order of registration
+	BucketMap		m_bySource;
+	BucketMap		m_byObject;
+	Bucket			m_wildcards;
+	UInt32			m_nextSequence;
+	UInt32			m_numRemoved;		// flagged for removal while in use
+
+	UInt32	ObjectKey(const EventCallback& callback) const;
+	Bucket&	BucketFor(const EventCallback& callback);
+	void	Erase(CallbackList::iterator iter);
+	bool	Matches(const EventCallback& callback, TESObjectREFR* callingObj, void* arg0, void* arg1) const;
+	void	AddMatches(const Bucket& bucket, TESObjectREFR* callingObj, void* arg0, void* arg1, MatchList& out) const;
+
+	static bool SequenceLess(const EventCallback* lhs, const EventCallback* rhs) { return lhs->sequence < rhs->sequence; }
+
+public:
+	CallbackIndex(eEventID eventID) : m_eventID(eventID), m_nextSequence(0), m_numRemoved(0) { }
+
+	bool	Add(const EventCallback& handler);				// false if an identical handler exists
+	bool	Remove(const EventCallback& handler);			// handlers for the same script matching any source and object filter
+	bool	Purge();										// erases handlers removed while in use, true if some are still in use
+
+	// appends handlers matching the event in order of registration, taking a use of each
+	void	GetMatches(TESObjectREFR* callingObj, void* arg0, void* arg1, MatchList& out) const;
+
+	void	Print(const char* eventName) const;
+};
+
+// set when a handler is removed while in use, cleared by Tick()
+static bool s_bPurgeCallbacks = false;
+
+UInt32 CallbackIndex::ObjectKey(const EventCallback& callback) const
+{
+	if (!callback.object)
+		return 0;
+
+	if (m_eventID == kEventID_OnMagicEffectHit) {
+		// event passes the effect code rather than the effect setting
+		EffectSetting* setting = OBLIVION_CAST(callback.object, TESForm, EffectSetting);
+		return setting ? setting->effectCode : 0;
+	}
+
+	return (UInt32)callback.object;
+}
+
+CallbackIndex::Bucket& CallbackIndex::BucketFor(const EventCallback& callback)
+{
+	if (callback.source)
+		return m_bySource[(UInt32)callback.source];
+
+	UInt32 objectKey = ObjectKey(callback);
+	return objectKey ? m_byObject[objectKey] : m_wildcards;
+}
+
+void CallbackIndex::Erase(CallbackList::iterator iter)
+{
+	Bucket& bucket = BucketFor(*iter);
+	bucket.erase(std::find(bucket.begin(), bucket.end(), &*iter));
+
+	if (bucket.empty()) {
+		if (iter->source)
+			m_bySource.erase((UInt32)iter->source);
+		else if (&bucket != &m_wildcards)
+			m_byObject.erase(ObjectKey(*iter));
+	}
+
+	m_callbacks.erase(iter);
+}
+
+bool CallbackIndex::Matches(const EventCallback& callback, TESObjectREFR* callingObj, void* arg0, void* arg1) const
+{
+	if (callback.IsRemoved())
+		return false;
+
+	if (callback.source && !((TESObjectREFR*)arg0 == callback.source))
+		return false;
+
+	if (callback.callingObj && !(callingObj == callback.callingObj))
+		return false;
 
+	if (callback.object) {
+		if (m_eventID == kEventID_OnMagicEffectHit) {
+			EffectSetting* setting = OBLIVION_CAST(callback.object, TESForm, EffectSetting);
+			if (setting && setting->effectCode != (UInt32)arg1)
+				return false;
+		}
+		else if (!(callback.object == (TESForm*)arg1))
+			return false;
+	}
+
+	return true;
+}
+
+void CallbackIndex::AddMatches(const Bucket& bucket, TESObjectREFR* callingObj, void* arg0, void* arg1, MatchList& out) const
+{
+	for (Bucket::const_iterator iter = bucket.begin(); iter != bucket.end(); ++iter) {
+		if (Matches(**iter, callingObj, arg0, arg1)) {
+			(*iter)->AddUse();
+			out.push_back(*iter);
+		}
+	}
+}
+
+bool CallbackIndex::Add(const EventCallback& handler)
+{
+	Bucket& bucket = BucketFor(handler);
+
+	// if an existing handler matches this one exactly, don't duplicate it
+	for (Bucket::iterator iter = bucket.begin(); iter != bucket.end(); ++iter) {
+		if ((*iter)->Equals(handler)) {
+			// may be re-adding a previously removed handler, so clear the Removed flag
+			if ((*iter)->IsRemoved()) {
+				(*iter)->SetRemoved(false);
+				m_numRemoved--;
+			}
+
+			// take on the new coalescing options
+			(*iter)->SetCoalesced(handler.IsCoalesced());
+			(*iter)->rateLimit = handler.rateLimit;
+			return false;
+		}
+	}
+
+	m_callbacks.push_back(handler);
+	EventCallback* callback = &m_callbacks.back();
+	callback->sequence = m_nextSequence++;
+	callback->useCount = 0;
+	callback->lastCallTime = GetTickCount() - callback->rateLimit;
+	callback->numSuppressed = 0;
+	bucket.push_back(callback);
+	return true;
+}
+
+bool CallbackIndex::Remove(const EventCallback& handler)
+{
+	bool bRemovedAtLeastOne = false;
+	for (CallbackList::iterator iter = m_callbacks.begin(); iter != m_callbacks.end(); ) {
+		if (iter->script != handler.script ||
+			(handler.object && handler.object != iter->object) ||
+			(handler.source && handler.source != iter->source)) {
+			++iter;
+			continue;
+		}
+
+		if (iter->IsInUse()) {
+			// this handler is currently active, flag it for later removal
+			if (!iter->IsRemoved()) {
+				iter->SetRemoved(true);
+				m_numRemoved++;
+				s_bPurgeCallbacks = true;
+			}
+
+			++iter;
+		}
+		else {
+			CallbackList::iterator toErase = iter++;
+			Erase(toErase);
+		}
+
+		bRemovedAtLeastOne = true;
+	}
+
+	return bRemovedAtLeastOne;
+}
+
+bool CallbackIndex::Purge()
+{
+	for (CallbackList::iterator iter = m_callbacks.begin(); m_numRemoved && iter != m_callbacks.end(); ) {
+		if (iter->IsRemoved() && !iter->IsInUse()) {
+			CallbackList::iterator toErase = iter++;
+			Erase(toErase);
+			m_numRemoved--;
+		}
+		else {
+			++iter;
+		}
+	}
+
+	return m_numRemoved != 0;
+}
+
+void CallbackIndex::GetMatches(TESObjectREFR* callingObj, void* arg0, void* arg1, MatchList& out) const
+{
+	UInt32 numMatches = out.size();
+	UInt32 numBuckets = 0;
+
+	BucketMap::const_iterator iter;
+	if (arg0 && (iter = m_bySource.find((UInt32)arg0)) != m_bySource.end()) {
+		AddMatches(iter->second, callingObj, arg0, arg1, out);
+		numBuckets++;
+	}
+
+	if (arg1 && (iter = m_byObject.find((UInt32)arg1)) != m_byObject.end()) {
+		AddMatches(iter->second, callingObj, arg0, arg1, out);
+		numBuckets++;
+	}
+
+	if (m_wildcards.size()) {
+		AddMatches(m_wildcards, callingObj, arg0, arg1, out);
+		numBuckets++;
+	}
+
+	// each bucket is in order of registration
+	if (numBuckets > 1)
+		std::sort(out.begin() + numMatches, out.end(), SequenceLess);
+}
+
+void CallbackIndex::Print(const char* eventName) const
+{
+	UInt32 numSuppressed = 0;
+	for (CallbackList::const_iterator iter = m_callbacks.begin(); iter != m_callbacks.end(); ++iter)
+		numSuppressed += iter->numSuppressed;
+
+	Console_Print("%s: %d handlers, %d calls suppressed", eventName, m_callbacks.size(), numSuppressed);
+
+	for (CallbackList::const_iterator iter = m_callbacks.begin(); iter != m_callbacks.end(); ++iter) {
+		if (iter->IsCoalesced() || iter->rateLimit) {
+			Console_Print("  script %08X: %s, rate limit %d ms, %d calls suppressed", iter->script->refID,
+				iter->IsCoalesced() ? "coalesced" : "not coalesced", iter->rateLimit, iter->numSuppressed);
+		}
+	}
+}
+
+bool SetHandler(eEventID id, EventCallback& handler)
+{
 	if (id < kEventID_MAX) {
+		s_handlerLock.StartWrite();
+
 		EventInfo* info = &s_eventInfos[id];
 		// is hook installed for this event type?
 		if (info->installHook) {
@@ -1035,21 +1353,13 @@ bool SetHandler(eEventID id, EventCallback& handler)
 		}
 
 		if (!info->callbacks) {
-			info->callbacks = new CallbackList();
-		}
-		else {
-			// if an existing handler matches this one exactly, don't duplicate it
-			for (CallbackList::iterator iter = info->callbacks->begin(); iter != info->callbacks->end(); ++iter) {
-				if (iter->Equals(handler)) {
-					// may be re-adding a previously removed handler, so clear the Removed flag
-					iter->SetRemoved(false);
-					return false;
-				}
-			}
+			info->callbacks = new CallbackIndex(id);
 		}
 
-		info->callbacks->push_back(handler);
-		return true;
+		bool bAdded = info->callbacks->Add(handler);
+
+		s_handlerLock.EndWrite();
+		return bAdded;
 	}
 	else {
 		return false;
@@ -1095,98 +1405,241 @@ private:
 };
 
 // stack of event names pushed when handler invoked, popped when handler returns
-// used by GetCurrentEventName
+// used by GetCurrentEventName. Handlers only run in the main thread
 std::stack<const char*> s_eventStack;
 
 // some events are best deferred until Tick() invoked rather than being handled immediately
-// this stores info about such an event. Currently unused.
+// this stores info about such an event. The callback's use is released once it has been invoked.
 struct DeferredCallback
 {
-	DeferredCallback(CallbackList::iterator& _iter, TESObjectREFR* _callingObj, void* _arg0, void* _arg1, EventInfo* _eventInfo)
-		: iterator(_iter), callingObj(_callingObj), arg0(_arg0), arg1(_arg1), eventInfo(_eventInfo) { }
+	DeferredCallback() : callback(NULL), callingObj(NULL), arg0(NULL), arg1(NULL), eventInfo(NULL) { }
+	DeferredCallback(EventCallback* _callback, TESObjectREFR* _callingObj, void* _arg0, void* _arg1, EventInfo* _eventInfo)
+		: callback(_callback), callingObj(_callingObj), arg0(_arg0), arg1(_arg1), eventInfo(_eventInfo) { }
 
-	CallbackList::iterator	iterator;
+	EventCallback			* callback;
 	TESObjectREFR			* callingObj;
 	void					* arg0;
 	void					* arg1;
 	EventInfo				* eventInfo;
 };
 
-std::list<DeferredCallback> s_deferredCallbacks;
+// bounded queue of deferred callbacks, pushed by any thread and popped by the main thread in Tick()
+// callingObj and the args are raw pointers which are only valid until the game moves on, so Tick() drains all calls
+// queued before it started rather than letting any wait for a later frame
+// a producer claims a slot by advancing the enqueue position with a compare-exchange, then publishes it through the
+// slot's sequence number, so pushing neither locks nor allocates. When the queue is full the callback is dropped.
+class DeferredQueue
+{
+public:
+	enum { kCapacity = 0x1000 };	// must be a power of 2
 
-void __stdcall HandleEventForCallingObject(eEventID id, TESObjectREFR* callingObj, void* arg0, void* arg1)
+	DeferredQueue();
+
+	bool	Push(const DeferredCallback& callback);		// false if the queue is full
+	bool	Pop(DeferredCallback* out);					// main thread only, false if empty
+
+	// invokes every callback pushed before the call, main thread only
+	void	Drain(void (* invoke)(const DeferredCallback& callback));
+
+	void	GetStats(DeferredQueueStats* out) const;
+
+private:
+	struct Slot
+	{
+		volatile LONG		sequence;	// == position when free, position + 1 once written
+		DeferredCallback	callback;
+	};
+
+	Slot			m_slots[kCapacity];
+	volatile LONG	m_enqueuePos;
+	volatile LONG	m_dequeuePos;
+
+	// statistics
+	volatile LONG	m_numQueued;
+	volatile LONG	m_numDropped;
+	volatile LONG	m_peakDepth;
+};
+
+DeferredQueue::DeferredQueue() : m_enqueuePos(0), m_dequeuePos(0), m_numQueued(0), m_numDropped(0), m_peakDepth(0)
 {
-	ScopedLock lock(s_criticalSection);
+	for (UInt32 i = 0; i < kCapacity; i++)
+		m_slots[i].sequence = i;
+}
 
-	EventInfo* eventInfo = &s_eventInfos[id];
-	if (eventInfo->callbacks) {
-		for (CallbackList::iterator iter = eventInfo->callbacks->begin(); iter != eventInfo->callbacks->end(); ) {
-			if (iter->IsRemoved()) {
-				if (!iter->IsInUse()) {
-					iter = eventInfo->callbacks->erase(iter);
-				}
-				else {
-					++iter;
-				}
-
-				continue;
-			}
+bool DeferredQueue::Push(const DeferredCallback& callback)
+{
+	LONG pos = m_enqueuePos;
+	Slot* slot = NULL;
+	while (true) {
+		slot = &m_slots[pos & (kCapacity - 1)];
+		LONG diff = (LONG)((UInt32)slot->sequence - (UInt32)pos);
+		if (diff == 0) {
+			LONG prevPos = InterlockedCompareExchange(&m_enqueuePos, pos + 1, pos);
+			if (prevPos == pos)
+				break;
+
+			pos = prevPos;		// another producer claimed the slot
+		}
+		else if (diff < 0) {
+			// slot not yet popped from the previous lap
+			InterlockedIncrement(&m_numDropped);
+			return false;
+		}
+		else {
+			pos = m_enqueuePos;
+		}
+	}
 
-			// Check filters
-			if (iter->source && !((TESObjectREFR*)arg0 == iter->source)) {
-				++iter;
-				continue;
-			}
+	slot->callback = callback;
+	InterlockedExchange(&slot->sequence, pos + 1);
 
-			if (iter->callingObj && !(callingObj == iter->callingObj)) {
-				++iter;
-				continue;
-			}
+	InterlockedIncrement(&m_numQueued);
 
-			if (iter->object) {
-				if (id == kEventID_OnMagicEffectHit) {
-					EffectSetting* setting = OBLIVION_CAST(iter->object, TESForm, EffectSetting);
-					if (setting && setting->effectCode != (UInt32)arg1) {
-						++iter;
-						continue;
-					}
-				}
-				else if (!(iter->object == (TESForm*)arg1)) {
-					++iter;
-					continue;
-				}
-			}
+	LONG depth = pos + 1 - m_dequeuePos;
+	LONG peak = m_peakDepth;
+	while (depth > peak) {
+		LONG prevPeak = InterlockedCompareExchange(&m_peakDepth, depth, peak);
+		if (prevPeak == peak)
+			break;
 
-			if (eventInfo->isDeferred || GetCurrentThreadId() != g_mainThreadID) {
-				// avoid potential issues with invoking handlers outside of main thread by deferring event handling
-				if (!iter->IsRemoved()) {
-					iter->SetInUse(true);
-					s_deferredCallbacks.push_back(DeferredCallback(iter, callingObj, arg0, arg1, eventInfo));
-					++iter;
-				}
-			}
-			else {
-				// handle immediately
-				bool bWasInUse = iter->IsInUse();
-				iter->SetInUse(true);
-				s_eventStack.push(eventInfo->name);
-				ScriptToken* result = UserFunctionManager::Call(EventHandlerCaller(iter->script, eventInfo, arg0, arg1, callingObj));
-				s_eventStack.pop();
-				iter->SetInUse(bWasInUse);
-
-				// it's possible the handler decided to remove itself, so take care of that, being careful
-				// not to remove a callback that is needed for deferred invocation
-				if (!bWasInUse && iter->IsRemoved()) {
-					iter = eventInfo->callbacks->erase(iter);
-				}
-				else {
-					++iter;
-				}
-
-				// result is unused
-				delete result;
-			}
+		peak = prevPeak;
+	}
+
+	return true;
+}
+
+bool DeferredQueue::Pop(DeferredCallback* out)
+{
+	Slot* slot = &m_slots[m_dequeuePos & (kCapacity - 1)];
+	if (slot->sequence != m_dequeuePos + 1)
+		return false;		// empty, or the producer has yet to finish writing
+
+	*out = slot->callback;
+	InterlockedExchange(&slot->sequence, m_dequeuePos + kCapacity);
+	m_dequeuePos++;
+	return true;
+}
+
+void DeferredQueue::Drain(void (* invoke)(const DeferredCallback& callback))
+{
+	LONG endPos = m_enqueuePos;
+	DeferredCallback deferred;
+	while (m_dequeuePos - endPos < 0) {
+		// a claimed slot is published right after it is written, wait for its producer rather than leave it behind
+		if (Pop(&deferred))
+			invoke(deferred);
+		else
+			Sleep(0);
+	}
+}
+
+void DeferredQueue::GetStats(DeferredQueueStats* out) const
+{
+	out->capacity = kCapacity;
+	out->numQueued = m_numQueued;
+	out->numDropped = m_numDropped;
+	out->peakDepth = m_peakDepth;
+	out->numPending = m_enqueuePos - m_dequeuePos;
+}
+
+static DeferredQueue s_deferredQueue;
+
+// handler invocations made this frame by coalesced handlers, cleared by Tick()
+struct CoalescedCall
+{
+	CoalescedCall(EventCallback* _callback, TESObjectREFR* _callingObj, void* _arg0, void* _arg1)
+		: callback(_callback), callingObj(_callingObj), arg0(_arg0), arg1(_arg1) { }
+
+	EventCallback	* callback;
+	TESObjectREFR	* callingObj;
+	void			* arg0;
+	void			* arg1;
+
+	bool operator<(const CoalescedCall& rhs) const
+	{
+		if (callback != rhs.callback)
+			return callback < rhs.callback;
+		else if (callingObj != rhs.callingObj)
+			return callingObj < rhs.callingObj;
+		else if (arg0 != rhs.arg0)
+			return arg0 < rhs.arg0;
+
+		return arg1 < rhs.arg1;
+	}
+};
+
+static std::set<CoalescedCall> s_coalescedCalls;
+
+// true if the handler has opted out of this invocation by rate limiting or coalescing
+// the rate limit interval starts only once a call gets through, so a coalesced duplicate doesn't hold off the next call
+static bool SuppressCallback(EventCallback* callback, TESObjectREFR* callingObj, void* arg0, void* arg1)
+{
+	if (callback->IsCoalesced() && !s_coalescedCalls.insert(CoalescedCall(callback, callingObj, arg0, arg1)).second) {
+		callback->numSuppressed++;
+		return true;
+	}
+
+	if (callback->rateLimit) {
+		UInt32 now = GetTickCount();
+		if (now - callback->lastCallTime < callback->rateLimit) {
+			callback->numSuppressed++;
+			return true;
 		}
+
+		callback->lastCallTime = now;
+	}
+
+	return false;
+}
+
+static void InvokeCallback(EventCallback* callback, EventInfo* eventInfo, TESObjectREFR* callingObj, void* arg0, void* arg1)
+{
+	// handler may have been removed by a previous one
+	if (!callback->IsRemoved() && !SuppressCallback(callback, callingObj, arg0, arg1)) {
+		s_eventStack.push(eventInfo->name);
+		ScriptToken* result = UserFunctionManager::Call(EventHandlerCaller(callback->script, eventInfo, arg0, arg1, callingObj));
+		s_eventStack.pop();
+
+		// result is unused
+		delete result;
+	}
+
+	// if the handler was removed it is erased by Tick() once no longer in use
+	callback->ReleaseUse();
+}
+
+static void InvokeDeferredCallback(const DeferredCallback& deferred)
+{
+	InvokeCallback(deferred.callback, deferred.eventInfo, deferred.callingObj, deferred.arg0, deferred.arg1);
+}
+
+void __stdcall HandleEventForCallingObject(eEventID id, TESObjectREFR* callingObj, void* arg0, void* arg1)
+{
+	// the index is created once, by the first SetHandler() for the event, and lives until exit
+	EventInfo* eventInfo = &s_eventInfos[id];
+	if (!eventInfo->callbacks)
+		return;
+
+	// collect the matching handlers; the lock is not held while they run, so they are free to add or remove handlers
+	MatchList matches;
+	s_handlerLock.StartRead();
+	eventInfo->callbacks->GetMatches(callingObj, arg0, arg1, matches);
+	s_handlerLock.EndRead();
+
+	if (matches.empty())
+		return;
+
+	if (eventInfo->isDeferred || GetCurrentThreadId() != g_mainThreadID) {
+		// avoid potential issues with invoking handlers outside of main thread by deferring event handling
+		for (MatchList::iterator iter = matches.begin(); iter != matches.end(); ++iter) {
+			if (!s_deferredQueue.Push(DeferredCallback(*iter, callingObj, arg0, arg1, eventInfo)))
+				(*iter)->ReleaseUse();
+		}
+	}
+	else {
+		// handle immediately
+		for (MatchList::iterator iter = matches.begin(); iter != matches.end(); ++iter)
+			InvokeCallback(*iter, eventInfo, callingObj, arg0, arg1);
 	}
 }
 
@@ -1200,10 +1653,30 @@ void __stdcall HandleEvent(eEventID id, void * arg0, void * arg1)
 // public API
 ///////////////
 
-const char* GetCurrentEventName()
+void GetDeferredQueueStats(DeferredQueueStats* out)
 {
-	ScopedLock lock(s_criticalSection);
+	s_deferredQueue.GetStats(out);
+}
+
+void PrintHandlerInfo()
+{
+	s_handlerLock.StartRead();
+
+	for (UInt32 i = 0; i < kEventID_MAX; i++) {
+		if (s_eventInfos[i].callbacks)
+			s_eventInfos[i].callbacks->Print(s_eventInfos[i].name);
+	}
+
+	s_handlerLock.EndRead();
+
+	DeferredQueueStats stats;
+	s_deferredQueue.GetStats(&stats);
+	Console_Print("Deferred calls: %d queued, %d dropped, %d pending, peak %d of %d",
+		stats.numQueued, stats.numDropped, stats.numPending, stats.peakDepth, stats.capacity);
+}
 
+const char* GetCurrentEventName()
+{
 	return s_eventStack.size() ? s_eventStack.top() : NULL;
 }
 
@@ -1214,42 +1687,15 @@ bool SetHandler(const char* id, EventCallback& handler)
 
 bool RemoveHandler(const char* id, EventCallback& handler)
 {
-	ScopedLock lock(s_criticalSection);
-
 	eEventID eventType = EventIDForString(id);
 	bool bRemovedAtLeastOne = false;
-	if (eventType < kEventID_MAX && s_eventInfos[eventType].callbacks) {
-		CallbackList* callbacks = s_eventInfos[eventType].callbacks;
-		for (CallbackList::iterator iter = callbacks->begin(); iter != callbacks->end(); ) {
-			if (iter->script == handler.script) {
-				bool bMatches = true;
-				if (handler.object && handler.object != iter->object) {
-					bMatches = false;
-				}
-				else if (handler.source && handler.source != iter->source) {
-					bMatches = false;
-				}
-
-				if (bMatches) {
-					if (iter->IsInUse()) {
-						// this handler is currently active, flag it for later removal
-						iter->SetRemoved(true);
-						++iter;
-					}
-					else {
-						iter = callbacks->erase(iter);
-					}
-
-					bRemovedAtLeastOne = true;
-				}
-				else {
-					++iter;
-				}
-			}
-			else {
-				++iter;
-			}
-		}
+	if (eventType < kEventID_MAX) {
+		s_handlerLock.StartWrite();
+
+		if (s_eventInfos[eventType].callbacks)
+			bRemovedAtLeastOne = s_eventInfos[eventType].callbacks->Remove(handler);
+
+		s_handlerLock.EndWrite();
 	}
 	
 	return bRemovedAtLeastOne;
@@ -1289,41 +1735,47 @@ void __stdcall HandleGameEvent(UInt32 eventMask, TESObjectREFR* source, TESForm*
 		return;
 	}
 
-	ScopedLock lock(s_criticalSection);
+	eEventID eventID = kEventID_MAX;
 
-	// ScriptEventList can be marked more than once per event, cheap check to prevent sending duplicate events to scripts
-	if (source != s_lastObj || object != s_lastTarget || eventMask != s_lastEvent) {
-		s_lastObj = source;
-		s_lastEvent = eventMask;
-		s_lastTarget = object;
-	}
-	else {
-		// duplicate event, ignore it
-		return;
+	{
+		// the lock guards the duplicate checks only, handlers may raise further events
+		ScopedLock lock(s_criticalSection);
+
+		// ScriptEventList can be marked more than once per event, cheap check to prevent sending duplicate events to scripts
+		if (source != s_lastObj || object != s_lastTarget || eventMask != s_lastEvent) {
+			s_lastObj = source;
+			s_lastEvent = eventMask;
+			s_lastTarget = object;
+		}
+		else {
+			// duplicate event, ignore it
+			return;
+		}
+
+		eventID = EventIDForMask(eventMask);
+		if (eventID == kEventID_OnHitWith) {
+			// special check for OnHitWith, since it gets called redundantly
+			if (source == s_lastOnHitWithActor && object == s_lastOnHitWithWeapon)
+				return;
+
+			s_lastOnHitWithActor = source;
+			s_lastOnHitWithWeapon = object;
+		}
+		else if (eventID == kEventID_OnHit) {
+			if (source == s_lastOnHitVictim && object == s_lastOnHitAttacker)
+				return;
+
+			s_lastOnHitVictim = source;
+			s_lastOnHitAttacker = object;
+		}
 	}
 
-	eEventID eventID = EventIDForMask(eventMask);
 	if (eventID < kEventID_MAX) {
 		// special-case OnMagicEffectHit
 		if (eventID == kEventID_OnMagicEffectHit) {
 			EffectSetting* setting = OBLIVION_CAST(object, TESForm, EffectSetting);
 			HandleEvent(eventID, source, setting ? (void*)setting->effectCode : 0);
 		}
-		else if (eventID == kEventID_OnHitWith) {
-			// special check for OnHitWith, since it gets called redundantly
-			if (source != s_lastOnHitWithActor || object != s_lastOnHitWithWeapon) {
-				s_lastOnHitWithActor = source;
-				s_lastOnHitWithWeapon = object;
-				HandleEvent(eventID, source, object);
-			}
-		}
-		else if (eventID == kEventID_OnHit) {
-			if (source != s_lastOnHitVictim || object != s_lastOnHitAttacker) {
-				s_lastOnHitVictim = source;
-				s_lastOnHitAttacker = object;
-				HandleEvent(eventID, source, object);
-			}
-		}
 		else
 			HandleEvent(eventID, source, object);
 	}
@@ -1346,42 +1798,37 @@ EventInfo::~EventInfo()
 
 void Tick()
 {
-	ScopedLock lock(s_criticalSection);
+	// handle deferred events. Calls queued by the handlers themselves wait for the next Tick()
+	s_deferredQueue.Drain(InvokeDeferredCallback);
 
-	// handle deferred events
-	if (s_deferredCallbacks.size()) {
-		std::list< std::list<DeferredCallback>::iterator > s_removedCallbacks;
-
-		std::list<DeferredCallback>::iterator iter = s_deferredCallbacks.begin();
-		while (iter != s_deferredCallbacks.end()) {
-			if (!iter->iterator->IsRemoved()) {
-				s_eventStack.push(iter->eventInfo->name);
-				ScriptToken* result = UserFunctionManager::Call(
-					EventHandlerCaller(iter->iterator->script, iter->eventInfo, iter->arg0, iter->arg1, iter->callingObj));
-				s_eventStack.pop();
-
-				if (iter->iterator->IsRemoved()) {
-					s_removedCallbacks.push_back(iter);
-					++iter;
-				}
-				else {
-					iter = s_deferredCallbacks.erase(iter);
-				}
-
-				// result is unused
-				delete result;
-			}
-		}
+	s_coalescedCalls.clear();
+
+	// report callbacks dropped since the last Tick()
+	static UInt32 s_numDroppedReported = 0;
+
+	DeferredQueueStats stats;
+	s_deferredQueue.GetStats(&stats);
+	if (stats.numDropped != s_numDroppedReported) {
+		_MESSAGE("EventManager: deferred event queue full, dropped %d handler calls (%d dropped of %d queued, peak depth %d)",
+			stats.numDropped - s_numDroppedReported, stats.numDropped, stats.numQueued + stats.numDropped, stats.peakDepth);
+		s_numDroppedReported = stats.numDropped;
+	}
+
+	// get rid of any handlers removed while in use
+	if (s_bPurgeCallbacks) {
+		s_handlerLock.StartWrite();
 
-		// get rid of any handlers removed during processing above
-		while (s_removedCallbacks.size()) {
-			(*s_removedCallbacks.begin())->eventInfo->callbacks->erase(iter->iterator);
-			s_removedCallbacks.pop_front();
+		s_bPurgeCallbacks = false;
+		for (UInt32 i = 0; i < kEventID_MAX; i++) {
+			if (s_eventInfos[i].callbacks && s_eventInfos[i].callbacks->Purge())
+				s_bPurgeCallbacks = true;
 		}
 
-		s_deferredCallbacks.clear();
+		s_handlerLock.EndWrite();
 	}
 
+	ScopedLock lock(s_criticalSection);
+
 	s_lastObj = NULL;
 	s_lastTarget = NULL;
 	s_lastEvent = NULL;
@@ -82,13 +82,14 @@ namespace EventManager
 	struct EventCallback
 	{
 		EventCallback(Script* funcScript, TESObjectREFR* sourceFilter = NULL, TESForm* objectFilter = NULL, TESObjectREFR* thisObj = NULL)
-			: script(funcScript), source(sourceFilter), object(objectFilter), callingObj(thisObj), flags(0) { }
+			: script(funcScript), source(sourceFilter), object(objectFilter), callingObj(thisObj), flags(0), sequence(0), useCount(0),
+			  rateLimit(0), lastCallTime(0), numSuppressed(0) { }
 		~EventCallback() { }
 
 		
 		enum {
 			kFlag_Removed		= 1 << 0,		// set when RemoveEventHandler called while handler is in use
-			kFlag_InUse			= 1 << 1,		// is in use by HandleEvent (so removing it would invalidate an iterator)
+			kFlag_Coalesce		= 1 << 1,		// invoked at most once per frame for the same event arguments
 		};
 
 		Script			* script;
@@ -96,11 +97,19 @@ namespace EventManager
 		TESForm			* object;				// second arg to handler
 		TESObjectREFR	* callingObj;			// invoking object for handler
 		UInt8			flags;
+		UInt32			sequence;				// order of registration, matching handlers are invoked in this order
+		volatile LONG	useCount;				// pending invocations, possibly on other threads. Handler can't be freed while in use
+		UInt32			rateLimit;				// minimum milliseconds between invocations, 0 if not limited
+		UInt32			lastCallTime;			// GetTickCount() at last invocation
+		UInt32			numSuppressed;			// invocations skipped by coalescing or rate limiting
 
-		bool IsInUse() const { return flags & kFlag_InUse ? true : false; }
+		bool IsInUse() const { return useCount != 0; }
 		bool IsRemoved() const { return flags & kFlag_Removed ? true : false; }
-		void SetInUse(bool bSet) { flags = bSet ? flags | kFlag_InUse : flags & ~kFlag_InUse; }
+		void AddUse() { InterlockedIncrement(&useCount); }
+		void ReleaseUse() { InterlockedDecrement(&useCount); }
 		void SetRemoved(bool bSet) { flags = bSet ? flags | kFlag_Removed : flags & ~kFlag_Removed; }
+		bool IsCoalesced() const { return flags & kFlag_Coalesce ? true : false; }
+		void SetCoalesced(bool bSet) { flags = bSet ? flags | kFlag_Coalesce : flags & ~kFlag_Coalesce; }
 		bool Equals(const EventCallback& rhs) const;	// compare, return true if the two handlers are identical
 	};
 
@@ -121,6 +130,22 @@ namespace EventManager
 	// name of whatever event is currently being handled
 	const char* GetCurrentEventName();
 
+	// events raised outside the main thread are queued for Tick(), which invokes every call queued before it started
+	// the queue holds a fixed number of calls, a call raised while it is full is dropped and counted
+	struct DeferredQueueStats
+	{
+		UInt32	capacity;		// handler calls the queue can hold
+		UInt32	numQueued;		// handler calls queued since startup
+		UInt32	numDropped;		// handler calls dropped because the queue was full
+		UInt32	peakDepth;		// most handler calls waiting at once
+		UInt32	numPending;		// handler calls waiting for the next Tick()
+	};
+
+	void GetDeferredQueueStats(DeferredQueueStats* out);
+
+	// prints registered handlers and invocations suppressed by coalescing or rate limiting to the console
+	void PrintHandlerInfo();
+
 	// called each frame to update internal state
 	void Tick();
 };
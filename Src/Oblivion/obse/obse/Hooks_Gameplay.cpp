@@ -20,6 +20,7 @@
 #include "EventManager.h"
 #include "Hooks_SaveLoad.h"
 #include "GameActorValues.h"
+#include "ScriptTokens.h"
 
 static void HandleMainLoopHook(void);
 
@@ -341,6 +342,9 @@ static void HandleNewGameHook(void)
 
 DWORD g_mainThreadID = 0;
 
+// microseconds per frame spent deleting unreferenced arrays and strings
+static const UInt32 kGarbageCollectionBudget = 500;
+
 static void HandleMainLoopHook(void)
 {
 	static bool s_recordedMainThreadID = false;
@@ -352,9 +356,9 @@ static void HandleMainLoopHook(void)
 	// Hook_Memory_CheckAllocs(); not currently used
 	// DoDeferredEnable(); not currently used
 
-	// clean up any temp arrays/strings
-	g_ArrayMap.Clean();
-	g_StringMap.Clean();
+	// clean up any temp arrays/strings, releasing large nested arrays over several frames
+	g_ArrayMap.Collect(kGarbageCollectionBudget);
+	g_StringMap.DeleteTemporaries(kGarbageCollectionBudget);
 
 	// delete any refs queued for deletion by DeleteReference command
 	// ###TODO: make this a Task
@@ -370,6 +374,9 @@ static void HandleMainLoopHook(void)
 
 	// Tick event manager
 	EventManager::Tick();
+
+	ScriptTokenPool::EndFrame();
+	g_scriptCommands.EndFrame();
 }
 
 // workaround for inability to take address of __thiscall functions
@@ -36,65 +36,29 @@ ArrayIterLoop::ArrayIterLoop(const ForEachContext* context, UInt8 modIndex)
 	g_ArrayMap.RemoveReference(&m_iterVar->data, modIndex);
 	g_ArrayMap.AddReference(&m_iterVar->data, context->iteratorID, 0xFF);
 
-	ArrayElement elem;
-	ArrayKey key;
-
-	if (g_ArrayMap.GetFirstElement(m_srcID, &elem, &key))
-	{
-		m_curKey = key;
-		UpdateIterator(&elem);		// initialize iterator to first element in array
-	}
+	if (g_ArrayMap.BeginCursor(m_srcID, &m_cursor))
+		UpdateIterator();		// initialize iterator to first element in array
 }
 
-void ArrayIterLoop::UpdateIterator(const ArrayElement* elem)
-{
-	std::string val("value");
-	std::string key("key");
+// string keys are not pooled until stored, so these don't depend on the string pool being constructed first
+static const ArrayKey s_valueKey("value");
+static const ArrayKey s_keyKey("key");
 
-	// iter["value"] = element data
-	switch (elem->DataType())
-	{
-	case kDataType_String:
-		g_ArrayMap.SetElementString(m_iterID, val, elem->m_data.str);
-		break;
-	case kDataType_Numeric:
-		g_ArrayMap.SetElementNumber(m_iterID, val, elem->m_data.num);
-		break;
-	case kDataType_Form:
-		{
-			g_ArrayMap.SetElementFormID(m_iterID, val, elem->m_data.formID);
-			break;
-		}
-	case kDataType_Array:
-		{
-			ArrayID arrID = elem->m_data.num;
-			g_ArrayMap.SetElementArray(m_iterID, val, arrID);
-			break;
-		}
-	default:
-		DEBUG_PRINT("ArrayIterLoop::UpdateIterator(): unknown datatype %d found for element value", elem->DataType());
-	}
+void ArrayIterLoop::UpdateIterator()
+{
+	// iter["value"] = element data, iter["key"] = element key
+	// the element is assigned in place, strings are shared with the source array
+	if (!g_ArrayMap.SetElement(m_iterID, s_valueKey, m_cursor.GetElement()))
+		DEBUG_PRINT("ArrayIterLoop::UpdateIterator(): unknown datatype %d found for element value", m_cursor.GetElement().DataType());
 
-	// iter["key"] = element key
-	switch (m_curKey.KeyType())
-	{
-	case kDataType_String:
-		g_ArrayMap.SetElementString(m_iterID, key, m_curKey.Key().str);
-		break;
-	default:
-		g_ArrayMap.SetElementNumber(m_iterID, key, m_curKey.Key().num);
-	}
+	g_ArrayMap.SetElementFromKey(m_iterID, s_keyKey, m_cursor.GetKey());
 }
 
 bool ArrayIterLoop::Update(COMMAND_ARGS)
 {
-	ArrayElement elem;
-	ArrayKey key;
-
-	if (g_ArrayMap.GetNextElement(m_srcID, &m_curKey, &elem, &key))
+	if (g_ArrayMap.AdvanceCursor(m_srcID, &m_cursor))
 	{
-		m_curKey = key;
-		UpdateIterator(&elem);	
+		UpdateIterator();
 		return true;
 	}
 
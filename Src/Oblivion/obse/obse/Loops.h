@@ -45,10 +45,10 @@ class ArrayIterLoop : public ForEachLoop
 {
 	ArrayID					m_srcID;
 	ArrayID					m_iterID;
-	ArrayKey				m_curKey;
+	ArrayCursor				m_cursor;
 	ScriptEventList::Var	* m_iterVar;
 
-	void UpdateIterator(const ArrayElement* elem);
+	void UpdateIterator();
 public:
 	ArrayIterLoop(const ForEachContext* context, UInt8 modIndex);
 	virtual ~ArrayIterLoop();
@@ -1,5 +1,6 @@
 #include "ScriptTokens.h"
 #include "ScriptUtils.h"
+#include "common/IMemPool.h"
 
 #ifdef DBG_EXPR_LEAKS
 	SInt32 TOKEN_COUNT = 0;
@@ -11,11 +12,100 @@
 
 ScriptToken::~ScriptToken()
 {
+	ReleaseString();
 #ifdef DBG_EXPR_LEAKS
 	TOKEN_COUNT--;
 #endif
 }
 
+/*************************************
+
+	ScriptTokenPool
+
+*************************************/
+
+template <UInt32 blockSize>
+struct TokenBlock
+{
+	union {
+		double	align;
+		UInt8	data[blockSize];
+	};
+};
+
+template <typename T, typename U>
+struct LargerOf
+{
+	enum { kSize = sizeof(T) > sizeof(U) ? sizeof(T) : sizeof(U) };
+};
+
+// the derived tokens vary little in size so a single block size covers all of them
+enum {
+	kTokenBlockSize_Small = sizeof(ScriptToken),
+#if OBLIVION
+	kTokenBlockSize_Large = LargerOf<SliceToken, LargerOf<PairToken, LargerOf<ArrayElementToken, LargerOf<ForEachContextToken,
+		LargerOf<AssignableStringVarToken, AssignableStringArrayElementToken> > > > >::kSize,
+#else
+	kTokenBlockSize_Large = LargerOf<SliceToken, PairToken>::kSize,
+#endif
+
+	kNumTokenBlocks_Small = 0x800,
+	kNumTokenBlocks_Large = 0x200,
+};
+
+typedef IThreadSafeBasicMemPool<TokenBlock<kTokenBlockSize_Small>, kNumTokenBlocks_Small>	SmallTokenPool;
+typedef IThreadSafeBasicMemPool<TokenBlock<kTokenBlockSize_Large>, kNumTokenBlocks_Large>	LargeTokenPool;
+
+static SmallTokenPool			s_smallTokenPool;
+static LargeTokenPool			s_largeTokenPool;
+static ScriptTokenPool::Stats	s_tokenPoolLastFrame = { 0 };
+
+// tokens can be created off the main thread, so the counters are updated atomically
+static volatile LONG			s_tokenPoolPooled = 0;
+static volatile LONG			s_tokenPoolHeap = 0;
+
+void* ScriptTokenPool::Allocate(size_t size)
+{
+	void* p = NULL;
+	if (size <= kTokenBlockSize_Small)
+		p = s_smallTokenPool.Allocate();
+	if (!p && size <= kTokenBlockSize_Large)
+		p = s_largeTokenPool.Allocate();
+
+	if (p)
+		InterlockedIncrement(&s_tokenPoolPooled);
+	else
+	{
+		InterlockedIncrement(&s_tokenPoolHeap);
+		p = ::operator new(size);
+	}
+
+	return p;
+}
+
+void ScriptTokenPool::Free(void* p)
+{
+	if (!p)
+		return;
+	else if (s_smallTokenPool.Contains(p))
+		s_smallTokenPool.Free((TokenBlock<kTokenBlockSize_Small>*)p);
+	else if (s_largeTokenPool.Contains(p))
+		s_largeTokenPool.Free((TokenBlock<kTokenBlockSize_Large>*)p);
+	else
+		::operator delete(p);
+}
+
+void ScriptTokenPool::EndFrame()
+{
+	s_tokenPoolLastFrame.pooled = InterlockedExchange(&s_tokenPoolPooled, 0);
+	s_tokenPoolLastFrame.heap = InterlockedExchange(&s_tokenPoolHeap, 0);
+}
+
+const ScriptTokenPool::Stats& ScriptTokenPool::LastFrame()
+{
+	return s_tokenPoolLastFrame;
+}
+
 /*************************************
 
 	ScriptToken constructors
@@ -23,53 +113,106 @@ ScriptToken::~ScriptToken()
 *************************************/
 
 // ScriptToken
-ScriptToken::ScriptToken() : type(kTokenType_Invalid), refIdx(0), variableType(Script::eVarType_Invalid)
+ScriptToken::ScriptToken() : type(kTokenType_Invalid), refIdx(0), variableType(Script::eVarType_Invalid), strStorage(kStrStorage_None)
 {
 	INC_TOKEN_COUNT
 	value.num = 0;
 }
 
-ScriptToken::ScriptToken(Token_Type _type, UInt8 _varType, UInt16 _refIdx) : type(_type), variableType(_varType), refIdx(_refIdx) 
+ScriptToken::ScriptToken(Token_Type _type, UInt8 _varType, UInt16 _refIdx) : type(_type), variableType(_varType), strStorage(kStrStorage_None), refIdx(_refIdx)
 { 
 	INC_TOKEN_COUNT
 }
-ScriptToken::ScriptToken(bool boolean) : type(kTokenType_Boolean), refIdx(0), variableType(Script::eVarType_Invalid)
+ScriptToken::ScriptToken(bool boolean) : type(kTokenType_Boolean), refIdx(0), variableType(Script::eVarType_Invalid), strStorage(kStrStorage_None)
 {
 	INC_TOKEN_COUNT
 	value.num = boolean ? 1 : 0;
 }
 
-ScriptToken::ScriptToken(double num) : type(kTokenType_Number), refIdx(0), variableType(Script::eVarType_Invalid)
+ScriptToken::ScriptToken(double num) : type(kTokenType_Number), refIdx(0), variableType(Script::eVarType_Invalid), strStorage(kStrStorage_None)
 {
 	INC_TOKEN_COUNT
 	value.num = num;
 }
 
-ScriptToken::ScriptToken(Script::RefVariable* refVar, UInt16 refIdx) : type(kTokenType_Ref), refIdx(refIdx), variableType(Script::eVarType_Invalid)
+ScriptToken::ScriptToken(Script::RefVariable* refVar, UInt16 refIdx) : type(kTokenType_Ref), refIdx(refIdx), variableType(Script::eVarType_Invalid), strStorage(kStrStorage_None)
 {
 	INC_TOKEN_COUNT
 	value.refVar = refVar;
 }
 
-ScriptToken::ScriptToken(const std::string& str) : type(kTokenType_String), refIdx(0), variableType(Script::eVarType_Invalid)
+ScriptToken::ScriptToken(const std::string& str) : type(kTokenType_String), refIdx(0), variableType(Script::eVarType_Invalid), strStorage(kStrStorage_None)
 {
 	INC_TOKEN_COUNT
-	value.str = str;
+	SetString(str.c_str(), str.length());
 }
 
-ScriptToken::ScriptToken(const char* str) : type(kTokenType_String), refIdx(0), variableType(Script::eVarType_Invalid)
+ScriptToken::ScriptToken(const char* str) : type(kTokenType_String), refIdx(0), variableType(Script::eVarType_Invalid), strStorage(kStrStorage_None)
 {
 	INC_TOKEN_COUNT
-	value.str = str;
+	SetString(str, str ? strlen(str) : 0);
+}
+
+void ScriptToken::SetString(const char* str, UInt32 len)
+{
+	// the inline buffer is the largest member of value, anything bigger grows every token and pool block
+	STATIC_ASSERT(sizeof(Value) == kShortStrLen + 1);
+
+	ReleaseString();
+
+	char* dest = value.shortStr;
+	strStorage = kStrStorage_Inline;
+	if (len > kShortStrLen)
+	{
+#if OBLIVION
+		value.sharedStr = ArrayString::Create(str, len);
+		strStorage = kStrStorage_Shared;
+		return;
+#else
+		dest = value.str = new char[len + 1];
+		strStorage = kStrStorage_Heap;
+#endif
+	}
+
+	if (len)
+		memcpy(dest, str, len);
+	dest[len] = 0;
+}
+
+#if OBLIVION
+void ScriptToken::SetString(ArrayString* str)
+{
+	if (str->length() <= kShortStrLen)
+		SetString(str->c_str(), str->length());
+	else
+	{
+		str->AddRef();
+		ReleaseString();
+		value.sharedStr = str;
+		strStorage = kStrStorage_Shared;
+	}
+}
+#endif
+
+void ScriptToken::ReleaseString()
+{
+	if (strStorage == kStrStorage_Heap)
+		delete[] value.str;
+#if OBLIVION
+	else if (strStorage == kStrStorage_Shared)
+		value.sharedStr->Release();
+#endif
+
+	strStorage = kStrStorage_None;
 }
 
-ScriptToken::ScriptToken(TESGlobal* global, UInt16 refIdx) : type(kTokenType_Global), refIdx(refIdx), variableType(Script::eVarType_Invalid)
+ScriptToken::ScriptToken(TESGlobal* global, UInt16 refIdx) : type(kTokenType_Global), refIdx(refIdx), variableType(Script::eVarType_Invalid), strStorage(kStrStorage_None)
 {
 	INC_TOKEN_COUNT
 	value.global = global;
 }
 
-ScriptToken::ScriptToken(UInt32 id, Token_Type asType) : refIdx(0), type(asType), variableType(Script::eVarType_Invalid)
+ScriptToken::ScriptToken(UInt32 id, Token_Type asType) : refIdx(0), type(asType), variableType(Script::eVarType_Invalid), strStorage(kStrStorage_None)
 {
 	INC_TOKEN_COUNT
 	switch (asType)
@@ -88,13 +231,13 @@ ScriptToken::ScriptToken(UInt32 id, Token_Type asType) : refIdx(0), type(asType)
 	}
 }
 
-ScriptToken::ScriptToken(Operator* op) : type(kTokenType_Operator), refIdx(0), variableType(Script::eVarType_Invalid)
+ScriptToken::ScriptToken(Operator* op) : type(kTokenType_Operator), refIdx(0), variableType(Script::eVarType_Invalid), strStorage(kStrStorage_None)
 {
 	INC_TOKEN_COUNT
 	value.op = op;
 }
 
-ScriptToken::ScriptToken(Script::VariableInfo* varInfo, UInt16 refIdx, UInt32 varType) : refIdx(refIdx), variableType(varType)
+ScriptToken::ScriptToken(Script::VariableInfo* varInfo, UInt16 refIdx, UInt32 varType) : refIdx(refIdx), variableType(varType), strStorage(kStrStorage_None)
 {
 	INC_TOKEN_COUNT
 	value.varInfo = varInfo;
@@ -118,7 +261,7 @@ ScriptToken::ScriptToken(Script::VariableInfo* varInfo, UInt16 refIdx, UInt32 va
 	}
 }
 
-ScriptToken::ScriptToken(CommandInfo* cmdInfo, UInt16 refIdx) : type(kTokenType_Command), refIdx(refIdx), variableType(Script::eVarType_Invalid)
+ScriptToken::ScriptToken(CommandInfo* cmdInfo, UInt16 refIdx) : type(kTokenType_Command), refIdx(refIdx), variableType(Script::eVarType_Invalid), strStorage(kStrStorage_None)
 {
 	INC_TOKEN_COUNT
 	value.cmd = cmdInfo;
@@ -126,7 +269,7 @@ ScriptToken::ScriptToken(CommandInfo* cmdInfo, UInt16 refIdx) : type(kTokenType_
 
 #if OBLIVION
 // ###TODO: Read() sets variable type; better to pass it to this constructor
-ScriptToken::ScriptToken(ScriptEventList::Var* var) : refIdx(0), type(kTokenType_Variable), variableType(Script::eVarType_Invalid)
+ScriptToken::ScriptToken(ScriptEventList::Var* var) : refIdx(0), type(kTokenType_Variable), variableType(Script::eVarType_Invalid), strStorage(kStrStorage_None)
 {
 	INC_TOKEN_COUNT
 	value.var = var;
@@ -325,7 +468,22 @@ const char* ScriptToken::GetString() const
 	const char* result = NULL;
 
 	if (type == kTokenType_String)
-		result = value.str.c_str();
+	{
+		switch (strStorage)
+		{
+		case kStrStorage_Inline:
+			result = value.shortStr;
+			break;
+		case kStrStorage_Heap:
+			result = value.str;
+			break;
+#if OBLIVION
+		case kStrStorage_Shared:
+			result = value.sharedStr->c_str();
+			break;
+#endif
+		}
+	}
 #if OBLIVION
 	else if (type == kTokenType_StringVar && value.var)
 	{
@@ -571,40 +729,141 @@ ScriptToken* ScriptToken::Read(ExpressionEvaluator* context)
 	return NULL;
 }
 
-Token_Type ScriptToken::ReadFrom(ExpressionEvaluator* context)
+ScriptToken* ScriptToken::Read(const DecodedToken& decoded, ExpressionEvaluator* context)
+{
+	ScriptToken* newToken = new ScriptToken();
+	if (newToken->ReadFrom(decoded, context) != kTokenType_Invalid)
+		return newToken;
+
+	delete newToken;
+	return NULL;
+}
+
+static UInt16 ReadCompiled16(UInt8*& data)
+{
+	UInt16 val = *((UInt16*)data);
+	data += 2;
+	return val;
+}
+
+DecodedToken::DecodedToken(const DecodedToken& rhs) : typeCode(rhs.typeCode), variableType(rhs.variableType), refIdx(rhs.refIdx),
+	varIdx(rhs.varIdx), endOffset(rhs.endOffset), num(rhs.num), cmd(rhs.cmd), str(rhs.str)
+{
+	if (str)
+		str->AddRef();
+}
+
+DecodedToken& DecodedToken::operator=(const DecodedToken& rhs)
+{
+	if (rhs.str)
+		rhs.str->AddRef();
+	if (str)
+		str->Release();
+
+	typeCode = rhs.typeCode;
+	variableType = rhs.variableType;
+	refIdx = rhs.refIdx;
+	varIdx = rhs.varIdx;
+	endOffset = rhs.endOffset;
+	num = rhs.num;
+	cmd = rhs.cmd;
+	str = rhs.str;
+	return *this;
+}
+
+DecodedToken::~DecodedToken()
 {
-	UInt8 typeCode = context->ReadByte();
+	if (str)
+		str->Release();
+}
+
+bool DecodedToken::Decode(UInt8*& data)
+{
+	typeCode = *data++;
 
 	switch (typeCode)
 	{
 	case 'B':
 	case 'b':
-		type = kTokenType_Number;
-		value.num = context->ReadByte();
+		num = *data++;
 		break;
 	case 'I':
 	case 'i':
-		type = kTokenType_Number;
-		value.num = context->Read16();
+		num = ReadCompiled16(data);
 		break;
 	case 'L':
 	case 'l':
-		type = kTokenType_Number;
-		value.num = context->Read32();
+		num = *((UInt32*)data);
+		data += 4;
 		break;
 	case 'Z':
-		type = kTokenType_Number;
-		value.num = context->ReadFloat();
+		num = *((double*)data);
+		data += sizeof(double);
 		break;
 	case 'S':
 		{
-			type = kTokenType_String;
-			value.str = context->ReadString();
+			UInt16 len = ReadCompiled16(data);
+			if (str)
+				str->Release();
+			str = ArrayString::Intern((const char*)data, len);
+			data += len;
 			break;
 		}
+	case 'R':
+	case 'G':
+		refIdx = ReadCompiled16(data);
+		break;
+	case 'X':
+		refIdx = ReadCompiled16(data);
+		varIdx = ReadCompiled16(data);
+		cmd = g_scriptCommands.GetByOpcode(varIdx);
+		break;
+	case 'V':
+		variableType = *data++;
+		refIdx = ReadCompiled16(data);
+		varIdx = ReadCompiled16(data);
+		break;
+	default:
+		return typeCode < kOpType_Max;
+	}
+
+	return true;
+}
+
+Token_Type ScriptToken::ReadFrom(ExpressionEvaluator* context)
+{
+	DecodedToken decoded;
+	if (!decoded.Decode(context->Data()))
+	{
+		context->Error("Unexpected token type %d (%02x) encountered", decoded.typeCode, decoded.typeCode);
+		type = kTokenType_Invalid;
+		return type;
+	}
+
+	return ReadFrom(decoded, context);
+}
+
+Token_Type ScriptToken::ReadFrom(const DecodedToken& decoded, ExpressionEvaluator* context)
+{
+	switch (decoded.typeCode)
+	{
+	case 'B':
+	case 'b':
+	case 'I':
+	case 'i':
+	case 'L':
+	case 'l':
+	case 'Z':
+		type = kTokenType_Number;
+		value.num = decoded.num;
+		break;
+	case 'S':
+		type = kTokenType_String;
+		SetString(decoded.str);
+		break;
 	case 'R':
 		type = kTokenType_Ref;
-		refIdx = context->Read16();
+		refIdx = decoded.refIdx;
 		value.refVar = context->script->GetVariable(refIdx);
 		if (!value.refVar)
 			type = kTokenType_Invalid;
@@ -618,7 +877,7 @@ Token_Type ScriptToken::ReadFrom(ExpressionEvaluator* context)
 	case 'G':
 		{
 			type = kTokenType_Global;
-			refIdx = context->Read16();
+			refIdx = decoded.refIdx;
 			Script::RefVariable* refVar = context->script->GetVariable(refIdx);
 			if (!refVar)
 			{
@@ -632,18 +891,15 @@ Token_Type ScriptToken::ReadFrom(ExpressionEvaluator* context)
 			break;
 		}
 	case 'X':
-		{
-			type = kTokenType_Command;
-			refIdx = context->Read16();
-			UInt16 opcode = context->Read16();
-			value.cmd = g_scriptCommands.GetByOpcode(opcode);
-			if (!value.cmd)
-				type = kTokenType_Invalid;
-			break;
-		}
+		type = kTokenType_Command;
+		refIdx = decoded.refIdx;
+		value.cmd = decoded.cmd;
+		if (!value.cmd)
+			type = kTokenType_Invalid;
+		break;
 	case 'V':
 		{
-			variableType = context->ReadByte();
+			variableType = decoded.variableType;
 			switch (variableType)
 			{
 			case Script::eVarType_Array:
@@ -663,7 +919,7 @@ Token_Type ScriptToken::ReadFrom(ExpressionEvaluator* context)
 				type = kTokenType_Invalid;
 			}
 
-			refIdx = context->Read16();
+			refIdx = decoded.refIdx;
 
 			ScriptEventList* eventList = context->eventList;
 			if (refIdx)
@@ -677,28 +933,17 @@ Token_Type ScriptToken::ReadFrom(ExpressionEvaluator* context)
 				}
 			}
 
-			UInt16 varIdx = context->Read16();
 			value.var = NULL;
 			if (eventList)
-				value.var = eventList->GetVariable(varIdx);
+				value.var = eventList->GetVariable(decoded.varIdx);
 
 			if (!value.var)
 				type = kTokenType_Invalid;
 			break;
 		}
 	default:
-		{
-			if (typeCode < kOpType_Max)
-			{
-				type = kTokenType_Operator;
-				value.op =  &s_operators[typeCode];
-			}
-			else
-			{
-				context->Error("Unexpected token type %d (%02x) encountered", typeCode, typeCode);
-				type = kTokenType_Invalid;
-			}
-		}
+		type = kTokenType_Operator;
+		value.op = &s_operators[decoded.typeCode];
 	}
 
 	return type;
@@ -752,7 +997,7 @@ bool ScriptToken::Write(ScriptLineBuffer* buf)
 			}
 		}
 	case kTokenType_String:
-		return buf->WriteString(value.str.c_str());
+		return buf->WriteString(GetString());
 	case kTokenType_Ref:
 	case kTokenType_Global:
 		return buf->Write16(refIdx);
@@ -144,19 +144,72 @@ struct ForEachContext
 	ForEachContext(UInt32 src, UInt32 iter, UInt32 varType, ScriptEventList::Var* _var) : sourceID(src), iteratorID(iter), variableType(varType), var(_var) { }
 };
 
+// a compiled token with its operands parsed out of the script data but not yet resolved against
+// the calling script's variables. Decoded once per expression and reused, see ExpressionCache
+struct DecodedToken
+{
+	UInt8			typeCode;
+	UInt8			variableType;
+	UInt16			refIdx;
+	UInt16			varIdx;
+	UInt16			endOffset;		// offset of the following token from the start of the expression
+	double			num;
+	CommandInfo		* cmd;
+	ArrayString		* str;			// pooled, 'S' only
+
+	DecodedToken() : typeCode(0), variableType(Script::eVarType_Invalid), refIdx(0), varIdx(0), endOffset(0), num(0), cmd(NULL), str(NULL) { }
+	DecodedToken(const DecodedToken& rhs);
+	DecodedToken& operator=(const DecodedToken& rhs);
+	~DecodedToken();
+
+	// advances data past the token, returns false if the type code is unrecognized
+	bool Decode(UInt8*& data);
+};
+
 #endif
 
+// ScriptTokens are created and deleted constantly during expression evaluation. They are allocated from
+// fixed-size free lists rather than the global heap; tokens that don't fit a block, or are allocated
+// while the pools are exhausted, fall back to the heap.
+class ScriptTokenPool
+{
+public:
+	struct Stats
+	{
+		UInt32	pooled;		// allocations served from the pools
+		UInt32	heap;		// allocations which fell back to the heap
+	};
+
+	static void *	Allocate(size_t size);
+	static void		Free(void * p);
+
+	static void		EndFrame();					// called once per frame from the main loop
+	static const Stats&	LastFrame();			// counters for the previous frame
+};
+
 // slightly less ugly but still cheap polymorphism
 struct ScriptToken
 {
 protected:
+	enum {
+		kStrStorage_None = 0,		// value holds no string
+		kStrStorage_Inline,			// value.shortStr
+		kStrStorage_Heap,			// value.str, owned by the token
+		kStrStorage_Shared,			// value.sharedStr, a reference to an ArrayString, run-time only
+
+		kShortStrLen = 15,
+	};
+
 	Token_Type	type;
 	UInt8		variableType;
+	UInt8		strStorage;
 	UInt16		refIdx;
 
+	// only string tokens carry string data, short strings are stored in place
 	struct Value {
-		std::string					str;
 		union {
+			char					* str;
+			char					shortStr[kShortStrLen + 1];
 			Script::RefVariable		* refVar;
 			UInt32					formID;
 			double					num;
@@ -165,6 +218,7 @@ protected:
 #if OBLIVION		// run-time only
 			ArrayID					arrID;
 			ScriptEventList::Var	* var;
+			ArrayString				* sharedStr;
 #endif
 			// compile-time only
 			Script::VariableInfo	* varInfo;
@@ -187,14 +241,27 @@ protected:
 	ScriptToken(UInt32 data, Token_Type asType);		// ArrayID or FormID
 
 	ScriptToken(const ScriptToken& rhs);	// unimplemented, don't want copy constructor called
+	ScriptToken& operator=(const ScriptToken& rhs);	// unimplemented, value may own a string
+
+	void		SetString(const char* str, UInt32 len);
+	void		ReleaseString();
+#if OBLIVION
+	void		SetString(ArrayString* str);	// shares str unless short enough to store in place
+#endif
 #if OBLIVION
 	ScriptToken(ScriptEventList::Var* var);
 #endif
 
 	Token_Type	ReadFrom(ExpressionEvaluator* context);	// reconstitute param from compiled data, return the type
+#if OBLIVION
+	Token_Type	ReadFrom(const DecodedToken& decoded, ExpressionEvaluator* context);
+#endif
 public:
 	virtual	~ScriptToken();
 
+	static void *	operator new(size_t size)	{ return ScriptTokenPool::Allocate(size); }
+	static void		operator delete(void * p)	{ ScriptTokenPool::Free(p); }
+
 	virtual const char	*			GetString() const;
 	virtual UInt32					GetFormID() const;
 	virtual TESForm*				GetTESForm() const;
@@ -237,6 +304,9 @@ public:
 	double					GetNumericRepresentation(bool bFromHex);	// attempts to convert string to number
 
 	static ScriptToken* Read(ExpressionEvaluator* context);
+#if OBLIVION
+	static ScriptToken* Read(const DecodedToken& decoded, ExpressionEvaluator* context);
+#endif
 
 	static ScriptToken* Create(bool boolean)													{ return new ScriptToken(boolean); }
 	static ScriptToken* Create(double num)														{ return new ScriptToken(num);	}
@@ -2718,6 +2718,120 @@ void ShowRuntimeError(Script* script, const char* fmt, ...)
 	va_end(args);
 }
 
+/**********************************
+	ExpressionCache
+**********************************/
+
+ExpressionCache::~ExpressionCache()
+{
+	m_numActive = 0;
+	Clear();
+}
+
+ExpressionCache::Use::~Use()
+{
+	if (--m_cache->m_numActive)
+		return;
+
+	for (std::vector<DecodedExpression*>::iterator iter = m_cache->m_retired.begin(); iter != m_cache->m_retired.end(); ++iter)
+		delete *iter;
+
+	m_cache->m_retired.clear();
+}
+
+void ExpressionCache::Retire(DecodedExpression* expr)
+{
+	if (m_numActive)
+		m_retired.push_back(expr);
+	else
+		delete expr;
+}
+
+ExpressionCache* ExpressionCache::GetSingleton()
+{
+	ThreadLocalData& localData = ThreadLocalData::Get();
+	if (!localData.expressionCache) {
+		localData.expressionCache = new ExpressionCache();
+	}
+
+	return localData.expressionCache;
+}
+
+void ExpressionCache::Clear()
+{
+	for (CacheMap::iterator iter = m_cache.begin(); iter != m_cache.end(); ++iter)
+		Retire(iter->second);
+
+	m_cache.clear();
+}
+
+DecodedExpression* ExpressionCache::Decode(UInt8* exprData)
+{
+	UInt16 argLen = *((UInt16*)exprData);
+	UInt8* data = exprData + sizeof(UInt16);
+	UInt8* endData = exprData + argLen;
+
+	DecodedExpression* expr = new DecodedExpression();
+	while (data < endData)
+	{
+		expr->tokens.push_back(DecodedToken());
+		DecodedToken& token = expr->tokens.back();
+		if (!token.Decode(data))
+			break;
+
+		token.endOffset = data - exprData;
+
+		// skip command args, they are extracted by the command itself
+		if (token.typeCode == 'X')
+			data += *((UInt16*)data);
+	}
+
+	// anything we can't account for is left to the regular path which will report the error
+	if (data != endData)
+	{
+		delete expr;
+		return NULL;
+	}
+
+	expr->argLen = argLen;
+	return expr;
+}
+
+const DecodedExpression* ExpressionCache::Get(Script* script, UInt8* exprData)
+{
+	if (!script->refID)
+		return NULL;
+
+	UInt16 argLen = *((UInt16*)exprData);
+
+	CacheMap::iterator iter = m_cache.find(exprData);
+	if (iter != m_cache.end())
+	{
+		DecodedExpression* expr = iter->second;
+		if (expr->script == script && expr->refID == script->refID && expr->scriptData == script->data &&
+			expr->dataLength == script->info.dataLength && expr->argLen == argLen)
+			return expr;
+
+		Retire(expr);
+		m_cache.erase(iter);
+	}
+
+	DecodedExpression* expr = Decode(exprData);
+	if (expr)
+	{
+		if (m_cache.size() >= kMaxEntries)
+			Clear();
+
+		expr->script = script;
+		expr->refID = script->refID;
+		expr->scriptData = script->data;
+		expr->dataLength = script->info.dataLength;
+		m_cache[exprData] = expr;
+	}
+
+	return expr;
+}
+
 /**********************************
 	ExpressionEvaluator
 **********************************/
@@ -3301,12 +3415,27 @@ bool ExpressionEvaluator::ConvertDefaultArg(ScriptToken* arg, ParamInfo* info, b
 ScriptToken* ExpressionEvaluator::Evaluate()
 {
 	std::stack<ScriptToken*> operands;
-	
+
+	UInt8* exprData = Data();
+	ExpressionCache* cache = ExpressionCache::GetSingleton();
+	ExpressionCache::Use cacheUse(cache);
+	const DecodedExpression* decoded = cache->Get(script, exprData);
+	UInt32 decodedIdx = 0;
+
 	UInt16 argLen = Read16();
 	UInt8* endData = Data() + argLen - sizeof(UInt16);
 	while (Data() < endData)
 	{
-		ScriptToken* curToken = ScriptToken::Read(this);
+		ScriptToken* curToken = NULL;
+		if (decoded)
+		{
+			const DecodedToken& token = decoded->tokens[decodedIdx++];
+			Data() = exprData + token.endOffset;
+			curToken = ScriptToken::Read(token, this);
+		}
+		else
+			curToken = ScriptToken::Read(this);
+
 		if (!curToken)
 			break;
 
@@ -3346,6 +3475,7 @@ ScriptToken* ExpressionEvaluator::Evaluate()
 
 			ExpectReturnType(kRetnType_Default);	// expect default return type unless called command specifies otherwise
 
+			g_scriptCommands.RecordDispatch();
 			bool bExecuted = cmdInfo->execute(cmdInfo->params, scrData, callingObj, (UInt32)contObj, script, eventList, &cmdResult, &numBytesRead);
 
 			if (!bExecuted)
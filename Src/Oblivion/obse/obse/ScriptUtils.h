@@ -19,6 +19,7 @@ class FunctionCaller;
 
 #include "ScriptTokens.h"
 #include <stack>
+#include <hash_map>
 
 #if OBLIVION
 #include <cstdarg>
@@ -73,8 +74,66 @@ public:
 
 #define OBSE_EXPR_MAX_ARGS 20		// max # of args we'll accept to a commmand
 
+#if OBLIVION
+
+// a compiled expression split into its tokens, so Evaluate() needn't re-parse the script data each time it runs
+struct DecodedExpression
+{
+	// stamp of the script the expression was decoded from, recompiled or reused scripts won't match it
+	Script						* script;
+	UInt32						refID;
+	void						* scriptData;
+	UInt32						dataLength;
+	UInt16						argLen;
+
+	std::vector<DecodedToken>	tokens;
+};
+
+// per-thread cache of DecodedExpressions keyed by the address of the compiled expression
+// scripts without a formID (console and RunScriptLine scripts) are never cached as their storage is reused
+// entries are only freed once no Evaluate() is running on the thread, as the expression an outer Evaluate() is
+// reading may be evicted while a command it calls runs a nested one
+class ExpressionCache
+{
+	enum { kMaxEntries = 0x4000 };		// flushed when exceeded
+
+	typedef stdext::hash_map<UInt8*, DecodedExpression*>	CacheMap;
+
+	CacheMap							m_cache;
+	std::vector<DecodedExpression*>		m_retired;		// evicted while in use
+	UInt32								m_numActive;	// nested Evaluate() calls on this thread
+
+	static DecodedExpression* Decode(UInt8* exprData);
+
+	void Retire(DecodedExpression* expr);
+
+public:
+	ExpressionCache() : m_numActive(0) { }
+	~ExpressionCache();
+
+	static ExpressionCache* GetSingleton();
+
+	// held by Evaluate() while it uses an expression returned by Get()
+	class Use
+	{
+		ExpressionCache	* m_cache;
+	public:
+		Use(ExpressionCache* cache) : m_cache(cache) { m_cache->m_numActive++; }
+		~Use();
+	};
+
+	// exprData points to the length-prefixed compiled expression. Returns NULL if the expression can't be decoded
+	// or isn't cached. The result is valid until the outermost Use on this thread is released
+	const DecodedExpression* Get(Script* script, UInt8* exprData);
+	void Clear();
+};
+
+#endif
+
 class ExpressionEvaluator
 {
+	friend struct ScriptToken;
+
 	enum { kMaxArgs = OBSE_EXPR_MAX_ARGS };
 
 	enum {
@@ -5,6 +5,7 @@
 #include "GameAPI.h"
 #include <vector>
 #include "EventManager.h"
+#include "CoSaveWriter.h"
 
 // ### TODO: only create save file when something has registered a handler
 
@@ -13,62 +14,23 @@ namespace Serialization
 
 static UInt32	kObseOpcodeBase = 0x1400;
 
-// file format internals
-
-//	general format:
-//	Header			header
-//		PluginHeader	plugin[header.numPlugins]
-//			ChunkHeader		chunk[plugin.numChunks]
-//				UInt8			data[chunk.length]
-
-struct Header
-{
-	enum
-	{
-		kSignature =		MACRO_SWAP32('OBSE'),	// endian-swapping so the order matches
-		kVersion =			1,
-
-		kVersion_Invalid =	0
-	};
-
-	UInt32	signature;
-	UInt32	formatVersion;
-	UInt16	obseVersion;
-	UInt16	obseMinorVersion;
-	UInt32	oblivionVersion;
-	UInt32	numPlugins;
-};
-
-struct PluginHeader
-{
-	UInt32	opcodeBase;
-	UInt32	numChunks;
-	UInt32	length;		// length of following data including ChunkHeader
-};
-
-struct ChunkHeader
-{
-	UInt32	type;
-	UInt32	version;
-	UInt32	length;
-};
-
 // locals
 
 IFileStream	s_currentFile;
 
+static CoSaveWriter	s_saveWriter;
+
+// write to <name>.tmp then rename over the old co-save so a failed save can't leave a truncated file behind
+static bool			s_atomicSave = true;
+
 typedef std::vector <PluginCallbacks>	PluginCallbackList;
 PluginCallbackList	s_pluginCallbacks;
 
 PluginHandle	s_currentPlugin = 0;
 
-Header			s_fileHeader = { 0 };
-
-UInt64			s_pluginHeaderOffset = 0;
 PluginHeader	s_pluginHeader = { 0 };
 
 bool			s_chunkOpen = false;
-UInt64			s_chunkHeaderOffset = 0;
 ChunkHeader		s_chunkHeader = { 0 };
 
 bool			s_preloading = false;		// if true, we are reading co-save *before* savegame begins to load
@@ -108,6 +70,45 @@ static std::string ConvertSaveFileName(std::string name)
 	return result;
 }
 
+static bool WriteSaveBuffer(const std::string & savePath)
+{
+	std::string	writePath = s_atomicSave ? savePath + ".tmp" : savePath;
+
+	if(!s_currentFile.Create(writePath.c_str()))
+	{
+		_ERROR("HandleSaveGame: couldn't create save file (%s)", writePath.c_str());
+		return false;
+	}
+
+	bool	written = true;
+
+	try
+	{
+		s_currentFile.WriteBuf(s_saveWriter.Data(), s_saveWriter.Size());
+	}
+	catch(...)
+	{
+		_ERROR("HandleSaveGame: couldn't write save file (%s)", writePath.c_str());
+		written = false;
+	}
+
+	s_currentFile.Close();
+
+	if(!s_atomicSave)
+		return written;
+
+	if(written && !MoveFileEx(writePath.c_str(), savePath.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+	{
+		_ERROR("HandleSaveGame: couldn't replace save file (%s, error %08X)", savePath.c_str(), GetLastError());
+		written = false;
+	}
+
+	if(!written)
+		DeleteFile(writePath.c_str());
+
+	return written;
+}
+
 // plugin API
 void SetSaveCallback(PluginHandle plugin, OBSESerializationInterface::EventCallback callback)
 {
@@ -180,58 +181,16 @@ bool WriteRecord(UInt32 type, UInt32 version, const void * buf, UInt32 length)
 	return WriteRecordData(buf, length);
 }
 
-// flush a chunk header to the file if one is currently open
-static void FlushWriteChunk(void)
-{
-	if(!s_chunkOpen)
-		return;
-
-	UInt64	curOffset = s_currentFile.GetOffset();
-	UInt64	chunkSize = curOffset - s_chunkHeaderOffset - sizeof(s_chunkHeader);
-
-	ASSERT(chunkSize < 0x80000000);	// stupidity check
-
-	s_chunkHeader.length = (UInt32)chunkSize;
-
-	s_currentFile.SetOffset(s_chunkHeaderOffset);
-	s_currentFile.WriteBuf(&s_chunkHeader, sizeof(s_chunkHeader));
-
-	s_currentFile.SetOffset(curOffset);
-
-	s_pluginHeader.length += chunkSize + sizeof(s_chunkHeader);
-
-	s_chunkOpen = false;
-}
-
 bool OpenRecord(UInt32 type, UInt32 version)
 {
-	if(!s_pluginHeader.numChunks)
-	{
-		ASSERT(!s_chunkOpen);
-
-		s_pluginHeaderOffset = s_currentFile.GetOffset();
-		s_currentFile.Skip(sizeof(s_pluginHeader));
-	}
-
-	FlushWriteChunk();
-
-	s_chunkHeaderOffset = s_currentFile.GetOffset();
-	s_currentFile.Skip(sizeof(s_chunkHeader));
-
-	s_pluginHeader.numChunks++;
-
-	s_chunkHeader.type = type;
-	s_chunkHeader.version = version;
-	s_chunkHeader.length = 0;
-
-	s_chunkOpen = true;
+	s_saveWriter.OpenChunk(type, version);
 
 	return true;
 }
 
 bool WriteRecordData(const void * buf, UInt32 length)
 {
-	s_currentFile.WriteBuf(buf, length);
+	s_saveWriter.WriteData(buf, length);
 
 	return true;
 }
@@ -345,23 +304,11 @@ void HandleSaveGame(const char * path)
 	else
 #endif
 	{
-		if(!s_currentFile.Create(savePath.c_str()))
-		{
-			_ERROR("HandleSaveGame: couldn't create save file (%s)", savePath.c_str());
-			return;
-		}
+		bool	succeeded = true;
 
 		try
 		{
-			// init header
-			s_fileHeader.signature =		Header::kSignature;
-			s_fileHeader.formatVersion =	Header::kVersion;
-			s_fileHeader.obseVersion =		OBSE_VERSION_INTEGER;
-			s_fileHeader.obseMinorVersion =	OBSE_VERSION_INTEGER_MINOR;
-			s_fileHeader.oblivionVersion =	OBLIVION_VERSION;
-			s_fileHeader.numPlugins =		0;
-
-			s_currentFile.Skip(sizeof(s_fileHeader));
+			s_saveWriter.Begin(OBSE_VERSION_INTEGER, OBSE_VERSION_INTEGER_MINOR, OBLIVION_VERSION);
 
 			// iterate through plugins
 			for(UInt32 i = 0; i < s_pluginCallbacks.size(); i++)
@@ -371,48 +318,38 @@ void HandleSaveGame(const char * path)
 					// set up header info
 					s_currentPlugin = i;
 
-					s_pluginHeader.opcodeBase = i ? g_pluginManager.GetBaseOpcode(i - 1) : kObseOpcodeBase;
-					s_pluginHeader.numChunks = 0;
-					s_pluginHeader.length = 0;
+					UInt32	opcodeBase = i ? g_pluginManager.GetBaseOpcode(i - 1) : kObseOpcodeBase;
 
-					if(!s_pluginHeader.opcodeBase)
+					if(!opcodeBase)
 					{
 						_ERROR("HandleSaveGame: plugin with default opcode base registered for serialization");
 						continue;
 					}
 
-					s_chunkOpen = false;
+					s_saveWriter.BeginPlugin(opcodeBase);
 
 					// call the plugin
 					s_pluginCallbacks[i].save(NULL);
 
-					// flush the remaining chunk data
-					FlushWriteChunk();
-
-					if(s_pluginHeader.numChunks)
-					{
-						UInt64	curOffset = s_currentFile.GetOffset();
-
-						s_currentFile.SetOffset(s_pluginHeaderOffset);
-						s_currentFile.WriteBuf(&s_pluginHeader, sizeof(s_pluginHeader));
-
-						s_currentFile.SetOffset(curOffset);
-
-						s_fileHeader.numPlugins++;
-					}
+					s_saveWriter.EndPlugin();
 				}
 			}
 
 			// write header
-			s_currentFile.SetOffset(0);
-			s_currentFile.WriteBuf(&s_fileHeader, sizeof(s_fileHeader));
+			s_saveWriter.End();
 		}
 		catch(...)
 		{
 			_ERROR("HandleSaveGame: exception during save");
+			succeeded = false;
 		}
 
-		s_currentFile.Close();
+		if(succeeded)
+			WriteSaveBuffer(savePath);
+		else
+			DeleteFile(savePath.c_str());	// a co-save from an earlier save would not match the new savegame
+
+		s_saveWriter.Trim();
 	}
 }
 
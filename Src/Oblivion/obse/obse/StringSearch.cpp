@@ -0,0 +1,118 @@
+#include "StringSearch.h"
+#include <cctype>
+#include <cstring>
+
+static UInt8	s_identity[0x100];
+static UInt8	s_lower[0x100];
+static bool		s_bInitTables = false;
+
+StringSearch::StringSearch(const char* pattern, bool bCaseSensitive)
+	: m_pattern((const UInt8*)pattern), m_length(strlen(pattern))
+{
+	if (!s_bInitTables)
+	{
+		for (UInt32 i = 0; i < 0x100; i++)
+		{
+			s_identity[i] = i;
+			s_lower[i] = tolower(i);
+		}
+
+		s_bInitTables = true;
+	}
+
+	m_fold = bCaseSensitive ? s_identity : s_lower;
+
+	for (UInt32 i = 0; i < 0x100; i++)
+		m_skip[i] = m_length;
+	for (UInt32 i = 0; i + 1 < m_length; i++)
+		m_skip[m_fold[m_pattern[i]]] = m_length - 1 - i;
+}
+
+UInt32 StringSearch::Find(const char* text, UInt32 textLen) const
+{
+	if (!m_length)
+		return 0;
+	else if (m_length > textLen)
+		return -1;
+
+	const UInt8* src = (const UInt8*)text;
+
+	// single byte case sensitive search, let the CRT's vectorized scan do the work
+	if (m_length == 1 && m_fold == s_identity)
+	{
+		const void* match = memchr(src, m_pattern[0], textLen);
+		return match ? (const UInt8*)match - src : -1;
+	}
+
+	const UInt8 last = m_fold[m_pattern[m_length - 1]];
+	for (UInt32 pos = 0; pos <= textLen - m_length; )
+	{
+		UInt8 ch = m_fold[src[pos + m_length - 1]];
+		if (ch == last)
+		{
+			UInt32 i = 0;
+			while (i < m_length - 1 && m_fold[src[pos + i]] == m_fold[m_pattern[i]])
+				i++;
+
+			if (i == m_length - 1)
+				return pos;
+		}
+
+		pos += m_skip[ch];
+	}
+
+	return -1;
+}
+
+UInt32 StringSearch::FindAll(const char* text, UInt32 startPos, UInt32 endPos, UInt32 maxMatches, std::vector<UInt32>* outMatches) const
+{
+	if (!m_length)
+		return 0;
+
+	UInt32 numFound = 0;
+	UInt32 strIdx = startPos;
+	while (numFound < maxMatches)
+	{
+		UInt32 found = Find(text + strIdx, endPos - strIdx);
+		if (found == -1)
+			break;
+
+		if (outMatches)
+			outMatches->push_back(strIdx + found);
+
+		numFound++;
+		strIdx += found + m_length;
+	}
+
+	return numFound;
+}
+
+std::string StringSearch::Replace(const char* text, UInt32 textLen, const std::vector<UInt32>& matches, const char* replaceWith) const
+{
+	UInt32 replacementLen = strlen(replaceWith);
+	std::string result;
+	result.reserve(textLen - matches.size() * m_length + matches.size() * replacementLen);
+
+	UInt32 copiedTo = 0;
+	for (UInt32 i = 0; i < matches.size(); i++)
+	{
+		result.append(text + copiedTo, matches[i] - copiedTo);
+		result.append(replaceWith, replacementLen);
+		copiedTo = matches[i] + m_length;
+	}
+
+	result.append(text + copiedTo, textLen - copiedTo);
+	return result;
+}
+
+bool StringSearch::ClampRange(UInt32 textLen, UInt32 startPos, UInt32* numChars)
+{
+	if (startPos >= textLen)
+		return false;
+
+	// compared against the space left rather than summed, startPos + numChars can wrap
+	if (*numChars > textLen - startPos)
+		*numChars = textLen - startPos;
+
+	return true;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Boyer-Moore-Horspool search used by the string var Find, Count and Replace commands. Case is folded through
+// a lookup table inside the comparison so neither the searched text nor the pattern need to be copied
+class StringSearch
+{
+	const UInt8	* m_pattern;
+	UInt32		m_length;
+	const UInt8	* m_fold;		// maps each byte to the byte it compares as
+	UInt32		m_skip[0x100];	// distance to shift by, indexed by folded last byte of the window
+
+public:
+	StringSearch(const char* pattern, bool bCaseSensitive);
+
+	UInt32	Length() const	{ return m_length; }
+
+	// returns offset of first match in text, or -1
+	UInt32	Find(const char* text, UInt32 textLen) const;
+
+	// finds up to maxMatches non-overlapping matches in text[startPos, endPos), appending their offsets in text to
+	// outMatches if it is not NULL. Returns the number found, an empty pattern matches nothing
+	UInt32	FindAll(const char* text, UInt32 startPos, UInt32 endPos, UInt32 maxMatches, std::vector<UInt32>* outMatches) const;
+
+	// copies text with each match returned by FindAll() replaced by replaceWith
+	std::string	Replace(const char* text, UInt32 textLen, const std::vector<UInt32>& matches, const char* replaceWith) const;
+
+	// clamps numChars so [startPos, startPos + numChars) lies within a string of textLen characters
+	// returns false if startPos is past the end
+	static bool	ClampRange(UInt32 textLen, UInt32 startPos, UInt32* numChars);
+};
@@ -2,25 +2,52 @@
 #include "StringVar.h"
 #include "GameForms.h"
 #include <algorithm>
+#include <vector>
 #include "Script.h"
 #include "Hooks_Script.h"
 #include "ScriptUtils.h"
 #include "GameData.h"
+#include "StringSearch.h"
 
 StringVar::StringVar(const char* in_data, UInt32 in_refID)
 {
-	data = std::string(in_data);
+	shared = ArrayString::Intern(in_data, strlen(in_data));
 	owningModIndex = in_refID >> 24;
 }
 
+StringVar::~StringVar()
+{
+	if (shared)
+		shared->Release();
+}
+
 const char* StringVar::GetCString()
 {
-	return data.c_str();
+	return shared ? shared->c_str() : data.c_str();
 }
 
 void StringVar::Set(const char* newString)
 {
-	data = std::string(newString);
+	ReleaseShared();
+	data = newString;
+}
+
+void StringVar::ReleaseShared()
+{
+	if (shared)
+	{
+		shared->Release();
+		shared = NULL;
+	}
+}
+
+void StringVar::Unshare()
+{
+	if (shared)
+	{
+		data.assign(shared->c_str(), shared->length());
+		ReleaseShared();
+	}
 }
 
 SInt32 StringVar::Compare(char* rhs, bool caseSensitive)
@@ -28,7 +55,7 @@ SInt32 StringVar::Compare(char* rhs, bool caseSensitive)
 	SInt32 cmp = 0;
 	if (!caseSensitive)
 	{
-		cmp = _stricmp(data.c_str(), rhs);
+		cmp = _stricmp(GetCString(), rhs);
 		if (cmp > 0)
 			return -1;
 		else if (cmp < 0)
@@ -38,43 +65,33 @@ SInt32 StringVar::Compare(char* rhs, bool caseSensitive)
 	}
 	else
 	{
-		std::string str2(rhs);
-		if (data == str2)
-			return 0;
-		else if (data > str2)
+		cmp = strcmp(GetCString(), rhs);
+		if (cmp > 0)
 			return -1;
-		else
+		else if (cmp < 0)
 			return 1;
+		else
+			return 0;
 	}
 }
 
 void StringVar::Insert(const char* subString, UInt32 insertionPos)
 {
+	Unshare();
 	if (insertionPos < GetLength())
 		data.insert(insertionPos, subString);
 	else if (insertionPos == GetLength())
 		data.append(subString);
 }
 
-#pragma warning(disable : 4996)	// disable checked iterator warning for std::transform with char*
-UInt32 StringVar::Find(char* subString, UInt32 startPos, UInt32 numChars, bool bCaseSensitive)
+UInt32 StringVar::Find(const char* subString, UInt32 startPos, UInt32 numChars, bool bCaseSensitive)
 {
 	UInt32 pos = -1;
 
-	if (numChars + startPos >= GetLength())
-		numChars = GetLength() - startPos;
-
-	if (startPos < GetLength())
+	if (StringSearch::ClampRange(GetLength(), startPos, &numChars))
 	{
-		std::string source = data.substr(startPos, numChars);
-		if (!bCaseSensitive)
-		{
-			std::transform(source.begin(), source.end(), source.begin(), tolower);
-			std::transform(subString, subString + strlen(subString), subString, tolower);
-		}
-
-		 //pos = data.substr(startPos, numChars).find(subString);	//returns -1 if not found
-		pos = source.find(subString);
+		StringSearch search(subString, bCaseSensitive);
+		pos = search.Find(GetCString() + startPos, numChars);	//returns -1 if not found
 		if (pos != -1)
 			pos += startPos;
 	}
@@ -82,100 +99,38 @@ UInt32 StringVar::Find(char* subString, UInt32 startPos, UInt32 numChars, bool b
 	return pos;
 }
 
-UInt32 StringVar::Count(char* subString, UInt32 startPos, UInt32 numChars, bool bCaseSensitive)
+UInt32 StringVar::Count(const char* subString, UInt32 startPos, UInt32 numChars, bool bCaseSensitive)
 {
-	if (numChars + startPos >= GetLength())
-		numChars = GetLength() - startPos;
-
-	if (startPos >= GetLength())
-		return 0;
-
-	std::string source = data.substr(startPos, numChars);	//only count occurences beginning before endPos
-	UInt32 subStringLen = strlen(subString);
-	if (!subStringLen)
+	if (!StringSearch::ClampRange(GetLength(), startPos, &numChars))
 		return 0;
 
-	if (!bCaseSensitive)
-	{
-		std::transform(source.begin(), source.end(), source.begin(), tolower);
-		std::transform(subString, subString + strlen(subString), subString, tolower);
-	}
-
-	UInt32 strIdx = 0;
-	UInt32 count = 0;
-	while (strIdx < GetLength() && ((strIdx = source.find(subString, strIdx)) != -1))
-	{
-		count++;
-		strIdx += subStringLen;
-	}
-
-	return count;
+	// only count occurences within range, not overlapping
+	StringSearch search(subString, bCaseSensitive);
+	return search.FindAll(GetCString(), startPos, startPos + numChars, -1, NULL);
 }
-#pragma warning(default : 4996)
 
 UInt32 StringVar::GetLength()
 {
-	return data.length();
+	return shared ? shared->length() : data.length();
 }
 
-UInt32 StringVar::Replace(char* toReplace, char* replaceWith, UInt32 startPos, UInt32 numChars, bool bCaseSensitive, UInt32 numToReplace)
+UInt32 StringVar::Replace(const char* toReplace, const char* replaceWith, UInt32 startPos, UInt32 numChars, bool bCaseSensitive, UInt32 numToReplace)
 {
 	// calc length of substring
-	if (startPos >= GetLength())
+	if (!StringSearch::ClampRange(GetLength(), startPos, &numChars))
 		return 0;
-	else if (numChars + startPos > GetLength())
-		numChars = GetLength() - startPos;
-
-	UInt32 numReplaced = 0;
-	UInt32 replacementLen = strlen(replaceWith);
-	UInt32 toReplaceLen = strlen(toReplace);
-
-	// create substring
-	std::string srcStr = data.substr(startPos, numChars);
 
-	// remove substring from original string
-	data.erase(startPos, numChars);
-
-	UInt32 strIdx = 0;
-	while (numReplaced < numToReplace)// && (strIdx = srcStr.find(toReplace, strIdx)) != -1)
-	{
-		if (bCaseSensitive)
-		{
-			strIdx = srcStr.find(toReplace, strIdx);
-			if (strIdx == -1)
-				break;
-		}
-		else
-		{
-			std::string strToReplace = toReplace;
-			std::string::iterator iter = std::search(srcStr.begin() + strIdx, srcStr.end(), strToReplace.begin(), strToReplace.end(), ci_equal);
-			if (iter != srcStr.end())
-				strIdx = iter - srcStr.begin();
-			else
-				break;
-		}
-
-		numReplaced++;
-		srcStr.erase(strIdx, toReplaceLen);
-		if (strIdx == srcStr.length())
-		{
-			srcStr.append(replaceWith);
-			break;						// reached end of string so all done
-		}
-		else
-		{
-			srcStr.insert(strIdx, replaceWith);
-			strIdx += replacementLen;
-		}
-	}
+	// find all matches within range first so that the result can be built in one pass
+	StringSearch search(toReplace, bCaseSensitive);
+	std::vector<UInt32> matches;
+	if (!search.FindAll(GetCString(), startPos, startPos + numChars, numToReplace, &matches))
+		return 0;
 
-	// paste altered string back into original string
-	if (startPos == GetLength())
-		data.append(srcStr);
-	else
-		data.insert(startPos, srcStr);
+	std::string result = search.Replace(GetCString(), GetLength(), matches, replaceWith);
+	ReleaseShared();
+	data.swap(result);
 
-	return numReplaced;
+	return matches.size();
 }
 
 void StringVar::Erase(UInt32 startPos, UInt32 numChars)
@@ -184,16 +139,16 @@ void StringVar::Erase(UInt32 startPos, UInt32 numChars)
 		numChars = GetLength() - startPos;
 
 	if (startPos < GetLength())
+	{
+		Unshare();
 		data.erase(startPos, numChars);
+	}
 }
 
 std::string StringVar::SubString(UInt32 startPos, UInt32 numChars)
 {
-	if (numChars + startPos >= GetLength())
-		numChars = GetLength() - startPos;
-
-	if (startPos < GetLength())
-		return data.substr(startPos, numChars);
+	if (StringSearch::ClampRange(GetLength(), startPos, &numChars))
+		return std::string(GetCString() + startPos, numChars);
 	else
 		return "";
 }
@@ -223,7 +178,7 @@ UInt32 StringVar::GetCharType(char ch)
 char StringVar::At(UInt32 charPos)
 {
 	if (charPos < GetLength())
-		return data[charPos];
+		return GetCString()[charPos];
 	else
 		return -1;
 }
@@ -234,7 +189,7 @@ void StringVarMap::Save(OBSESerializationInterface* intfc)
 
 	intfc->OpenRecord('STVS', 0);
 
-	for (std::map<UInt32, StringVar*>::iterator iter = m_state->vars.begin();
+	for (_VarMap::iterator iter = m_state->vars.begin();
 			iter != m_state->vars.end();
 			iter++)
 	{
@@ -298,6 +253,12 @@ void StringVarMap::Load(OBSESerializationInterface* intfc)
 				modIndex = tempRefID >> 24;
 
 			intfc->ReadRecordData(&stringID, sizeof(stringID));
+			if (!IsValidLoadedID(stringID))
+			{
+				_MESSAGE("String ID %d is out of range, the co-save may be corrupt. Discarding", stringID);
+				continue;
+			}
+
 			intfc->ReadRecordData(&strLength, sizeof(strLength));
 			
 			intfc->ReadRecordData(buffer, strLength);
@@ -378,11 +339,7 @@ bool AssignToStringVar(ParamInfo * paramInfo, void * arg1, TESObjectREFR * thisO
 void StringVarMap::Clean()		// clean up any temporary vars
 {
 	if (m_state) {
-		while (m_state->tempVars.size())
-		{
-			UInt32 idToDelete = *(m_state->tempVars.begin());
-			Delete(idToDelete);
-		}
+		DeleteTemporaries();
 	}
 }
 
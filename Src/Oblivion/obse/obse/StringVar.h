@@ -2,6 +2,7 @@
 #include "Serialization.h"
 #include "GameAPI.h"
 #include "VarMap.h"
+#include "ArrayVar.h"
 
 // String changes layout:
 //
@@ -19,24 +20,32 @@
 
 class StringVar
 {
-	std::string data;
+	std::string	data;
+	ArrayString	* shared;	// pooled contents the var was created with, NULL once modified and held in data
 	UInt8		owningModIndex;
+
+	StringVar(const StringVar& rhs);
+	StringVar& operator=(const StringVar& rhs);
+
+	void		Unshare();			// copies shared contents into data before modifying them
+	void		ReleaseShared();	// discards shared contents, data is about to be replaced
 public:
 	StringVar(const char* in_data, UInt32 in_refID);
+	~StringVar();
 
 	void		Set(const char* newString);
 	SInt32		Compare(char* rhs, bool caseSensitive);
 	void		Insert(const char* subString, UInt32 insertionPos);
-	UInt32		Find(char* subString, UInt32 startPos, UInt32 numChars, bool bCaseSensitive = false);	//returns position of substring
-	UInt32		Count(char* subString, UInt32 startPos, UInt32 numChars, bool bCaseSensitive = false);
-	UInt32		Replace(char* toReplace, char* replaceWith, UInt32 startPos, UInt32 numChars, bool bCaseSensitive, UInt32 numToReplace = -1);	//returns num replaced
+	UInt32		Find(const char* subString, UInt32 startPos, UInt32 numChars, bool bCaseSensitive = false);	//returns position of substring
+	UInt32		Count(const char* subString, UInt32 startPos, UInt32 numChars, bool bCaseSensitive = false);
+	UInt32		Replace(const char* toReplace, const char* replaceWith, UInt32 startPos, UInt32 numChars, bool bCaseSensitive, UInt32 numToReplace = -1);	//returns num replaced
 	void		Erase(UInt32 startPos, UInt32 numChars);
 	std::string	SubString(UInt32 startPos, UInt32 numChars);
 	double*		ToFloat(UInt32 startPos, UInt32 numChars);
 	char		At(UInt32 charPos);
 	static UInt32	GetCharType(char ch);
 
-	std::string String()					{	return data;	}
+	std::string String()					{	return shared ? std::string(shared->c_str(), shared->length()) : data;	}
 	const char*	GetCString();
 	UInt32		GetLength();
 	UInt8		GetOwningModIndex();	
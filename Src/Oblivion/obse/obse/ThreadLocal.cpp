@@ -2,6 +2,7 @@
 #include "obse_common/SafeWrite.h"
 #include "FunctionScripts.h"
 #include "Loops.h"
+#include "ScriptUtils.h"
 
 #if OBLIVION_VERSION == OBLIVION_VERSION_1_2_416
 static const UInt32 kBackgroundLoaderThreadHookAddr = 0x0047CF3E;
@@ -27,6 +28,10 @@ void __stdcall HandleThreadExit()
 			delete data->loopManager;
 		}
 
+		if (data->expressionCache) {
+			delete data->expressionCache;
+		}
+
 		// free memory allocated for this thread's data
 		delete data;
 	}
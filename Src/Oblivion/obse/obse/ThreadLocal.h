@@ -5,6 +5,7 @@
 class ExpressionEvaluator;
 class UserFunctionManager;
 class LoopManager;
+class ExpressionCache;
 
 /* added v0020 to clean up the way we handle scripts executing in parallel */
 
@@ -13,8 +14,9 @@ struct ThreadLocalData
 	ExpressionEvaluator		* expressionEvaluator;	// evaluator at top of expression stack
 	UserFunctionManager		* userFunctionManager;	// per-thread singleton
 	LoopManager				* loopManager;			// per-thread singleton
+	ExpressionCache			* expressionCache;		// per-thread singleton
 
-	ThreadLocalData() : expressionEvaluator(NULL), userFunctionManager(NULL), loopManager(NULL) {
+	ThreadLocalData() : expressionEvaluator(NULL), userFunctionManager(NULL), loopManager(NULL), expressionCache(NULL) {
 		//
 	}
 
@@ -1,7 +1,7 @@
 #pragma once
 
 #include <map>
-#include <set>
+#include <vector>
 #include "Serialization.h"
 
 // simple template class used to support OBSE custom data types (strings, arrays, etc)
@@ -10,40 +10,190 @@ template <class Var>
 class VarMap
 {
 protected:
-	typedef std::map<UInt32, Var*>	_VarMap;
-	typedef std::set<UInt32>		_VarIDs;
+	// set of var IDs with constant time insert, erase and lookup. Top() is the most recently inserted ID still present
+	class _VarIDs {
+		std::vector<UInt32>	m_ids;
+		std::vector<UInt32>	m_pos;		// indexed by ID, position in m_ids + 1 or 0 if absent
 
+	public:
+		UInt32	size() const	{ return m_ids.size(); }
+		UInt32	Top() const		{ return m_ids.size() ? m_ids.back() : 0; }
+
+		bool Contains(UInt32 id) const {
+			return id < m_pos.size() && m_pos[id];
+		}
+
+		void Insert(UInt32 id) {
+			if (Contains(id))
+				return;
+			if (id >= m_pos.size())
+				m_pos.resize(id + 1, 0);
+			m_ids.push_back(id);
+			m_pos[id] = m_ids.size();
+		}
+
+		void Erase(UInt32 id) {
+			if (!Contains(id))
+				return;
+			UInt32 last = m_ids.back();
+			m_ids[m_pos[id] - 1] = last;
+			m_pos[last] = m_pos[id];
+			m_ids.pop_back();
+			m_pos[id] = 0;
+		}
+
+		// removes and returns Top()
+		UInt32 Pop() {
+			UInt32 id = Top();
+			Erase(id);
+			return id;
+		}
+
+		void clear() {
+			m_ids.clear();
+			m_pos.clear();
+		}
+	};
+
+	// vars indexed directly by ID. IDs are handed out compactly (see GetUnusedID) so the table stays dense
+	class _VarMap {
+		std::vector<Var*>	m_vars;		// index is var ID, NULL if unused. never ends with NULL
+		UInt32				m_count;
+
+	public:
+		// walks used IDs in increasing order. iter->first is the ID, iter->second the var
+		class iterator {
+			friend class _VarMap;
+
+			const std::vector<Var*>		* m_vars;
+			std::pair<UInt32, Var*>		m_entry;
+
+			iterator(const std::vector<Var*>* vars, UInt32 id) : m_vars(vars), m_entry(id, NULL) { Skip(); }
+
+			void Skip() {
+				while (m_entry.first < m_vars->size() && !(*m_vars)[m_entry.first])
+					m_entry.first++;
+				m_entry.second = m_entry.first < m_vars->size() ? (*m_vars)[m_entry.first] : NULL;
+			}
+
+		public:
+			const std::pair<UInt32, Var*>* operator->() const	{ return &m_entry; }
+			const std::pair<UInt32, Var*>& operator*() const	{ return m_entry; }
+			iterator& operator++()						{ m_entry.first++; Skip(); return *this; }
+			iterator operator++(int)					{ iterator prev = *this; ++*this; return prev; }
+			bool operator==(const iterator& rhs) const	{ return m_entry.first == rhs.m_entry.first; }
+			bool operator!=(const iterator& rhs) const	{ return m_entry.first != rhs.m_entry.first; }
+		};
+
+		_VarMap() : m_count(0) { }
+
+		iterator	begin() const	{ return iterator(&m_vars, 0); }
+		iterator	end() const		{ return iterator(&m_vars, m_vars.size()); }
+		UInt32		size() const	{ return m_count; }
+		UInt32		MaxID() const	{ return m_vars.size() ? m_vars.size() - 1 : 0; }
+
+		Var* Find(UInt32 id) const {
+			return id < m_vars.size() ? m_vars[id] : NULL;
+		}
+
+		void Insert(UInt32 id, Var* var) {
+			if (id >= m_vars.size())
+				m_vars.resize(id + 1, NULL);
+			if (!m_vars[id])
+				m_count++;
+			m_vars[id] = var;
+		}
+
+		void Erase(UInt32 id) {
+			if (id < m_vars.size() && m_vars[id]) {
+				m_vars[id] = NULL;
+				m_count--;
+				while (m_vars.size() && !m_vars.back())
+					m_vars.pop_back();
+			}
+		}
+
+		void clear() {
+			m_vars.clear();
+			m_count = 0;
+		}
+	};
+
+	// hit and miss counts of the caches of every state, so they survive loading a saved game
+	struct CacheStats {
+		UInt32	hits;
+		UInt32	misses;
+	};
+
+	// least recently used cache of vars, most recent first
 	class VarCache {
-		// if desired this can be replaced with an impl that caches more than one var without changing client code
-		UInt32		varID;
-		Var			* var;
+		struct Entry {
+			UInt32	varID;
+			Var		* var;
+		};
+
+		std::vector<Entry>	m_entries;
+		UInt32				m_maxEntries;
+		CacheStats			* m_stats;
 
 	public:
-		VarCache() : varID(0), var(NULL) { }
+		enum { kDefaultSize = 4 };
+
+		VarCache(CacheStats* stats) : m_maxEntries(kDefaultSize), m_stats(stats) { m_entries.reserve(kDefaultSize); }
 
 		~VarCache() { 
 			Reset(); 
 		}
 
+		void SetSize(UInt32 maxEntries) {
+			m_maxEntries = maxEntries;
+			if (m_entries.size() > maxEntries)
+				m_entries.resize(maxEntries);
+		}
+
 		void Insert(UInt32 id, Var* v) {
-			varID = id;
-			var = v;
+			if (!m_maxEntries)
+				return;
+
+			if (m_entries.size() < m_maxEntries)
+				m_entries.push_back(Entry());
+			for (UInt32 i = m_entries.size() - 1; i > 0; i--)
+				m_entries[i] = m_entries[i - 1];
+
+			m_entries[0].varID = id;
+			m_entries[0].var = v;
 		}
 
-		// clear all cached vars (only one in current impl)
+		// clear all cached vars
 		void Reset() {
-			varID = 0;
-			var = NULL;
+			m_entries.clear();
 		}
 
 		void Remove(UInt32 id) {
-			if (id == varID) {
-				Reset();
+			for (UInt32 i = 0; i < m_entries.size(); i++) {
+				if (m_entries[i].varID == id) {
+					m_entries.erase(m_entries.begin() + i);
+					return;
+				}
 			}
 		}
 
 		Var* Get(UInt32 id) {
-			return (varID == id) ? var : NULL;
+			for (UInt32 i = 0; i < m_entries.size(); i++) {
+				if (m_entries[i].varID == id) {
+					// move to front
+					Entry hit = m_entries[i];
+					for ( ; i > 0; i--)
+						m_entries[i] = m_entries[i - 1];
+					m_entries[0] = hit;
+
+					m_stats->hits++;
+					return hit.var;
+				}
+			}
+
+			m_stats->misses++;
+			return NULL;
 		}
 	};
 
@@ -53,27 +203,19 @@ protected:
 		_VarIDs		availableVars;	// IDs < greatest used ID available as IDs for new vars
 		VarCache	cache;
 
+		State(CacheStats* cacheStats) : cache(cacheStats) { }
+
 		~State() {
 			Reset();
 		}
 
 		UInt32	GetUnusedID()
 		{
-			UInt32 id = 1;
+			UInt32 id = availableVars.Pop();
+			if (id)
+				return id;
 
-			if (availableVars.size())
-			{
-				id = *availableVars.begin();
-				availableVars.erase(id);
-			}
-			else if (vars.size())
-			{
-				_VarMap::iterator iter = vars.end();
-				--iter;
-				id = iter->first + 1;
-			}
-
-			return id;
+			return vars.size() ? vars.MaxID() + 1 : 1;
 		}
 
 		Var*	Get(UInt32 varID)
@@ -84,10 +226,10 @@ protected:
 					return var;
 				}
 
-				_VarMap::iterator it = vars.find(varID);
-				if (it != vars.end())  {
-					cache.Insert(varID, it->second);
-					return it->second;
+				var = vars.Find(varID);
+				if (var) {
+					cache.Insert(varID, var);
+					return var;
 				}
 			}
 			
@@ -101,36 +243,30 @@ protected:
 
 		void Insert(UInt32 varID, Var* var)
 		{
-			vars[varID] = var;
+			cache.Remove(varID);
+			availableVars.Erase(varID);
+			vars.Insert(varID, var);
 		}
 
 		void	Delete(UInt32 varID)
 		{
-			Var* var = Get(varID);
+			Var* var = vars.Find(varID);
 			if (var)
 			{
 				cache.Remove(varID);
 
 				delete var;
-				vars.erase(varID);
+				vars.Erase(varID);
 			}
-			tempVars.erase(varID);
+			tempVars.Erase(varID);
 			SetIDAvailable(varID);
 		}
 
 		void Reset()
 		{
 			cache.Reset();
-			_VarMap::iterator itEnd = vars.end();
-			_VarMap::iterator iter = vars.begin();
-			_VarMap::iterator toErase = iter;
-			while (iter != itEnd)
-			{
+			for (typename _VarMap::iterator iter = vars.begin(); iter != vars.end(); ++iter)
 				delete iter->second;
-				toErase = iter;
-				++iter;
-				vars.erase(toErase);
-			}
 
 			vars.clear();
 			tempVars.clear();
@@ -140,25 +276,36 @@ protected:
 		void	MarkTemporary(UInt32 varID, bool bTemporary)
 		{
 			if (bTemporary)
-				tempVars.insert(varID);
+				tempVars.Insert(varID);
 			else
-				tempVars.erase(varID);
+				tempVars.Erase(varID);
 		}
 
 		bool IsTemporary(UInt32 varID)
 		{
-			return (tempVars.find(varID) != tempVars.end()) ? true : false;
+			return tempVars.Contains(varID);
 		}
 
 		void SetIDAvailable(UInt32 id) {
 			if (id) {
-				availableVars.insert(id);
+				availableVars.Insert(id);
 			}
 		}
 	};
 
-	State	* m_state;				// currently loaded vars
-	State	* m_backupState;		// previously loaded vars, used as restore point in the event a saved game fails to load
+	State		* m_state;				// currently loaded vars
+	State		* m_backupState;		// previously loaded vars, used as restore point in the event a saved game fails to load
+	UInt32		m_cacheSize;			// applied to each new state
+	CacheStats	m_cacheStats;			// shared by each state's cache
+
+	// IDs are handed out compactly, so an ID beyond this in a co-save can only come from corrupt data.
+	// The tables above are indexed by ID and loading it would allocate an entry for every ID below it
+	enum { kMaxLoadedID = 0x00100000 };
+
+	static bool IsValidLoadedID(UInt32 id)
+	{
+		return id && id <= kMaxLoadedID;
+	}
 
 	UInt32	GetUnusedID()
 	{
@@ -171,9 +318,11 @@ protected:
 	}
 
 public:
-	VarMap()
+	VarMap() : m_cacheSize(VarCache::kDefaultSize)
 	{
-		m_state = new State();
+		m_cacheStats.hits = 0;
+		m_cacheStats.misses = 0;
+		m_state = new State(&m_cacheStats);
 		m_backupState = NULL;
 	}
 
@@ -203,6 +352,40 @@ public:
 		m_state->Delete(varID);
 	}
 
+	// deletes vars queued as temporary, including any queued while doing so
+	// given a budget, stops once that many microseconds have passed and leaves the rest for the next call
+	// returns the number of vars left in the queue
+	UInt32 DeleteTemporaries(UInt32 budgetMicroseconds = 0)
+	{
+		static const UInt32 kDeletesPerTimeCheck = 16;
+
+		LARGE_INTEGER freq, start, now;
+		if (budgetMicroseconds)
+		{
+			QueryPerformanceFrequency(&freq);
+			QueryPerformanceCounter(&start);
+		}
+
+		UInt32 numDeleted = 0;
+		while (m_state->tempVars.size())
+		{
+			Delete(m_state->tempVars.Top());
+			if (budgetMicroseconds && !(++numDeleted % kDeletesPerTimeCheck))
+			{
+				QueryPerformanceCounter(&now);
+				if ((now.QuadPart - start.QuadPart) * 1000000 / freq.QuadPart >= budgetMicroseconds)
+					break;
+			}
+		}
+
+		return m_state->tempVars.size();
+	}
+
+	UInt32	NumVars()
+	{
+		return m_state->vars.size();
+	}
+
 	void Reset(OBSESerializationInterface* intfc)
 	{
 		m_state->Reset();
@@ -211,7 +394,8 @@ public:
 	void Preload()
 	{
 		m_backupState = m_state;
-		m_state = new State();
+		m_state = new State(&m_cacheStats);
+		m_state->cache.SetSize(m_cacheSize);
 	}
 
 	void PostLoad(bool bLoadSucceeded) 
@@ -242,4 +426,29 @@ public:
 	{
 		return m_state->IsTemporary(varID);
 	}
+
+	// number of vars cached by Get(), 0 disables the cache. Kept across loads
+	void SetCacheSize(UInt32 maxEntries)
+	{
+		m_cacheSize = maxEntries;
+		m_state->cache.SetSize(maxEntries);
+		if (m_backupState)
+			m_backupState->cache.SetSize(maxEntries);
+	}
+
+	UInt32 GetCacheSize()
+	{
+		return m_cacheSize;
+	}
+
+	// counted since the game started, across loads
+	UInt32 GetCacheHits()
+	{
+		return m_cacheStats.hits;
+	}
+
+	UInt32 GetCacheMisses()
+	{
+		return m_cacheStats.misses;
+	}
 };
\ No newline at end of file